@@ -38,12 +38,17 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <string>
+
+#include <android-base/stringprintf.h>
+
 #define OP_DOWNLOAD   1
 #define OP_COMMAND    2
 #define OP_QUERY      3
 #define OP_NOTICE     4
 #define OP_DOWNLOAD_SPARSE 5
 #define OP_WAIT_FOR_DISCONNECT 6
+#define OP_DEFERRED   7
 
 typedef struct Action Action;
 
@@ -67,8 +72,13 @@ struct Action {
     double start;
 };
 
-static Action *action_list = 0;
-static Action *action_last = 0;
+// The queue is per thread so that several devices can be driven at once.
+static thread_local Action *action_list = 0;
+static thread_local Action *action_last = 0;
+
+// While an OP_DEFERRED action runs, newly queued actions are spliced in
+// directly after it (in order) rather than appended to the end of the list.
+static thread_local Action *action_insert_after = 0;
 
 
 
@@ -86,17 +96,53 @@ bool fb_getvar(Transport* transport, const std::string& key, std::string* value)
     return true;
 }
 
+// Prefix for status lines, set per thread when flashing several devices at once.
+static thread_local std::string status_prefix;
+
+void fb_set_status_prefix(const std::string& prefix)
+{
+    status_prefix = prefix;
+}
+
+__attribute__((__format__(__printf__, 1, 2)))
+static void status_printf(const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    std::string line;
+    android::base::StringAppendV(&line, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "%s%s", status_prefix.c_str(), line.c_str());
+}
+
 static int cb_default(Action* a, int status, const char* resp) {
     if (status) {
-        fprintf(stderr,"FAILED (%s)\n", resp);
+        status_printf("FAILED (%s)\n", resp);
     } else {
         double split = now();
-        fprintf(stderr,"OKAY [%7.3fs]\n", (split - a->start));
+        status_printf("OKAY [%7.3fs]\n", (split - a->start));
         a->start = split;
     }
     return status;
 }
 
+static int cb_download(Action* a, int status, const char* resp) {
+    if (status) {
+        status_printf("FAILED (%s)\n", resp);
+        return status;
+    }
+    double split = now();
+    double elapsed = split - a->start;
+    if (elapsed > 0) {
+        status_printf("OKAY [%7.3fs] (%.1f MB/s)\n", elapsed,
+                a->size / elapsed / (1024 * 1024));
+    } else {
+        status_printf("OKAY [%7.3fs]\n", elapsed);
+    }
+    a->start = split;
+    return status;
+}
+
 static Action *queue_action(unsigned op, const char *fmt, ...)
 {
     va_list ap;
@@ -114,12 +160,18 @@ static Action *queue_action(unsigned op, const char *fmt, ...)
         die("Command length (%d) exceeds maximum size (%d)", cmdsize, sizeof(a->cmd));
     }
 
-    if (action_last) {
+    if (action_insert_after) {
+        a->next = action_insert_after->next;
+        action_insert_after->next = a;
+        if (action_last == action_insert_after) action_last = a;
+        action_insert_after = a;
+    } else if (action_last) {
         action_last->next = a;
+        action_last = a;
     } else {
         action_list = a;
+        action_last = a;
     }
-    action_last = a;
     a->op = op;
     a->func = cb_default;
 
@@ -150,6 +202,7 @@ void fb_queue_flash(const char *ptn, void *data, unsigned sz)
     a->data = data;
     a->size = sz;
     a->msg = mkmsg("sending '%s' (%d KB)", ptn, sz / 1024);
+    a->func = cb_download;
 
     a = queue_action(OP_COMMAND, "flash:%s", ptn);
     a->msg = mkmsg("writing '%s'", ptn);
@@ -161,8 +214,10 @@ void fb_queue_flash_sparse(const char* ptn, struct sparse_file* s, unsigned sz,
 
     a = queue_action(OP_DOWNLOAD_SPARSE, "");
     a->data = s;
-    a->size = 0;
+    // Only used to report the transfer rate; the sparse download computes its own length.
+    a->size = sz;
     a->msg = mkmsg("sending sparse '%s' %zu/%zu (%d KB)", ptn, current, total, sz / 1024);
+    a->func = cb_download;
 
     a = queue_action(OP_COMMAND, "flash:%s", ptn);
     a->msg = mkmsg("writing '%s' %zu/%zu", ptn, current, total);
@@ -199,14 +254,14 @@ static int cb_check(Action* a, int status, const char* resp, int invert)
     int yes;
 
     if (status) {
-        fprintf(stderr,"FAILED (%s)\n", resp);
+        status_printf("FAILED (%s)\n", resp);
         return status;
     }
 
     if (a->prod) {
         if (strcmp(a->prod, cur_product) != 0) {
             double split = now();
-            fprintf(stderr,"IGNORE, product is %s required only for %s [%7.3fs]\n",
+            status_printf("IGNORE, product is %s required only for %s [%7.3fs]\n",
                     cur_product, a->prod, (split - a->start));
             a->start = split;
             return 0;
@@ -218,7 +273,7 @@ static int cb_check(Action* a, int status, const char* resp, int invert)
 
     if (yes) {
         double split = now();
-        fprintf(stderr,"OKAY [%7.3fs]\n", (split - a->start));
+        status_printf("OKAY [%7.3fs]\n", (split - a->start));
         a->start = split;
         return 0;
     }
@@ -257,10 +312,10 @@ void fb_queue_require(const char *prod, const char *var,
 
 static int cb_display(Action* a, int status, const char* resp) {
     if (status) {
-        fprintf(stderr, "%s FAILED (%s)\n", a->cmd, resp);
+        status_printf("%s FAILED (%s)\n", a->cmd, resp);
         return status;
     }
-    fprintf(stderr, "%s: %s\n", (char*) a->data, resp);
+    status_printf("%s: %s\n", (char*) a->data, resp);
     return 0;
 }
 
@@ -275,7 +330,7 @@ void fb_queue_display(const char *var, const char *prettyname)
 
 static int cb_save(Action* a, int status, const char* resp) {
     if (status) {
-        fprintf(stderr, "%s FAILED (%s)\n", a->cmd, resp);
+        status_printf("%s FAILED (%s)\n", a->cmd, resp);
         return status;
     }
     strncpy(reinterpret_cast<char*>(a->data), resp, a->size);
@@ -328,6 +383,12 @@ void fb_queue_wait_for_disconnect(void)
     queue_action(OP_WAIT_FOR_DISCONNECT, "");
 }
 
+void fb_queue_deferred(const std::function<void()>& func)
+{
+    Action *a = queue_action(OP_DEFERRED, "");
+    a->data = new std::function<void()>(func);
+}
+
 int fb_execute_queue(Transport* transport)
 {
     Action *a;
@@ -345,7 +406,7 @@ int fb_execute_queue(Transport* transport)
         if (start < 0) start = a->start;
         if (a->msg) {
             // fprintf(stderr,"%30s... ",a->msg);
-            fprintf(stderr,"%s...\n",a->msg);
+            status_printf("%s...\n",a->msg);
         }
         if (a->op == OP_DOWNLOAD) {
             status = fb_download_data(transport, a->data, a->size);
@@ -360,18 +421,25 @@ int fb_execute_queue(Transport* transport)
             status = a->func(a, status, status ? fb_get_error().c_str() : resp);
             if (status) break;
         } else if (a->op == OP_NOTICE) {
-            fprintf(stderr,"%s\n",(char*)a->data);
+            status_printf("%s\n",(char*)a->data);
         } else if (a->op == OP_DOWNLOAD_SPARSE) {
             status = fb_download_data_sparse(transport, reinterpret_cast<sparse_file*>(a->data));
             status = a->func(a, status, status ? fb_get_error().c_str() : "");
             if (status) break;
         } else if (a->op == OP_WAIT_FOR_DISCONNECT) {
             transport->WaitForDisconnect();
+        } else if (a->op == OP_DEFERRED) {
+            auto func = reinterpret_cast<std::function<void()>*>(a->data);
+            action_insert_after = a;
+            (*func)();
+            action_insert_after = 0;
+            delete func;
+            a->data = nullptr;
         } else {
             die("bogus action");
         }
     }
 
-    fprintf(stderr,"finished. total time: %.3fs\n", (now() - start));
+    status_printf("finished. total time: %.3fs\n", (now() - start));
     return status;
 }
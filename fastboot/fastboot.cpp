@@ -45,6 +45,10 @@
 
 #include <chrono>
 #include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -71,7 +75,7 @@
 #define O_BINARY 0
 #endif
 
-char cur_product[FB_RESPONSE_SZ + 1];
+thread_local char cur_product[FB_RESPONSE_SZ + 1];
 
 static const char* serial = nullptr;
 static const char* product = nullptr;
@@ -79,7 +83,10 @@ static const char* cmdline = nullptr;
 static unsigned short vendor_id = 0;
 static int long_listing = 0;
 static int64_t sparse_limit = -1;
-static int64_t target_sparse_limit = -1;
+
+// The max-download-size each device reported, queried once per transport.
+static std::mutex target_sparse_limits_lock;
+static std::map<Transport*, int64_t> target_sparse_limits;
 
 static unsigned page_size = 2048;
 static unsigned base_addr      = 0x10000000;
@@ -211,10 +218,6 @@ static int match_fastboot_with_serial(usb_ifc_info* info, const char* local_seri
     return 0;
 }
 
-static int match_fastboot(usb_ifc_info* info) {
-    return match_fastboot_with_serial(info, serial);
-}
-
 static int list_devices_callback(usb_ifc_info* info) {
     if (match_fastboot_with_serial(info, nullptr) == 0) {
         std::string serial = info->serial_number;
@@ -243,16 +246,12 @@ static int list_devices_callback(usb_ifc_info* info) {
 // If |serial| is non-null but invalid, this prints an error message to stderr and returns nullptr.
 // Otherwise it blocks until the target is available.
 //
-// The returned Transport is a singleton, so multiple calls to this function will return the same
-// object, and the caller should not attempt to delete the returned Transport.
-static Transport* open_device() {
-    static Transport* transport = nullptr;
+// Every call opens a new Transport, so several devices can be connected at once. open_device()
+// keeps the one used by single-device commands.
+static Transport* connect_device(const char* serial) {
+    Transport* transport = nullptr;
     bool announce = true;
 
-    if (transport != nullptr) {
-        return transport;
-    }
-
     Socket::Protocol protocol = Socket::Protocol::kTcp;
     std::string host;
     int port = 0;
@@ -292,7 +291,9 @@ static Transport* open_device() {
                 fprintf(stderr, "error: %s\n", error.c_str());
             }
         } else {
-            transport = usb_open(match_fastboot);
+            transport = usb_open([serial](usb_ifc_info* info) {
+                return match_fastboot_with_serial(info, serial);
+            });
         }
 
         if (transport != nullptr) {
@@ -307,6 +308,15 @@ static Transport* open_device() {
     }
 }
 
+static Transport* open_device() {
+    static Transport* transport = nullptr;
+
+    if (transport == nullptr) {
+        transport = connect_device(serial);
+    }
+    return transport;
+}
+
 static void list_devices() {
     // We don't actually open a USB device here,
     // just getting our callback called so we can
@@ -372,6 +382,9 @@ static void usage() {
             "                                           For ethernet, provide an address in the\n"
             "                                           form <protocol>:<hostname>[:port] where\n"
             "                                           <protocol> is either tcp or udp.\n"
+            "                                           May be repeated to flash, erase and\n"
+            "                                           reboot several devices in parallel;\n"
+            "                                           images are loaded only once.\n"
             "  -p <product>                             Specify product name.\n"
             "  -c <cmdline>                             Override kernel commandline.\n"
             "  -i <vendor id>                           Specify a custom USB vendor id.\n"
@@ -724,22 +737,27 @@ static struct sparse_file **load_sparse_files(int fd, int max_size)
 {
     struct sparse_file* s = sparse_file_import_auto(fd, false, true);
     if (!s) {
-        die("cannot sparse read file\n");
+        fprintf(stderr, "cannot sparse read file\n");
+        return nullptr;
     }
 
     int files = sparse_file_resparse(s, max_size, nullptr, 0);
     if (files < 0) {
-        die("Failed to resparse\n");
+        fprintf(stderr, "Failed to resparse\n");
+        return nullptr;
     }
 
     sparse_file** out_s = reinterpret_cast<sparse_file**>(calloc(sizeof(struct sparse_file *), files + 1));
     if (!out_s) {
-        die("Failed to allocate sparse file array\n");
+        fprintf(stderr, "Failed to allocate sparse file array\n");
+        return nullptr;
     }
 
     files = sparse_file_resparse(s, max_size, out_s, files);
     if (files < 0) {
-        die("Failed to resparse\n");
+        fprintf(stderr, "Failed to resparse\n");
+        free(out_s);
+        return nullptr;
     }
 
     return out_s;
@@ -767,31 +785,43 @@ static int64_t get_target_sparse_limit(Transport* transport) {
     return limit;
 }
 
-static int64_t get_sparse_limit(Transport* transport, int64_t size) {
-    int64_t limit;
+// Returns the max-download-size transport reported, or -1 if it hasn't been queried yet.
+static int64_t peek_target_sparse_limit(Transport* transport) {
+    std::lock_guard<std::mutex> lock(target_sparse_limits_lock);
+    auto it = target_sparse_limits.find(transport);
+    return it == target_sparse_limits.end() ? -1 : it->second;
+}
 
+// Returns the size images sent to transport are resparsed to, or 0 if they're never resparsed.
+// This may query the target, so it must be called from the thread driving transport.
+static int64_t get_max_sparse_limit(Transport* transport) {
     if (sparse_limit == 0) {
         return 0;
     } else if (sparse_limit > 0) {
-        limit = sparse_limit;
-    } else {
-        if (target_sparse_limit == -1) {
-            target_sparse_limit = get_target_sparse_limit(transport);
-        }
-        if (target_sparse_limit > 0) {
-            limit = target_sparse_limit;
-        } else {
-            return 0;
-        }
+        return sparse_limit;
     }
 
-    if (size > limit) {
-        return limit;
+    int64_t limit = peek_target_sparse_limit(transport);
+    if (limit == -1) {
+        limit = get_target_sparse_limit(transport);
+        std::lock_guard<std::mutex> lock(target_sparse_limits_lock);
+        target_sparse_limits[transport] = limit;
     }
+    return limit > 0 ? limit : 0;
+}
 
+// Returns the size to resparse an image of the given size to, or 0 if it fits as is.
+static int64_t sparse_limit_for_size(int64_t max_limit, int64_t size) {
+    if (max_limit > 0 && size > max_limit) {
+        return max_limit;
+    }
     return 0;
 }
 
+static int64_t get_sparse_limit(Transport* transport, int64_t size) {
+    return sparse_limit_for_size(get_max_sparse_limit(transport), size);
+}
+
 // Until we get lazy inode table init working in make_ext4fs, we need to
 // erase partitions of type ext4 before flashing a filesystem so no stale
 // inodes are left lying around.  Otherwise, e2fsck gets very upset.
@@ -803,14 +833,16 @@ static bool needs_erase(Transport* transport, const char* partition) {
     return partition_type == "ext4";
 }
 
-static bool load_buf_fd(Transport* transport, int fd, struct fastboot_buffer* buf) {
+// Loads the image in fd, resparsing it if it's bigger than max_limit (see get_max_sparse_limit).
+// This doesn't use the transport, so it's safe to call from any thread.
+static bool load_buf_fd(int64_t max_limit, int fd, struct fastboot_buffer* buf) {
     int64_t sz = get_file_size(fd);
     if (sz == -1) {
         return false;
     }
 
     lseek64(fd, 0, SEEK_SET);
-    int64_t limit = get_sparse_limit(transport, sz);
+    int64_t limit = sparse_limit_for_size(max_limit, sz);
     if (limit) {
         sparse_file** s = load_sparse_files(fd, limit);
         if (s == nullptr) {
@@ -820,7 +852,7 @@ static bool load_buf_fd(Transport* transport, int fd, struct fastboot_buffer* bu
         buf->data = s;
     } else {
         void* data = load_fd(fd, &sz);
-        if (data == nullptr) return -1;
+        if (data == nullptr) return false;
         buf->type = FB_BUFFER;
         buf->data = data;
         buf->sz = sz;
@@ -834,7 +866,7 @@ static bool load_buf(Transport* transport, const char* fname, struct fastboot_bu
     if (fd == -1) {
         return false;
     }
-    return load_buf_fd(transport, fd, buf);
+    return load_buf_fd(get_max_sparse_limit(transport), fd, buf);
 }
 
 static void flash_buf(const char *pname, struct fastboot_buffer *buf)
@@ -1028,6 +1060,89 @@ static void do_for_partitions(Transport* transport, const std::string& part, con
     }
 }
 
+// Loads an image for flashall/update on a background thread. Each image's
+// loader is started when the previous image starts downloading, so reading,
+// unzipping and resparsing the next image overlaps with the current transfer.
+// The loader is given the transport's get_max_sparse_limit up front, since
+// the transport can only be used from the thread driving it.
+class ImageLoader {
+  public:
+    ImageLoader(int64_t max_sparse_limit, const std::function<int()>& open)
+        : max_sparse_limit_(max_sparse_limit), open_(open) {}
+
+    void Start() {
+        if (!started_) {
+            started_ = true;
+            result_ = std::async(std::launch::async, [this]() { return Load(); });
+        }
+    }
+
+    bool Wait(struct fastboot_buffer* buf) {
+        Start();
+        if (!result_.get()) {
+            errno = error_;
+            return false;
+        }
+        *buf = buf_;
+        return true;
+    }
+
+  private:
+    bool Load() {
+        int fd = open_();
+        if (fd == -1 || !load_buf_fd(max_sparse_limit_, fd, &buf_)) {
+            error_ = errno;
+            return false;
+        }
+        return true;
+    }
+
+    int64_t max_sparse_limit_;
+    std::function<int()> open_;
+    bool started_ = false;
+    std::future<bool> result_;
+    struct fastboot_buffer buf_;
+    int error_ = 0;
+
+    DISALLOW_COPY_AND_ASSIGN(ImageLoader);
+};
+
+struct PrefetchedImage {
+    std::string name;
+    std::string part_name;
+    std::string slot;
+    // Optional images that can't be loaded are skipped rather than fatal.
+    bool optional;
+    std::unique_ptr<ImageLoader> loader;
+    std::function<void(const std::string&, struct fastboot_buffer*)> flash;
+};
+
+// Queues each image's flash actions behind a deferred action that waits for
+// its loader and kicks off the loader for the image after it.
+static void queue_prefetched_images(Transport* transport,
+                                    std::vector<std::shared_ptr<PrefetchedImage>> images) {
+    if (images.empty()) return;
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        std::shared_ptr<PrefetchedImage> next = i + 1 < images.size() ? images[i + 1] : nullptr;
+        std::shared_ptr<PrefetchedImage> image = images[i];
+        fb_queue_deferred([transport, image, next]() {
+            fastboot_buffer buf;
+            bool loaded = image->loader->Wait(&buf);
+            if (!loaded && !image->optional) {
+                die("cannot load '%s': %s", image->name.c_str(), strerror(errno));
+            }
+            if (next) next->loader->Start();
+            if (!loaded) return;
+            do_for_partitions(transport, image->part_name, image->slot,
+                              [&](const std::string& partition) {
+                                  image->flash(partition, &buf);
+                              }, false);
+        });
+    }
+    images[0]->loader->Start();
+}
+
 static void do_flash(Transport* transport, const char* pname, const char* fname) {
     struct fastboot_buffer buf;
 
@@ -1101,6 +1216,11 @@ static void do_update(Transport* transport, const char* filename, const std::str
             skip_secondary = true;
         }
     }
+    // Extraction happens on loader threads while signatures are read on the
+    // main thread, so all access to the archive is serialized.
+    auto zip_lock = std::make_shared<std::mutex>();
+    int64_t max_sparse_limit = get_max_sparse_limit(transport);
+    std::vector<std::shared_ptr<PrefetchedImage>> prefetched;
     for (size_t i = 0; i < arraysize(images); ++i) {
         const char* slot = slot_override.c_str();
         if (images[i].is_secondary) {
@@ -1111,34 +1231,50 @@ static void do_update(Transport* transport, const char* filename, const std::str
             }
         }
 
-        int fd = unzip_to_file(zip, images[i].img_name);
-        if (fd == -1) {
+        ZipString zip_entry_name(images[i].img_name);
+        ZipEntry zip_entry;
+        if (FindEntry(zip, zip_entry_name, &zip_entry) != 0) {
             if (images[i].is_optional) {
                 continue;
             }
+            fprintf(stderr, "archive does not contain '%s'\n", images[i].img_name);
             CloseArchive(zip);
-            exit(1); // unzip_to_file already explained why.
-        }
-        fastboot_buffer buf;
-        if (!load_buf_fd(transport, fd, &buf)) {
-            die("cannot load %s from flash: %s", images[i].img_name, strerror(errno));
+            exit(1);
         }
 
-        auto update = [&](const std::string &partition) {
-            do_update_signature(zip, images[i].sig_name);
+        char* img_name = images[i].img_name;
+        char* sig_name = images[i].sig_name;
+        auto image = std::make_shared<PrefetchedImage>();
+        image->name = img_name;
+        image->part_name = images[i].part_name;
+        image->slot = slot;
+        image->optional = images[i].is_optional;
+        image->loader.reset(new ImageLoader(max_sparse_limit, [zip, zip_lock, img_name]() {
+            std::lock_guard<std::mutex> lock(*zip_lock);
+            return unzip_to_file(zip, img_name);
+        }));
+        image->flash = [transport, zip, zip_lock, sig_name, erase_first](
+                const std::string& partition, fastboot_buffer* buf) {
+            {
+                std::lock_guard<std::mutex> lock(*zip_lock);
+                do_update_signature(zip, sig_name);
+            }
             if (erase_first && needs_erase(transport, partition.c_str())) {
                 fb_queue_erase(partition.c_str());
             }
-            flash_buf(partition.c_str(), &buf);
+            flash_buf(partition.c_str(), buf);
             /* not closing the fd here since the sparse code keeps the fd around
              * but hasn't mmaped data yet. The tmpfile will get cleaned up when the
              * program exits.
              */
         };
-        do_for_partitions(transport, images[i].part_name, slot, update, false);
+        prefetched.push_back(image);
     }
+    queue_prefetched_images(transport, prefetched);
+
+    // The archive stays open until the images have been extracted.
+    fb_queue_deferred([zip]() { CloseArchive(zip); });
 
-    CloseArchive(zip);
     if (slot_override == "all") {
         set_active(transport, "a");
     } else {
@@ -1190,6 +1326,8 @@ static void do_flashall(Transport* transport, const std::string& slot_override,
         }
     }
 
+    int64_t max_sparse_limit = get_max_sparse_limit(transport);
+    std::vector<std::shared_ptr<PrefetchedImage>> prefetched;
     for (size_t i = 0; i < arraysize(images); i++) {
         const char* slot = NULL;
         if (images[i].is_secondary) {
@@ -1199,21 +1337,32 @@ static void do_flashall(Transport* transport, const std::string& slot_override,
         }
         if (!slot) continue;
         fname = find_item_given_name(images[i].img_name, product);
-        fastboot_buffer buf;
-        if (!load_buf(transport, fname.c_str(), &buf)) {
+        // Loading happens while earlier images are flashed, so make sure every
+        // required image is there before anything is written to the device.
+        if (access(fname.c_str(), R_OK) != 0) {
             if (images[i].is_optional) continue;
             die("could not load '%s': %s\n", images[i].img_name, strerror(errno));
         }
 
-        auto flashall = [&](const std::string &partition) {
+        auto image = std::make_shared<PrefetchedImage>();
+        image->name = images[i].img_name;
+        image->part_name = images[i].part_name;
+        image->slot = slot;
+        image->optional = images[i].is_optional;
+        image->loader.reset(new ImageLoader(max_sparse_limit, [fname]() {
+            return open(fname.c_str(), O_RDONLY | O_BINARY);
+        }));
+        image->flash = [transport, fname, erase_first](const std::string& partition,
+                                                       fastboot_buffer* buf) {
             do_send_signature(fname.c_str());
             if (erase_first && needs_erase(transport, partition.c_str())) {
                 fb_queue_erase(partition.c_str());
             }
-            flash_buf(partition.c_str(), &buf);
+            flash_buf(partition.c_str(), buf);
         };
-        do_for_partitions(transport, images[i].part_name, slot, flashall, false);
+        prefetched.push_back(image);
     }
+    queue_prefetched_images(transport, prefetched);
 
     if (slot_override == "all") {
         set_active(transport, "a");
@@ -1222,6 +1371,209 @@ static void do_flashall(Transport* transport, const std::string& slot_override,
     }
 }
 
+// Flashing several devices from one invocation ("-s" given more than once).
+// Each image is loaded, and resparsed once per distinct download limit, into
+// read-only memory shared by all devices; every device then builds and runs
+// its own command queue on its own thread.
+struct SharedImage {
+    std::vector<std::pair<void*, int64_t>> chunks;
+};
+
+static std::mutex shared_images_lock;
+static std::map<std::pair<std::string, int64_t>,
+                std::shared_future<std::shared_ptr<SharedImage>>> shared_images;
+
+static int write_to_memory(void* priv, const void* data, int len) {
+    char** cursor = reinterpret_cast<char**>(priv);
+    memcpy(*cursor, data, len);
+    *cursor += len;
+    return 0;
+}
+
+static std::shared_ptr<SharedImage> load_shared_image_once(const std::string& fname,
+                                                           int64_t limit) {
+    int fd = open(fname.c_str(), O_RDONLY | O_BINARY);
+    if (fd == -1) {
+        fprintf(stderr, "cannot load '%s': %s\n", fname.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    auto image = std::make_shared<SharedImage>();
+    if (limit) {
+        sparse_file** s = load_sparse_files(fd, limit);
+        if (s == nullptr) {
+            fprintf(stderr, "cannot resparse '%s'\n", fname.c_str());
+            return nullptr;
+        }
+        for (; *s; ++s) {
+            int64_t sz = sparse_file_len(*s, true, false);
+            char* data = reinterpret_cast<char*>(malloc(sz));
+            char* cursor = data;
+            if (data == nullptr ||
+                sparse_file_callback(*s, true, false, write_to_memory, &cursor) < 0) {
+                fprintf(stderr, "cannot resparse '%s'\n", fname.c_str());
+                free(data);
+                return nullptr;
+            }
+            image->chunks.emplace_back(data, sz);
+        }
+    } else {
+        int64_t sz;
+        void* data = load_fd(fd, &sz);
+        if (data == nullptr) {
+            fprintf(stderr, "cannot load '%s': %s\n", fname.c_str(), strerror(errno));
+            return nullptr;
+        }
+        image->chunks.emplace_back(data, sz);
+    }
+    return image;
+}
+
+// Returns nullptr if the image can't be loaded; every device flashing it then fails.
+static std::shared_ptr<SharedImage> load_shared_image(const std::string& fname, int64_t limit) {
+    std::shared_future<std::shared_ptr<SharedImage>> image;
+    {
+        std::lock_guard<std::mutex> lock(shared_images_lock);
+        auto key = std::make_pair(fname, limit);
+        auto it = shared_images.find(key);
+        if (it == shared_images.end()) {
+            image = std::async(std::launch::async, load_shared_image_once, fname, limit).share();
+            shared_images.emplace(key, image);
+        } else {
+            image = it->second;
+        }
+    }
+    return image.get();
+}
+
+struct MultiDeviceCommand {
+    enum { kFlash, kErase, kReboot, kRebootBootloader } op;
+    std::string partition;
+    std::string fname;
+};
+
+static int flash_one_of_many(Transport* transport, const std::string& serial,
+                             const std::vector<MultiDeviceCommand>& commands,
+                             const std::string& slot_override, bool erase_first) {
+    fb_set_status_prefix(serial + ": ");
+
+    for (const MultiDeviceCommand& command : commands) {
+        switch (command.op) {
+            case MultiDeviceCommand::kFlash: {
+                // A bad image fails this device only; the others carry on flashing.
+                struct stat sb;
+                if (stat(command.fname.c_str(), &sb) == -1) {
+                    fprintf(stderr, "%s: cannot load '%s': %s\n", serial.c_str(),
+                            command.fname.c_str(), strerror(errno));
+                    return 1;
+                }
+                int64_t limit = get_sparse_limit(transport, sb.st_size);
+                std::shared_ptr<SharedImage> image = load_shared_image(command.fname, limit);
+                if (image == nullptr) return 1;
+
+                auto flash = [&](const std::string& partition) {
+                    if (erase_first && needs_erase(transport, partition.c_str())) {
+                        fb_queue_erase(partition.c_str());
+                    }
+                    for (const auto& chunk : image->chunks) {
+                        fb_queue_flash(partition.c_str(), chunk.first, chunk.second);
+                    }
+                };
+                do_for_partitions(transport, command.partition, slot_override, flash, true);
+                break;
+            }
+            case MultiDeviceCommand::kErase:
+                do_for_partitions(transport, command.partition, slot_override,
+                                  [](const std::string& partition) {
+                                      fb_queue_erase(partition.c_str());
+                                  }, true);
+                break;
+            case MultiDeviceCommand::kReboot:
+                fb_queue_reboot();
+                fb_queue_wait_for_disconnect();
+                break;
+            case MultiDeviceCommand::kRebootBootloader:
+                fb_queue_command("reboot-bootloader", "rebooting into bootloader");
+                fb_queue_wait_for_disconnect();
+                break;
+        }
+    }
+
+    return fb_execute_queue(transport);
+}
+
+static int do_multi_device(const std::vector<std::string>& serials, int argc, char** argv,
+                           const std::string& slot_override, bool erase_first, bool skip_reboot) {
+    std::vector<MultiDeviceCommand> commands;
+    while (argc > 0) {
+        MultiDeviceCommand command;
+        if (!strcmp(*argv, "flash") && argc >= 2) {
+            command.op = MultiDeviceCommand::kFlash;
+            command.partition = argv[1];
+            if (argc > 2) {
+                command.fname = argv[2];
+                argc -= 3;
+                argv += 3;
+            } else {
+                command.fname = find_item(argv[1], product);
+                argc -= 2;
+                argv += 2;
+            }
+            if (command.fname.empty()) {
+                die("cannot determine image filename for '%s'", command.partition.c_str());
+            }
+        } else if (!strcmp(*argv, "erase") && argc >= 2) {
+            command.op = MultiDeviceCommand::kErase;
+            command.partition = argv[1];
+            argc -= 2;
+            argv += 2;
+        } else if (!strcmp(*argv, "reboot") && argc == 1) {
+            argc -= 1;
+            argv += 1;
+            if (skip_reboot) continue;
+            command.op = MultiDeviceCommand::kReboot;
+        } else if (!strcmp(*argv, "reboot-bootloader") && argc == 1) {
+            command.op = MultiDeviceCommand::kRebootBootloader;
+            argc -= 1;
+            argv += 1;
+        } else {
+            die("'%s' is not supported with multiple devices "
+                "(only flash, erase, reboot and reboot-bootloader are)", *argv);
+        }
+        commands.push_back(command);
+    }
+
+    std::vector<Transport*> transports;
+    for (const std::string& serial : serials) {
+        Transport* transport = connect_device(serial.c_str());
+        if (transport == nullptr) {
+            return EXIT_FAILURE;
+        }
+        transports.push_back(transport);
+    }
+
+    std::vector<int> results(serials.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < serials.size(); ++i) {
+        threads.emplace_back([&, i]() {
+            results[i] = flash_one_of_many(transports[i], serials[i], commands, slot_override,
+                                           erase_first);
+        });
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+        if (results[i]) {
+            fprintf(stderr, "%s: FAILED\n", serials[i].c_str());
+            ++failures;
+        }
+    }
+    fprintf(stderr, "%zu of %zu devices flashed successfully\n",
+            serials.size() - failures, serials.size());
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 #define skip(n) do { argc -= (n); argv += (n); } while (0)
 #define require(n) do { if (argc < (n)) {usage(); exit(1);}} while (0)
 
@@ -1342,6 +1694,7 @@ static void fb_perform_format(Transport* transport,
     int fd;
 
     unsigned int limit = INT_MAX;
+    int64_t target_sparse_limit = peek_target_sparse_limit(transport);
     if (target_sparse_limit > 0 && target_sparse_limit < limit) {
         limit = target_sparse_limit;
     }
@@ -1404,7 +1757,7 @@ static void fb_perform_format(Transport* transport,
         return;
     }
 
-    if (!load_buf_fd(transport, fd, &buf)) {
+    if (!load_buf_fd(get_max_sparse_limit(transport), fd, &buf)) {
         fprintf(stderr, "Cannot read image: %s\n", strerror(errno));
         close(fd);
         return;
@@ -1436,6 +1789,7 @@ int main(int argc, char **argv)
     int longindex;
     std::string slot_override;
     std::string next_active;
+    std::vector<std::string> serials;
 
     const struct option longopts[] = {
         {"base", required_argument, 0, 'b'},
@@ -1515,6 +1869,7 @@ int main(int argc, char **argv)
             break;
         case 's':
             serial = optarg;
+            serials.push_back(optarg);
             break;
         case 'S':
             sparse_limit = parse_num(optarg);
@@ -1578,6 +1933,10 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (serials.size() > 1) {
+        return do_multi_device(serials, argc, argv, slot_override, erase_first, skip_reboot);
+    }
+
     Transport* transport = open_device();
     if (transport == nullptr) {
         return 1;
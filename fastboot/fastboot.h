@@ -32,6 +32,7 @@
 #include <inttypes.h>
 #include <stdlib.h>
 
+#include <functional>
 #include <string>
 
 #include "transport.h"
@@ -64,7 +65,10 @@ void fb_queue_command(const char *cmd, const char *msg);
 void fb_queue_download(const char *name, void *data, uint32_t size);
 void fb_queue_notice(const char *notice);
 void fb_queue_wait_for_disconnect(void);
+/* Runs func when the queue reaches this point; anything it queues runs next. */
+void fb_queue_deferred(const std::function<void()>& func);
 int fb_execute_queue(Transport* transport);
+void fb_set_status_prefix(const std::string& prefix);
 void fb_set_active(const char *slot);
 
 /* util stuff */
@@ -73,6 +77,6 @@ char *mkmsg(const char *fmt, ...);
 __attribute__((__noreturn__)) void die(const char *fmt, ...);
 
 /* Current product */
-extern char cur_product[FB_RESPONSE_SZ + 1];
+extern thread_local char cur_product[FB_RESPONSE_SZ + 1];
 
 #endif
@@ -26,15 +26,18 @@
  * SUCH DAMAGE.
  */
 
-#define round_down(a, b) \
-    ({ typeof(a) _a = (a); typeof(b) _b = (b); _a - (_a % _b); })
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <android-base/stringprintf.h>
 #include <sparse/sparse.h>
@@ -42,7 +45,7 @@
 #include "fastboot.h"
 #include "transport.h"
 
-static std::string g_error;
+static thread_local std::string g_error;
 
 const std::string fb_get_error() {
     return g_error;
@@ -186,68 +189,150 @@ int fb_download_data(Transport* transport, const void* data, uint32_t size) {
     return _command_send(transport, cmd, data, size, 0) < 0 ? -1 : 0;
 }
 
-#define TRANSPORT_BUF_SIZE 1024
-static char transport_buf[TRANSPORT_BUF_SIZE];
-static int transport_buf_len;
+// Sparse images are streamed through a small ring of transport buffers: a
+// producer thread walks the sparse file (reading backing files as it goes)
+// while the calling thread writes completed buffers to the transport, so
+// chunk generation overlaps with the USB/network transfer. Every write but
+// the last is exactly TRANSPORT_BUF_SIZE bytes.
+#define TRANSPORT_BUF_SIZE (1024 * 1024)
+#define TRANSPORT_BUF_COUNT 3
+
+class SparseDownloader {
+  public:
+    SparseDownloader(Transport* transport, struct sparse_file* s);
+    int Run();
+
+  private:
+    struct Buffer {
+        std::unique_ptr<char[]> data;
+        int len;
+    };
+
+    static int Write(void* priv, const void* data, int len);
+    int Write(const char* data, int len);
+    void Produce();
+    Buffer* GetFreeBuffer();
+    void QueueFullBuffer(Buffer* buf);
+
+    Transport* transport_;
+    struct sparse_file* s_;
+
+    std::vector<Buffer> buffers_;
+    Buffer* current_ = nullptr;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Buffer*> free_;
+    std::deque<Buffer*> full_;
+    bool producer_done_ = false;
+    bool consumer_failed_ = false;
+    int producer_status_ = 0;
+};
+
+SparseDownloader::SparseDownloader(Transport* transport, struct sparse_file* s)
+    : transport_(transport), s_(s), buffers_(TRANSPORT_BUF_COUNT) {
+    for (Buffer& buf : buffers_) {
+        buf.data.reset(new char[TRANSPORT_BUF_SIZE]);
+        buf.len = 0;
+        free_.push_back(&buf);
+    }
+}
 
-static int fb_download_data_sparse_write(void *priv, const void *data, int len)
-{
-    int r;
-    Transport* transport = reinterpret_cast<Transport*>(priv);
-    int to_write;
-    const char* ptr = reinterpret_cast<const char*>(data);
+SparseDownloader::Buffer* SparseDownloader::GetFreeBuffer() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return !free_.empty() || consumer_failed_; });
+    if (consumer_failed_) {
+        return nullptr;
+    }
+    Buffer* buf = free_.front();
+    free_.pop_front();
+    buf->len = 0;
+    return buf;
+}
 
-    if (transport_buf_len) {
-        to_write = std::min(TRANSPORT_BUF_SIZE - transport_buf_len, len);
+void SparseDownloader::QueueFullBuffer(Buffer* buf) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    full_.push_back(buf);
+    cv_.notify_all();
+}
 
-        memcpy(transport_buf + transport_buf_len, ptr, to_write);
-        transport_buf_len += to_write;
-        ptr += to_write;
-        len -= to_write;
-    }
+int SparseDownloader::Write(void* priv, const void* data, int len) {
+    return reinterpret_cast<SparseDownloader*>(priv)->Write(
+            reinterpret_cast<const char*>(data), len);
+}
 
-    if (transport_buf_len == TRANSPORT_BUF_SIZE) {
-        r = _command_data(transport, transport_buf, TRANSPORT_BUF_SIZE);
-        if (r != TRANSPORT_BUF_SIZE) {
-            return -1;
+int SparseDownloader::Write(const char* data, int len) {
+    while (len > 0) {
+        if (current_ == nullptr) {
+            current_ = GetFreeBuffer();
+            if (current_ == nullptr) {
+                return -1;
+            }
         }
-        transport_buf_len = 0;
-    }
 
-    if (len > TRANSPORT_BUF_SIZE) {
-        if (transport_buf_len > 0) {
-            g_error = "internal error: transport_buf not empty";
-            return -1;
-        }
-        to_write = round_down(len, TRANSPORT_BUF_SIZE);
-        r = _command_data(transport, ptr, to_write);
-        if (r != to_write) {
-            return -1;
+        int to_copy = std::min(TRANSPORT_BUF_SIZE - current_->len, len);
+        memcpy(current_->data.get() + current_->len, data, to_copy);
+        current_->len += to_copy;
+        data += to_copy;
+        len -= to_copy;
+
+        if (current_->len == TRANSPORT_BUF_SIZE) {
+            QueueFullBuffer(current_);
+            current_ = nullptr;
         }
-        ptr += to_write;
-        len -= to_write;
     }
+    return 0;
+}
 
-    if (len > 0) {
-        if (len > TRANSPORT_BUF_SIZE) {
-            g_error = "internal error: too much left for transport_buf";
-            return -1;
-        }
-        memcpy(transport_buf, ptr, len);
-        transport_buf_len = len;
+void SparseDownloader::Produce() {
+    int r = sparse_file_callback(s_, true, false, Write, this);
+    if (r >= 0 && current_ != nullptr && current_->len > 0) {
+        QueueFullBuffer(current_);
+        current_ = nullptr;
     }
 
-    return 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    producer_status_ = r;
+    producer_done_ = true;
+    cv_.notify_all();
 }
 
-static int fb_download_data_sparse_flush(Transport* transport) {
-    if (transport_buf_len > 0) {
-        if (_command_data(transport, transport_buf, transport_buf_len) != transport_buf_len) {
-            return -1;
+int SparseDownloader::Run() {
+    std::thread producer(&SparseDownloader::Produce, this);
+
+    int status = 0;
+    while (true) {
+        Buffer* buf;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return !full_.empty() || producer_done_; });
+            if (full_.empty()) {
+                break;
+            }
+            buf = full_.front();
+            full_.pop_front();
+        }
+
+        if (_command_data(transport_, buf->data.get(), buf->len) != buf->len) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            consumer_failed_ = true;
+            cv_.notify_all();
+            status = -1;
+            break;
         }
-        transport_buf_len = 0;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(buf);
+        cv_.notify_all();
     }
-    return 0;
+
+    producer.join();
+
+    if (status == 0 && producer_status_ < 0) {
+        g_error = "failed to generate sparse data";
+        status = -1;
+    }
+    return status;
 }
 
 int fb_download_data_sparse(Transport* transport, struct sparse_file* s) {
@@ -263,12 +348,8 @@ int fb_download_data_sparse(Transport* transport, struct sparse_file* s) {
         return -1;
     }
 
-    r = sparse_file_callback(s, true, false, fb_download_data_sparse_write, transport);
-    if (r < 0) {
-        return -1;
-    }
-
-    r = fb_download_data_sparse_flush(transport);
+    SparseDownloader downloader(transport, s);
+    r = downloader.Run();
     if (r < 0) {
         return -1;
     }
@@ -130,9 +130,16 @@ class UdpTransport : public Transport {
                                    uint8_t* rx_data, size_t rx_length, int attempts,
                                    std::string* error);
 
+    // Helper for SendData(); sends |tx_data| as a series of packets keeping up to |window_size_|
+    // of them unacknowledged at a time. Only used for writes, where every response is an empty
+    // ACK. Unacknowledged packets are re-transmitted individually on timeout.
+    ssize_t SendWindowed(Id id, const uint8_t* tx_data, size_t tx_length, int attempts,
+                         std::string* error);
+
     std::unique_ptr<Socket> socket_;
     int sequence_ = -1;
     size_t max_data_length_ = kMinPacketSize - kHeaderSize;
+    size_t window_size_ = 1;
     std::vector<uint8_t> rx_packet_;
 
     DISALLOW_COPY_AND_ASSIGN(UdpTransport);
@@ -150,7 +157,7 @@ std::unique_ptr<UdpTransport> UdpTransport::NewTransport(std::unique_ptr<Socket>
 }
 
 bool UdpTransport::InitializeProtocol(std::string* error) {
-    uint8_t rx_data[4];
+    uint8_t rx_data[6];
 
     sequence_ = 0;
     rx_packet_.resize(kMinPacketSize);
@@ -198,6 +205,16 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     max_data_length_ = packet_size - kHeaderSize;
     rx_packet_.resize(packet_size);
 
+    // Devices that support windowed writes append their maximum window size; older devices
+    // only send the first four bytes and keep using stop-and-wait.
+    window_size_ = 1;
+    if (rx_bytes >= 6) {
+        uint16_t window_size = ExtractUint16(rx_data + 4);
+        if (window_size > 1) {
+            window_size_ = std::min(kHostMaxWindowSize, window_size);
+        }
+    }
+
     return true;
 }
 
@@ -210,6 +227,11 @@ ssize_t UdpTransport::SendData(Id id, const uint8_t* tx_data, size_t tx_length,
         return -1;
     }
 
+    // Multi-packet writes can be pipelined if the device negotiated a window.
+    if (window_size_ > 1 && rx_length == 0 && tx_length > max_data_length_) {
+        return SendWindowed(id, tx_data, tx_length, attempts, error);
+    }
+
     Header header;
     size_t packet_data_length;
     ssize_t ret = 0;
@@ -249,6 +271,101 @@ ssize_t UdpTransport::SendData(Id id, const uint8_t* tx_data, size_t tx_length,
     return ret;
 }
 
+ssize_t UdpTransport::SendWindowed(Id id, const uint8_t* tx_data, size_t tx_length,
+                                   int attempts, std::string* error) {
+    struct Packet {
+        Header header;
+        const uint8_t* data;
+        size_t length;
+        bool acked;
+    };
+
+    // Split |tx_data| up front; every packet but the last has the continuation flag set.
+    std::vector<Packet> packets((tx_length + max_data_length_ - 1) / max_data_length_);
+    for (size_t i = 0; i < packets.size(); ++i) {
+        Packet& packet = packets[i];
+        packet.data = tx_data + i * max_data_length_;
+        packet.length = std::min(max_data_length_, tx_length - i * max_data_length_);
+        packet.acked = false;
+        packet.header.Set(id, sequence_ + i,
+                          i + 1 < packets.size() ? kFlagContinuation : kFlagNone);
+    }
+
+    auto send_packet = [this, error](const Packet& packet) {
+        if (!socket_->Send({{packet.header.bytes(), kHeaderSize}, {packet.data, packet.length}})) {
+            *error = Socket::GetErrorMessage();
+            return false;
+        }
+        return true;
+    };
+
+    error->clear();
+    size_t first_unacked = 0;
+    size_t next_to_send = 0;
+    ssize_t total_data_bytes = 0;
+    int attempts_left = attempts;
+    while (first_unacked < packets.size()) {
+        // Fill the window.
+        while (next_to_send < packets.size() && next_to_send - first_unacked < window_size_) {
+            if (!send_packet(packets[next_to_send])) {
+                return -1;
+            }
+            ++next_to_send;
+        }
+
+        ssize_t bytes = socket_->Receive(rx_packet_.data(), rx_packet_.size(), kResponseTimeoutMs);
+        if (bytes == -1) {
+            if (!socket_->ReceiveTimedOut()) {
+                *error = Socket::GetErrorMessage();
+                return -1;
+            }
+            if (--attempts_left <= 0) {
+                *error = "no response from target";
+                return -1;
+            }
+            // Selective re-transmit: only the packets in the window still waiting for an ACK.
+            for (size_t i = first_unacked; i < next_to_send; ++i) {
+                if (!packets[i].acked && !send_packet(packets[i])) {
+                    return -1;
+                }
+            }
+            continue;
+        } else if (bytes < static_cast<ssize_t>(kHeaderSize)) {
+            *error = "protocol error: incomplete header";
+            return -1;
+        }
+
+        // Anything that doesn't match an outstanding packet is a stale duplicate; ignore it.
+        uint16_t offset = ExtractUint16(rx_packet_.data() + kIndexSeqH) -
+                          static_cast<uint16_t>(sequence_ + first_unacked);
+        size_t index = first_unacked + offset;
+        if (index >= next_to_send || packets[index].acked ||
+            !packets[index].header.Matches(rx_packet_.data())) {
+            continue;
+        }
+
+        if (rx_packet_[kIndexId] == kIdError) {
+            error->append(rx_packet_.data() + kHeaderSize, rx_packet_.data() + bytes);
+            *error = "target reported error: " + *error;
+            return -1;
+        }
+        if (rx_packet_[kIndexFlags] & kFlagContinuation) {
+            *error = "protocol error: continuation in windowed ACK";
+            return -1;
+        }
+        total_data_bytes += bytes - kHeaderSize;
+
+        packets[index].acked = true;
+        attempts_left = attempts;
+        while (first_unacked < next_to_send && packets[first_unacked].acked) {
+            ++first_unacked;
+        }
+    }
+
+    sequence_ += packets.size();
+    return total_data_bytes;
+}
+
 ssize_t UdpTransport::SendSinglePacketHelper(
         Header* header, const uint8_t* tx_data, size_t tx_length, uint8_t* rx_data,
         size_t rx_length, const int attempts, std::string* error) {
@@ -51,6 +51,11 @@ constexpr uint16_t kProtocolVersion = 1;
 // This will be negotiated with the device so may end up being smaller.
 constexpr uint16_t kHostMaxPacketSize = 8192;
 
+// Maximum number of unacknowledged Fastboot write packets the host will keep in flight. Devices
+// that support windowing advertise their own limit in the init response and the minimum is used;
+// devices that don't advertise one get the original stop-and-wait behavior.
+constexpr uint16_t kHostMaxWindowSize = 32;
+
 // Retransmission constants. Retransmission timeout must be at least 500ms, and the host must
 // attempt to send packets for at least 1 minute once the device has connected. See
 // fastboot_protocol.txt for more information.
@@ -16,6 +16,12 @@
 
 #include "udp.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include "socket.h"
@@ -529,3 +535,256 @@ TEST_F(UdpTest, CloseTransport) {
     EXPECT_EQ(-1, transport_->Write("foo", 3));
     EXPECT_EQ(-1, transport_->Read(buffer, sizeof(buffer)));
 }
+
+// Returns an Init response from a device that advertises a |window_size| for windowed writes.
+static std::string WindowedInitPacket(uint16_t sequence, uint16_t max_packet_size,
+                                      uint16_t window_size) {
+    return InitPacket(sequence, kProtocolVersion, max_packet_size) + PacketValue(window_size);
+}
+
+// Fixture class for transports that negotiated windowed writes with the device.
+class UdpWindowTest : public UdpTest {
+  public:
+    void SetUp() override { ASSERT_TRUE(InitializeWindowedTransport(0, 512, 4)); }
+
+    bool InitializeWindowedTransport(uint16_t starting_sequence, int device_max_packet_size,
+                                     uint16_t window_size) {
+        mock_socket_ = new SocketMock;
+        mock_socket_->ExpectSend(QueryPacket(0));
+        mock_socket_->AddReceive(QueryPacket(0, starting_sequence));
+        mock_socket_->ExpectSend(
+                InitPacket(starting_sequence, kProtocolVersion, kHostMaxPacketSize));
+        mock_socket_->AddReceive(
+                WindowedInitPacket(starting_sequence, device_max_packet_size, window_size));
+
+        std::string error;
+        transport_ = Connect(std::unique_ptr<Socket>(mock_socket_), &error);
+        return transport_ != nullptr && error.empty();
+    }
+
+    // Splits |data| into the packets the host should send starting at |sequence|.
+    static std::vector<std::string> Packets(uint16_t sequence, const std::string& data) {
+        constexpr size_t kMaxDataSize = 512 - 4;
+        std::vector<std::string> packets;
+        for (size_t i = 0; i < data.length(); i += kMaxDataSize) {
+            bool last = i + kMaxDataSize >= data.length();
+            packets.push_back(FastbootPacket(sequence++, data.substr(i, kMaxDataSize),
+                                             last ? kFlagNone : kFlagContinuation));
+        }
+        return packets;
+    }
+};
+
+// Tests that a windowed write keeps up to the window size of packets in flight.
+TEST_F(UdpWindowTest, WindowedWrite) {
+    std::vector<std::string> packets = Packets(1, std::string(508 * 6, 'x'));
+    ASSERT_EQ(6U, packets.size());
+
+    for (size_t i = 0; i < 4; ++i) {
+        mock_socket_->ExpectSend(packets[i]);
+    }
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->ExpectSend(packets[4]);
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->ExpectSend(packets[5]);
+    for (uint16_t seq = 3; seq <= 6; ++seq) {
+        mock_socket_->AddReceive(FastbootPacket(seq));
+    }
+    EXPECT_TRUE(Write(std::string(508 * 6, 'x')));
+
+    // Sequence numbers continue after the whole window.
+    mock_socket_->ExpectSend(FastbootPacket(7, "foo"));
+    mock_socket_->AddReceive(FastbootPacket(7));
+    EXPECT_TRUE(Write("foo"));
+}
+
+// Tests that only packets which weren't acknowledged are re-transmitted after a timeout, and that
+// out-of-order and duplicate ACKs are handled.
+TEST_F(UdpWindowTest, SelectiveRetransmit) {
+    std::string data(508 * 4, 'y');
+    std::vector<std::string> packets = Packets(1, data);
+
+    for (const std::string& packet : packets) {
+        mock_socket_->ExpectSend(packet);
+    }
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->AddReceive(FastbootPacket(3));
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->AddReceiveTimeout();
+    mock_socket_->ExpectSend(packets[1]);
+    mock_socket_->ExpectSend(packets[3]);
+    mock_socket_->AddReceive(FastbootPacket(4));
+    mock_socket_->AddReceive(FastbootPacket(2));
+
+    EXPECT_TRUE(Write(data));
+}
+
+// Tests that windowed writes work across sequence number wrap-around.
+TEST_F(UdpWindowTest, SequenceWrap) {
+    ASSERT_TRUE(InitializeWindowedTransport(0xFFFD, 512, 4));
+
+    std::string data(508 * 4, 'z');
+    std::vector<std::string> packets = Packets(0xFFFE, data);
+    for (const std::string& packet : packets) {
+        mock_socket_->ExpectSend(packet);
+    }
+    for (uint16_t seq : {0xFFFF, 0x0000, 0xFFFE, 0x0001}) {
+        mock_socket_->AddReceive(FastbootPacket(seq));
+    }
+
+    EXPECT_TRUE(Write(data));
+}
+
+// Tests that an error response for any in-flight packet aborts the write.
+TEST_F(UdpWindowTest, ErrorResponse) {
+    std::string data(508 * 3, 'e');
+    for (const std::string& packet : Packets(1, data)) {
+        mock_socket_->ExpectSend(packet);
+    }
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->AddReceive(ErrorPacket(3, "test error"));
+
+    EXPECT_FALSE(Write(data));
+}
+
+// Tests that reads and single-packet writes keep using stop-and-wait.
+TEST_F(UdpWindowTest, SmallTransfersUnchanged) {
+    mock_socket_->ExpectSend(FastbootPacket(1, "foo"));
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->ExpectSend(FastbootPacket(2));
+    mock_socket_->AddReceive(FastbootPacket(2, "bar"));
+
+    EXPECT_TRUE(Write("foo"));
+    EXPECT_TRUE(Read("bar"));
+}
+
+// A device on the other end of a loopback link. It answers the handshake advertising
+// |window_size|, and each Receive() ACKs the oldest outstanding Fastboot packet, recording how many
+// packets the host had put on the socket without an ACK at that point.
+class LoopbackDeviceSocket : public Socket {
+  public:
+    explicit LoopbackDeviceSocket(uint16_t window_size)
+            : Socket(INVALID_SOCKET), window_size_(window_size) {}
+
+    bool Send(const void* data, size_t length) override {
+        std::string packet(reinterpret_cast<const char*>(data), length);
+        if (packet.length() < 4) {
+            ADD_FAILURE() << "Send() of a truncated packet";
+            return false;
+        }
+        uint16_t sequence = (static_cast<uint8_t>(packet[2]) << 8) | static_cast<uint8_t>(packet[3]);
+        switch (packet[0]) {
+            case kIdDeviceQuery:
+                replies_.push(QueryPacket(sequence, 0));
+                break;
+            case kIdInitialization:
+                replies_.push(WindowedInitPacket(sequence, 512, window_size_));
+                break;
+            case kIdFastboot:
+                unacked_.push(sequence);
+                data_ += packet.substr(4);
+                break;
+            default:
+                ADD_FAILURE() << "Send() of unexpected packet id " << static_cast<int>(packet[0]);
+                return false;
+        }
+        return true;
+    }
+
+    bool Send(std::vector<cutils_socket_buffer_t> buffers) override {
+        std::string data;
+        for (const auto& buffer : buffers) {
+            data.append(reinterpret_cast<const char*>(buffer.data), buffer.length);
+        }
+        return Send(data.data(), data.size());
+    }
+
+    ssize_t Receive(void* data, size_t length, int /*timeout_ms*/) override {
+        std::string reply;
+        if (!replies_.empty()) {
+            reply = replies_.front();
+            replies_.pop();
+        } else if (!unacked_.empty()) {
+            in_flight_at_ack_.push_back(unacked_.size());
+            reply = FastbootPacket(unacked_.front());
+            unacked_.pop();
+        } else {
+            ADD_FAILURE() << "Receive() was called with nothing in flight";
+            return -1;
+        }
+        if (reply.length() > length) {
+            ADD_FAILURE() << "Receive(): not enough bytes (" << length << ")";
+            return -1;
+        }
+        memcpy(data, reply.data(), reply.length());
+        return reply.length();
+    }
+
+    // The Fastboot data received so far.
+    const std::string& data() const { return data_; }
+
+    // For each ACK, how many packets were in flight when the host waited for it.
+    const std::vector<size_t>& in_flight_at_ack() const { return in_flight_at_ack_; }
+
+  private:
+    uint16_t window_size_;
+    std::queue<std::string> replies_;
+    std::queue<uint16_t> unacked_;
+    std::string data_;
+    std::vector<size_t> in_flight_at_ack_;
+};
+
+// Loopback throughput check: streams a 1MiB download to a device that ACKs one packet per receive,
+// and verifies from what actually reached the socket that the host filled the whole window before
+// waiting for the first ACK and kept it full for the rest of the transfer.
+TEST_F(UdpWindowTest, LoopbackThroughput) {
+    LoopbackDeviceSocket* device = new LoopbackDeviceSocket(kHostMaxWindowSize);
+    std::string error;
+    transport_ = Connect(std::unique_ptr<Socket>(device), &error);
+    ASSERT_NE(nullptr, transport_) << error;
+
+    std::string data(1024 * 1024, '\0');
+    for (size_t i = 0; i < data.length(); ++i) {
+        data[i] = i * 7;
+    }
+    size_t packet_count = Packets(1, data).size();
+
+    EXPECT_TRUE(Write(data));
+    EXPECT_EQ(data, device->data());
+
+    const std::vector<size_t>& in_flight = device->in_flight_at_ack();
+    ASSERT_EQ(packet_count, in_flight.size());
+    EXPECT_EQ(kHostMaxWindowSize, in_flight[0]);
+    // Until the tail of the transfer each ACK is immediately replaced by a new packet.
+    for (size_t i = 0; i + kHostMaxWindowSize <= packet_count; ++i) {
+        EXPECT_EQ(kHostMaxWindowSize, in_flight[i]) << "at ACK " << i;
+    }
+}
+
+// Tests that a window of 1 falls back to stop-and-wait.
+TEST_F(UdpWindowTest, WindowNegotiation) {
+    ASSERT_TRUE(InitializeWindowedTransport(0, 512, 1));
+
+    std::string data(508 * 2, 'n');
+    std::vector<std::string> packets = Packets(1, data);
+    mock_socket_->ExpectSend(packets[0]);
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->ExpectSend(packets[1]);
+    mock_socket_->AddReceive(FastbootPacket(2));
+    EXPECT_TRUE(Write(data));
+}
+
+// Tests that a device advertising a window larger than the host's limit gets the host's limit.
+TEST_F(UdpWindowTest, WindowNegotiationCapsToHostMax) {
+    LoopbackDeviceSocket* device = new LoopbackDeviceSocket(kHostMaxWindowSize * 4);
+    std::string error;
+    transport_ = Connect(std::unique_ptr<Socket>(device), &error);
+    ASSERT_NE(nullptr, transport_) << error;
+
+    std::string data(508 * kHostMaxWindowSize * 2, 'c');
+    EXPECT_TRUE(Write(data));
+    EXPECT_EQ(data, device->data());
+    ASSERT_FALSE(device->in_flight_at_ack().empty());
+    EXPECT_EQ(kHostMaxWindowSize, *std::max_element(device->in_flight_at_ack().begin(),
+                                                    device->in_flight_at_ack().end()));
+}
@@ -29,6 +29,8 @@
 #ifndef _USB_H_
 #define _USB_H_
 
+#include <functional>
+
 #include "transport.h"
 
 struct usb_ifc_info {
@@ -53,7 +55,7 @@ struct usb_ifc_info {
     char device_path[256];
 };
 
-typedef int (*ifc_match_func)(usb_ifc_info *ifc);
+typedef std::function<int(usb_ifc_info*)> ifc_match_func;
 
 Transport* usb_open(ifc_match_func callback);
 
@@ -46,18 +46,35 @@ LOCAL_SRC_FILES := \
 LOCAL_STATIC_LIBRARIES := libinit_parser
 LOCAL_CLANG := true
 include $(BUILD_HOST_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_CPPFLAGS := $(init_cflags)
+LOCAL_MODULE := init_rc_cache
+LOCAL_SRC_FILES := \
+    parser.cpp \
+    rc_cache.cpp \
+    rc_cache_main.cpp \
+
+LOCAL_STATIC_LIBRARIES := libbase liblog
+LOCAL_CLANG := true
+include $(BUILD_HOST_EXECUTABLE)
 endif
 
 include $(CLEAR_VARS)
 LOCAL_CPPFLAGS := $(init_cflags)
 LOCAL_SRC_FILES:= \
     action.cpp \
+    boot_trace.cpp \
+    bootchart_collector.cpp \
     capabilities.cpp \
     descriptors.cpp \
     import_parser.cpp \
     init_parser.cpp \
     log.cpp \
     parser.cpp \
+    path_matcher.cpp \
+    persistent_properties.cpp \
+    rc_cache.cpp \
     service.cpp \
     util.cpp \
 
@@ -158,8 +175,14 @@ include $(BUILD_EXECUTABLE)
 include $(CLEAR_VARS)
 LOCAL_MODULE := init_tests
 LOCAL_SRC_FILES := \
+    action_test.cpp \
+    boot_trace_test.cpp \
+    bootchart_collector_test.cpp \
     init_parser_test.cpp \
+    path_matcher_test.cpp \
+    persistent_properties_test.cpp \
     property_service_test.cpp \
+    rc_cache_test.cpp \
     util_test.cpp \
 
 LOCAL_SHARED_LIBRARIES += \
@@ -173,6 +196,27 @@ LOCAL_CPPFLAGS := -Wall -Wextra -Werror
 include $(BUILD_NATIVE_TEST)
 
 
+# Benchmarks.
+# Run with: adb shell /data/benchmarktest/init_benchmarks/init_benchmarks
+# =========================================================
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_benchmarks
+LOCAL_SRC_FILES := \
+    path_matcher_benchmark.cpp \
+    property_service_benchmark.cpp \
+    rc_cache_benchmark.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    libbase \
+    liblog \
+
+LOCAL_STATIC_LIBRARIES := libinit
+LOCAL_CLANG := true
+LOCAL_CPPFLAGS := -Wall -Wextra -Werror
+include $(BUILD_NATIVE_BENCHMARK)
+
+
 # Include targets in subdirs.
 # =========================================================
 include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -18,9 +18,12 @@
 
 #include <errno.h>
 
+#include <algorithm>
+
 #include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 
+#include "boot_trace.h"
 #include "builtins.h"
 #include "error.h"
 #include "init_parser.h"
@@ -122,16 +125,18 @@ void Action::ExecuteCommand(const Command& command) const {
     int result = command.InvokeFunc();
 
     double duration_ms = t.duration_s() * 1000;
+    std::string trigger_name = BuildTriggersString();
+    std::string cmd_str = command.BuildCommandString();
+    std::string source = command.BuildSourceString();
     // Any action longer than 50ms will be warned to user as slow operation
     if (duration_ms > 50.0 ||
         android::base::GetMinimumLogSeverity() <= android::base::DEBUG) {
-        std::string trigger_name = BuildTriggersString();
-        std::string cmd_str = command.BuildCommandString();
-        std::string source = command.BuildSourceString();
-
         LOG(INFO) << "Command '" << cmd_str << "' action=" << trigger_name << source
                   << " returned " << result << " took " << duration_ms << "ms.";
     }
+    BootTrace::GetInstance().AddEvent(
+        BootTrace::kCommand, cmd_str, t.start(),
+        StringPrintf("action=%s%s returned %d", trigger_name.c_str(), source.c_str(), result));
 }
 
 bool Action::ParsePropertyTrigger(const std::string& trigger, std::string* err) {
@@ -210,23 +215,25 @@ bool Action::CheckPropertyTriggers(const std::string& name,
         return true;
     }
 
-    bool found = name.empty();
+    // Check the property that changed before reading any of the others.
+    if (!name.empty()) {
+        auto it = property_triggers_.find(name);
+        if (it == property_triggers_.end() || (it->second != "*" && it->second != value)) {
+            return false;
+        }
+    }
+
     for (const auto& [trigger_name, trigger_value] : property_triggers_) {
         if (trigger_name == name) {
-            if (trigger_value != "*" && trigger_value != value) {
-                return false;
-            } else {
-                found = true;
-            }
-        } else {
-            std::string prop_val = property_get(trigger_name.c_str());
-            if (prop_val.empty() || (trigger_value != "*" &&
-                                     trigger_value != prop_val)) {
-                return false;
-            }
+            continue;
+        }
+        std::string prop_val = property_get(trigger_name.c_str());
+        if (prop_val.empty() || (trigger_value != "*" &&
+                                 trigger_value != prop_val)) {
+            return false;
         }
     }
-    return found;
+    return true;
 }
 
 bool Action::CheckEventTrigger(const std::string& trigger) const {
@@ -275,6 +282,9 @@ public:
     bool CheckTriggers(const Action& action) const override {
         return action.CheckEventTrigger(trigger_);
     }
+    const std::vector<Action*>* FindCandidates(const ActionManager& am) const override {
+        return &am.FindEventTriggerActions(trigger_);
+    }
 private:
     const std::string trigger_;
 };
@@ -287,6 +297,10 @@ public:
     bool CheckTriggers(const Action& action) const override {
         return action.CheckPropertyTrigger(name_, value_);
     }
+    const std::vector<Action*>* FindCandidates(const ActionManager& am) const override {
+        // An empty name means all property triggers, from QueueAllPropertyTriggers().
+        return name_.empty() ? nullptr : &am.FindPropertyTriggerActions(name_);
+    }
 private:
     const std::string name_;
     const std::string value_;
@@ -294,16 +308,27 @@ private:
 
 class BuiltinTrigger : public Trigger {
 public:
-    explicit BuiltinTrigger(Action* action) : action_(action) {
+    BuiltinTrigger(Action* action, const std::string& name) : action_(action), name_(name) {
     }
     bool CheckTriggers(const Action& action) const override {
         return action_ == &action;
     }
+    const std::vector<Action*>* FindCandidates(const ActionManager& am) const override {
+        // The action is indexed under its name until it runs, which an event
+        // trigger of the same name may make it do first.
+        return &am.FindEventTriggerActions(name_);
+    }
 private:
-    const Action* action_;
+    Action* action_;
+    const std::string name_;
 };
 
-ActionManager::ActionManager() : current_command_(0) {
+ActionManager::ActionManager()
+    : current_command_(0),
+      triggers_processed_(0),
+      trigger_checks_(0),
+      trigger_matches_(0),
+      trigger_check_ms_(0) {
 }
 
 ActionManager& ActionManager::GetInstance() {
@@ -321,10 +346,58 @@ void ActionManager::AddAction(std::unique_ptr<Action> action) {
     if (old_action_it != actions_.end()) {
         (*old_action_it)->CombineAction(*action);
     } else {
+        IndexAction(action.get());
         actions_.emplace_back(std::move(action));
     }
 }
 
+void ActionManager::IndexAction(Action* action) {
+    if (!action->event_trigger().empty()) {
+        event_trigger_actions_[action->event_trigger()].emplace_back(action);
+    } else {
+        for (const auto& [name, value] : action->property_triggers()) {
+            property_trigger_actions_[name].emplace_back(action);
+        }
+    }
+}
+
+void ActionManager::UnindexAction(const Action* action) {
+    auto erase = [action](std::map<std::string, std::vector<Action*>>* index,
+                          const std::string& key) {
+        auto it = index->find(key);
+        if (it == index->end()) {
+            return;
+        }
+        auto& actions = it->second;
+        actions.erase(std::remove(actions.begin(), actions.end(), action), actions.end());
+        if (actions.empty()) {
+            index->erase(it);
+        }
+    };
+
+    if (!action->event_trigger().empty()) {
+        erase(&event_trigger_actions_, action->event_trigger());
+    } else {
+        for (const auto& [name, value] : action->property_triggers()) {
+            erase(&property_trigger_actions_, name);
+        }
+    }
+}
+
+const std::vector<Action*>& ActionManager::FindEventTriggerActions(
+        const std::string& trigger) const {
+    static const std::vector<Action*> empty;
+    auto it = event_trigger_actions_.find(trigger);
+    return it == event_trigger_actions_.end() ? empty : it->second;
+}
+
+const std::vector<Action*>& ActionManager::FindPropertyTriggerActions(
+        const std::string& name) const {
+    static const std::vector<Action*> empty;
+    auto it = property_trigger_actions_.find(name);
+    return it == property_trigger_actions_.end() ? empty : it->second;
+}
+
 void ActionManager::QueueEventTrigger(const std::string& trigger) {
     trigger_queue_.push(std::make_unique<EventTrigger>(trigger));
 }
@@ -349,19 +422,35 @@ void ActionManager::QueueBuiltinAction(BuiltinFunction func,
 
     action->AddCommand(func, name_vector);
 
-    trigger_queue_.push(std::make_unique<BuiltinTrigger>(action.get()));
+    trigger_queue_.push(std::make_unique<BuiltinTrigger>(action.get(), name));
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
 void ActionManager::ExecuteOneCommand() {
     // Loop through the trigger queue until we have an action to execute
     while (current_executing_actions_.empty() && !trigger_queue_.empty()) {
-        for (const auto& action : actions_) {
-            if (trigger_queue_.front()->CheckTriggers(*action)) {
-                current_executing_actions_.emplace(action.get());
+        Timer t;
+        const Trigger& trigger = *trigger_queue_.front();
+        auto check = [this, &trigger](const Action* action) {
+            ++trigger_checks_;
+            if (trigger.CheckTriggers(*action)) {
+                ++trigger_matches_;
+                current_executing_actions_.emplace(action);
+            }
+        };
+        if (const std::vector<Action*>* candidates = trigger.FindCandidates(*this)) {
+            for (const auto& action : *candidates) {
+                check(action);
+            }
+        } else {
+            for (const auto& action : actions_) {
+                check(action.get());
             }
         }
         trigger_queue_.pop();
+        ++triggers_processed_;
+        trigger_check_ms_ += t.duration_s() * 1000;
     }
 
     if (current_executing_actions_.empty()) {
@@ -373,6 +462,7 @@ void ActionManager::ExecuteOneCommand() {
     if (current_command_ == 0) {
         std::string trigger_name = action->BuildTriggersString();
         LOG(INFO) << "processing action (" << trigger_name << ")";
+        current_action_start_ = boot_clock::now();
     }
 
     action->ExecuteOneCommand(current_command_);
@@ -382,9 +472,12 @@ void ActionManager::ExecuteOneCommand() {
     // If this action was oneshot, then also remove it from actions_.
     ++current_command_;
     if (current_command_ == action->NumCommands()) {
+        BootTrace::GetInstance().AddEvent(BootTrace::kAction, action->BuildTriggersString(),
+                                          current_action_start_);
         current_executing_actions_.pop();
         current_command_ = 0;
         if (action->oneshot()) {
+            UnindexAction(action);
             auto eraser = [&action] (std::unique_ptr<Action>& a) {
                 return a.get() == action;
             };
@@ -401,6 +494,13 @@ void ActionManager::DumpState() const {
     for (const auto& a : actions_) {
         a->DumpState();
     }
+    LogTriggerStats();
+}
+
+void ActionManager::LogTriggerStats() const {
+    LOG(INFO) << "Processed " << triggers_processed_ << " triggers against " << actions_.size()
+              << " actions: " << trigger_checks_ << " checks, " << trigger_matches_
+              << " matches, " << trigger_check_ms_ << "ms";
 }
 
 bool ActionParser::ParseSection(const std::vector<std::string>& args,
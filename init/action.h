@@ -25,6 +25,7 @@
 #include "builtins.h"
 #include "init_parser.h"
 #include "keyword_map.h"
+#include "util.h"
 
 class Command {
 public:
@@ -65,6 +66,10 @@ public:
     void DumpState() const;
 
     bool oneshot() const { return oneshot_; }
+    const std::string& event_trigger() const { return event_trigger_; }
+    const std::map<std::string, std::string>& property_triggers() const {
+        return property_triggers_;
+    }
     static void set_function_map(const KeywordMap<BuiltinFunction>* function_map) {
         function_map_ = function_map;
     }
@@ -83,16 +88,26 @@ private:
     static const KeywordMap<BuiltinFunction>* function_map_;
 };
 
+class ActionManager;
+
 class Trigger {
 public:
     virtual ~Trigger() { }
     virtual bool CheckTriggers(const Action& action) const = 0;
+    // Returns the only actions CheckTriggers() can match, in the order they
+    // were added, or nullptr if every action has to be checked.
+    virtual const std::vector<Action*>* FindCandidates(const ActionManager&) const {
+        return nullptr;
+    }
 };
 
 class ActionManager {
 public:
     static ActionManager& GetInstance();
 
+    // init uses GetInstance(); tests use managers of their own.
+    ActionManager();
+
     void AddAction(std::unique_ptr<Action> action);
     void QueueEventTrigger(const std::string& trigger);
     void QueuePropertyTrigger(const std::string& name, const std::string& value);
@@ -101,17 +116,34 @@ public:
     void ExecuteOneCommand();
     bool HasMoreCommands() const;
     void DumpState() const;
+    void LogTriggerStats() const;
 
-private:
-    ActionManager();
+    const std::vector<Action*>& FindEventTriggerActions(const std::string& trigger) const;
+    const std::vector<Action*>& FindPropertyTriggerActions(const std::string& name) const;
 
+private:
     ActionManager(ActionManager const&) = delete;
     void operator=(ActionManager const&) = delete;
 
+    void IndexAction(Action* action);
+    void UnindexAction(const Action* action);
+
     std::vector<std::unique_ptr<Action>> actions_;
+    // Actions by their event trigger, and actions with only property triggers
+    // by each property they use, each in the same order as actions_. This lets
+    // a queued trigger check just the actions that mention it.
+    std::map<std::string, std::vector<Action*>> event_trigger_actions_;
+    std::map<std::string, std::vector<Action*>> property_trigger_actions_;
     std::queue<std::unique_ptr<Trigger>> trigger_queue_;
     std::queue<const Action*> current_executing_actions_;
     std::size_t current_command_;
+    // When the first command of the front of current_executing_actions_ ran.
+    boot_clock::time_point current_action_start_;
+    // How much work trigger matching has done, for LogTriggerStats().
+    std::size_t triggers_processed_;
+    std::size_t trigger_checks_;
+    std::size_t trigger_matches_;
+    double trigger_check_ms_;
 };
 
 class ActionParser : public SectionParser {
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "action.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// The labels of the actions that have run, in order.
+static std::vector<std::string> ran;
+
+static int Record(const std::vector<std::string>& args) {
+  ran.push_back(args.back());
+  return 0;
+}
+
+class ActionIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ran.clear();
+  }
+
+  // Adds an action on triggers whose only command records label.
+  void AddAction(const std::vector<std::string>& triggers, const std::string& label) {
+    auto action = std::make_unique<Action>(false);
+    std::string err;
+    ASSERT_TRUE(action->InitTriggers(triggers, &err)) << err;
+    action->AddCommand(Record, {"record", label});
+    // The manager adds the commands of an action with the same triggers as
+    // an earlier one to that one.
+    auto same = std::find_if(actions_.begin(), actions_.end(), [&](const auto& added) {
+      return added.first->TriggersEqual(*action);
+    });
+    if (same != actions_.end()) {
+      same->second.push_back(label);
+    } else {
+      actions_.emplace_back(action.get(), std::vector<std::string>{label});
+    }
+    am_.AddAction(std::move(action));
+  }
+
+  // What ExecuteOneCommand() runs without the index: every action, in the
+  // order it was added, that check accepts.
+  std::vector<std::string> FullScan(const std::function<bool(const Action&)>& check) const {
+    std::vector<std::string> result;
+    for (const auto& [action, labels] : actions_) {
+      if (check(*action)) result.insert(result.end(), labels.begin(), labels.end());
+    }
+    return result;
+  }
+
+  std::vector<std::string> RunQueued() {
+    ran.clear();
+    while (am_.HasMoreCommands()) {
+      am_.ExecuteOneCommand();
+    }
+    return ran;
+  }
+
+  void ExpectEventTrigger(const std::string& trigger) {
+    SCOPED_TRACE(trigger);
+    am_.QueueEventTrigger(trigger);
+    EXPECT_EQ(FullScan([&](const Action& a) { return a.CheckEventTrigger(trigger); }),
+              RunQueued());
+  }
+
+  void ExpectPropertyTrigger(const std::string& name, const std::string& value) {
+    SCOPED_TRACE(name + "=" + value);
+    am_.QueuePropertyTrigger(name, value);
+    EXPECT_EQ(FullScan([&](const Action& a) { return a.CheckPropertyTrigger(name, value); }),
+              RunQueued());
+  }
+
+  ActionManager am_;
+  std::vector<std::pair<Action*, std::vector<std::string>>> actions_;
+};
+
+TEST_F(ActionIndexTest, matches_like_a_full_scan) {
+  AddAction({"action_index_test.boot"}, "boot");
+  AddAction({"action_index_test.boot", "&&", "property:action_index_test.a=1"}, "boot_and_a");
+  AddAction({"property:action_index_test.a=1"}, "a=1");
+  AddAction({"property:action_index_test.a=*"}, "a=*");
+  AddAction({"property:action_index_test.a=1", "&&", "property:action_index_test.b=2"},
+            "a=1_and_b=2");
+  AddAction({"property:action_index_test.b=2", "&&", "property:ro.build.type=*"},
+            "b=2_and_build_type");
+  // Triggered by the property that comes after ro.build.type.
+  AddAction({"property:ro.build.type=*", "&&", "property:sys.action_index_test=1"},
+            "build_type_and_sys");
+  AddAction({"property:ro.build.type=*"}, "build_type");
+  AddAction({"action_index_test.other"}, "other");
+  AddAction({"action_index_test.boot"}, "boot_again");
+
+  ExpectEventTrigger("action_index_test.boot");
+  EXPECT_EQ((std::vector<std::string>{"boot", "boot_again"}), ran);
+  ExpectEventTrigger("action_index_test.other");
+  ExpectEventTrigger("action_index_test.unused");
+
+  ExpectPropertyTrigger("action_index_test.a", "1");
+  EXPECT_EQ((std::vector<std::string>{"a=1", "a=*"}), ran);
+  ExpectPropertyTrigger("action_index_test.a", "2");
+  EXPECT_EQ((std::vector<std::string>{"a=*"}), ran);
+  ExpectPropertyTrigger("action_index_test.b", "2");
+  ExpectPropertyTrigger("ro.build.type", "user");
+  ExpectPropertyTrigger("sys.action_index_test", "1");
+  EXPECT_EQ((std::vector<std::string>{"build_type_and_sys"}), ran);
+  ExpectPropertyTrigger("action_index_test.unused", "1");
+
+  // Every property-only action, checked against the current properties.
+  am_.QueueAllPropertyTriggers();
+  EXPECT_EQ(FullScan([](const Action& a) { return a.CheckPropertyTrigger("", ""); }),
+            RunQueued());
+}
+
+TEST_F(ActionIndexTest, runs_builtins_once) {
+  AddAction({"action_index_test.builtin"}, "event");
+
+  // The builtin's action is indexed under its name until it has run.
+  am_.QueueBuiltinAction(Record, "action_index_test.builtin");
+  am_.QueueEventTrigger("action_index_test.builtin");
+  am_.QueueBuiltinAction(Record, "action_index_test.builtin");
+  EXPECT_EQ((std::vector<std::string>{"action_index_test.builtin", "event",
+                                      "action_index_test.builtin"}),
+            RunQueued());
+
+  ExpectEventTrigger("action_index_test.builtin");
+  EXPECT_EQ((std::vector<std::string>{"event"}), ran);
+}
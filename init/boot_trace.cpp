@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_trace.h"
+
+#include <inttypes.h>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+using android::base::StringAppendF;
+
+const char BootTrace::kChromeTracePath[] = "/data/bootchart/boot_trace.json";
+
+// Enough for every action, command and service start of a normal boot.
+static constexpr size_t kMaxEvents = 16384;
+
+static const char* CategoryName(BootTrace::Category category) {
+    switch (category) {
+        case BootTrace::kAction: return "action";
+        case BootTrace::kCommand: return "command";
+        case BootTrace::kService: return "service";
+        case BootTrace::kWait: return "wait";
+    }
+    return "unknown";
+}
+
+static int64_t ToMicroseconds(boot_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+static void AppendJsonString(std::string* out, const std::string& s) {
+    out->push_back('"');
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out->push_back('\\');
+            out->push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            StringAppendF(out, "\\u%04x", c);
+        } else {
+            out->push_back(c);
+        }
+    }
+    out->push_back('"');
+}
+
+BootTrace& BootTrace::GetInstance() {
+    static BootTrace instance(kMaxEvents);
+    return instance;
+}
+
+BootTrace::BootTrace(size_t max_events) : max_events_(max_events), dropped_events_(0) {
+}
+
+void BootTrace::AddEvent(Category category, const std::string& name,
+                         boot_clock::time_point start, const std::string& detail) {
+    if (events_.size() >= max_events_) {
+        ++dropped_events_;
+        return;
+    }
+    events_.push_back({category, name, detail, start, boot_clock::now() - start});
+}
+
+void BootTrace::Dump() const {
+    LOG(INFO) << "Boot trace: " << events_.size() << " events, " << dropped_events_
+              << " dropped";
+    for (const auto& e : events_) {
+        LOG(INFO) << "  " << ToMicroseconds(e.start.time_since_epoch()) << "us +"
+                  << ToMicroseconds(e.duration) << "us " << CategoryName(e.category) << " '"
+                  << e.name << "'" << (e.detail.empty() ? "" : " ") << e.detail;
+    }
+}
+
+std::string BootTrace::ToChromeTrace() const {
+    // init's main thread is tid 1, and waits are tid 2.
+    std::string out =
+        "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"init\"}},\n"
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"waits\"}}";
+    for (const auto& e : events_) {
+        out += ",\n{\"name\":";
+        AppendJsonString(&out, e.name);
+        StringAppendF(&out, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRId64 ",\"dur\":%" PRId64
+                      ",\"pid\":1,\"tid\":%d",
+                      CategoryName(e.category), ToMicroseconds(e.start.time_since_epoch()),
+                      ToMicroseconds(e.duration), e.category == kWait ? 2 : 1);
+        if (!e.detail.empty()) {
+            out += ",\"args\":{\"detail\":";
+            AppendJsonString(&out, e.detail);
+            out += "}";
+        }
+        out += "}";
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+bool BootTrace::WriteChromeTrace(const std::string& path) const {
+    if (!android::base::WriteStringToFile(ToChromeTrace(), path, 0644, 0, 0)) {
+        PLOG(ERROR) << "failed to write boot trace to " << path;
+        return false;
+    }
+    LOG(INFO) << "Wrote " << events_.size() << " boot trace events to " << path;
+    return true;
+}
+
+void BootTrace::HandleControlMessage(const std::string& msg) const {
+    if (msg == "dump") {
+        Dump();
+    } else if (msg == "write") {
+        WriteChromeTrace(kChromeTracePath);
+    } else {
+        LOG(ERROR) << "unknown boot_trace control msg '" << msg << "'";
+    }
+}
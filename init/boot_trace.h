@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_BOOT_TRACE_H
+#define _INIT_BOOT_TRACE_H
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+// An in-memory record of what init spent its time on: every action and
+// command it ran, every service it started, and how long it waited for
+// coldboot, exec'ed processes and properties. Setting ctl.boot_trace to
+// "dump" logs it, and to "write" saves it to kChromeTracePath in the Chrome
+// trace event format, which chrome://tracing and Perfetto can show.
+//
+// Only init's main thread may use the trace.
+class BootTrace {
+public:
+    enum Category {
+        kAction,
+        kCommand,
+        kService,
+        // Waits are shown on a track of their own, since init keeps handling
+        // events while it waits.
+        kWait,
+    };
+
+    static BootTrace& GetInstance();
+
+    explicit BootTrace(size_t max_events);
+
+    // Records an event that started at start and has just finished.
+    void AddEvent(Category category, const std::string& name, boot_clock::time_point start,
+                  const std::string& detail = "");
+
+    // Logs every event recorded so far.
+    void Dump() const;
+
+    std::string ToChromeTrace() const;
+    bool WriteChromeTrace(const std::string& path) const;
+
+    // Handles the ctl.boot_trace control message.
+    void HandleControlMessage(const std::string& msg) const;
+
+    static const char kChromeTracePath[];
+
+private:
+    BootTrace(const BootTrace&) = delete;
+    void operator=(const BootTrace&) = delete;
+
+    struct Event {
+        Category category;
+        std::string name;
+        std::string detail;
+        boot_clock::time_point start;
+        boot_clock::duration duration;
+    };
+
+    std::vector<Event> events_;
+    const size_t max_events_;
+    // Events not recorded because there were already max_events_.
+    size_t dropped_events_;
+};
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_trace.h"
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+static size_t CountOf(const std::string& haystack, const std::string& needle) {
+  size_t count = 0;
+  for (size_t pos = haystack.find(needle); pos != std::string::npos;
+       pos = haystack.find(needle, pos + 1)) {
+    count++;
+  }
+  return count;
+}
+
+TEST(boot_trace, chrome_trace) {
+  BootTrace trace(16);
+  boot_clock::time_point start(std::chrono::milliseconds(1500));
+  trace.AddEvent(BootTrace::kCommand, "mkdir /data", start, "action=post-fs-data returned 0");
+  trace.AddEvent(BootTrace::kWait, "coldboot", start);
+
+  std::string json = trace.ToChromeTrace();
+  EXPECT_EQ(0U, json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"));
+  EXPECT_NE(std::string::npos,
+            json.find("{\"name\":\"mkdir /data\",\"cat\":\"command\",\"ph\":\"X\","
+                      "\"ts\":1500000,\"dur\":"));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"detail\":\"action=post-fs-data returned 0\"}"));
+  EXPECT_NE(std::string::npos,
+            json.find("{\"name\":\"coldboot\",\"cat\":\"wait\",\"ph\":\"X\",\"ts\":1500000,"));
+  EXPECT_NE(std::string::npos, json.find(",\"pid\":1,\"tid\":2}"));
+  EXPECT_EQ(4U, CountOf(json, "\"ph\":"));
+  EXPECT_EQ("\n]}\n", json.substr(json.size() - 4));
+}
+
+TEST(boot_trace, escapes_strings) {
+  BootTrace trace(16);
+  trace.AddEvent(BootTrace::kService, "a\"b\\c\nd", boot_clock::now());
+  EXPECT_NE(std::string::npos, trace.ToChromeTrace().find("\"name\":\"a\\\"b\\\\c\\u000ad\""));
+}
+
+TEST(boot_trace, drops_events_beyond_limit) {
+  BootTrace trace(2);
+  for (int i = 0; i < 5; i++) {
+    trace.AddEvent(BootTrace::kAction, "boot", boot_clock::now());
+  }
+  EXPECT_EQ(2U, CountOf(trace.ToChromeTrace(), "\"name\":\"boot\""));
+}
+
+TEST(boot_trace, write_chrome_trace) {
+  BootTrace trace(16);
+  trace.AddEvent(BootTrace::kAction, "early-init", boot_clock::now());
+
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/boot_trace.json";
+  ASSERT_TRUE(trace.WriteChromeTrace(path));
+  std::string content;
+  ASSERT_TRUE(android::base::ReadFileToString(path, &content));
+  EXPECT_EQ(trace.ToChromeTrace(), content);
+}
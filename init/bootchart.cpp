@@ -29,6 +29,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <memory>
@@ -39,7 +40,12 @@
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "bootchart_collector.h"
+#include "util.h"
 
 using android::base::StringPrintf;
 using namespace std::chrono_literals;
@@ -50,12 +56,6 @@ static std::mutex g_bootcharting_finished_mutex;
 static std::condition_variable g_bootcharting_finished_cv;
 static bool g_bootcharting_finished;
 
-static long long get_uptime_jiffies() {
-  std::string uptime;
-  if (!android::base::ReadFileToString("/proc/uptime", &uptime)) return 0;
-  return 100LL * strtod(uptime.c_str(), NULL);
-}
-
 static std::unique_ptr<FILE, decltype(&fclose)> fopen_unique(const char* filename,
                                                              const char* mode) {
   std::unique_ptr<FILE, decltype(&fclose)> result(fopen(filename, mode), fclose);
@@ -89,90 +89,53 @@ static void log_header() {
   fprintf(&*fp, "system.kernel.options = %s\n", kernel_cmdline.c_str());
 }
 
-static void log_uptime(FILE* log) {
-  fprintf(log, "%lld\n", get_uptime_jiffies());
-}
-
-static void log_file(FILE* log, const char* procfile) {
-  log_uptime(log);
-
-  std::string content;
-  if (android::base::ReadFileToString(procfile, &content)) {
-    fprintf(log, "%s\n", content.c_str());
-  }
-}
-
-static void log_processes(FILE* log) {
-  log_uptime(log);
-
-  std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir("/proc"), closedir);
-  struct dirent* entry;
-  while ((entry = readdir(dir.get())) != NULL) {
-    // Only match numeric values.
-    int pid = atoi(entry->d_name);
-    if (pid == 0) continue;
-
-    // /proc/<pid>/stat only has truncated task names, so get the full
-    // name from /proc/<pid>/cmdline.
-    std::string cmdline;
-    android::base::ReadFileToString(StringPrintf("/proc/%d/cmdline", pid), &cmdline);
-    const char* full_name = cmdline.c_str(); // So we stop at the first NUL.
-
-    // Read process stat line.
-    std::string stat;
-    if (android::base::ReadFileToString(StringPrintf("/proc/%d/stat", pid), &stat)) {
-      if (!cmdline.empty()) {
-        // Substitute the process name with its real name.
-        size_t open = stat.find('(');
-        size_t close = stat.find_last_of(')');
-        if (open != std::string::npos && close != std::string::npos) {
-          stat.replace(open + 1, close - open - 1, full_name);
-        }
-      }
-      fputs(stat.c_str(), log);
-    }
-  }
-
-  fputc('\n', log);
-}
-
-static void bootchart_thread_main() {
-  LOG(INFO) << "Bootcharting started";
+static void bootchart_thread_main(std::chrono::milliseconds interval) {
+  LOG(INFO) << "Bootcharting started, sampling every " << interval.count() << "ms";
 
-  // Open log files.
-  auto stat_log = fopen_unique("/data/bootchart/proc_stat.log", "we");
-  if (!stat_log) return;
-  auto proc_log = fopen_unique("/data/bootchart/proc_ps.log", "we");
-  if (!proc_log) return;
-  auto disk_log = fopen_unique("/data/bootchart/proc_diskstats.log", "we");
-  if (!disk_log) return;
+  BootchartCollector collector;
+  if (!collector.Open("/data/bootchart/bootchart.bin")) return;
 
   log_header();
 
+  int samples = 0;
+  boot_clock::duration sampling_time(0);
+  auto next = boot_clock::now();
   while (true) {
+    next = std::max(next + interval, boot_clock::now());
     {
       std::unique_lock<std::mutex> lock(g_bootcharting_finished_mutex);
-      g_bootcharting_finished_cv.wait_for(lock, 200ms);
+      g_bootcharting_finished_cv.wait_until(lock, next, [] { return g_bootcharting_finished; });
       if (g_bootcharting_finished) break;
     }
 
-    log_file(&*stat_log, "/proc/stat");
-    log_file(&*disk_log, "/proc/diskstats");
-    log_processes(&*proc_log);
+    auto start = boot_clock::now();
+    if (!collector.Sample()) break;
+    sampling_time += boot_clock::now() - start;
+    samples++;
   }
 
-  LOG(INFO) << "Bootcharting finished";
+  LOG(INFO) << "Bootcharting finished: " << samples << " samples took "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(sampling_time).count()
+            << "ms";
 }
 
 static int do_bootchart_start() {
-  // We don't care about the content, but we do care that /data/bootchart/enabled actually exists.
+  // /data/bootchart/enabled must exist. If it contains a number, that's the
+  // interval between samples in milliseconds.
   std::string start;
   if (!android::base::ReadFileToString("/data/bootchart/enabled", &start)) {
     LOG(VERBOSE) << "Not bootcharting";
     return 0;
   }
 
-  g_bootcharting_thread = new std::thread(bootchart_thread_main);
+  std::chrono::milliseconds interval = 200ms;
+  unsigned int interval_ms;
+  if (android::base::ParseUint(android::base::Trim(start), &interval_ms, 10000u) &&
+      interval_ms > 0) {
+    interval = std::chrono::milliseconds(interval_ms);
+  }
+
+  g_bootcharting_thread = new std::thread(bootchart_thread_main, interval);
   return 0;
 }
 
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bootchart_collector.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+// Rather than the proc_*.log files bootchart reads, samples are recorded
+// in bootchart.bin, which decode-bootchart.py turns back into them. The file
+// starts with kMagic, and is then a series of records, each a RecordHeader
+// followed by its payload:
+//   kSample: the uptime in jiffies as an int64_t, starting each sample;
+//   kProcStat, kDiskStats: the contents of /proc/stat or /proc/diskstats;
+//   kProcessStat: an int32_t pid and the contents of /proc/<pid>/stat;
+//   kCmdline: an int32_t pid and the contents of /proc/<pid>/cmdline, which is
+//       only read again when the process's name in its stat changes, and
+//       comes before the kProcessStat it was read for.
+static const uint32_t kMagic = 0x31544342;  // "BCT1"
+
+enum RecordType : uint32_t {
+  kSample = 1,
+  kProcStat = 2,
+  kDiskStats = 3,
+  kProcessStat = 4,
+  kCmdline = 5,
+};
+
+struct RecordHeader {
+  uint32_t type;
+  uint32_t length;
+};
+
+// Beyond this many processes, /proc/<pid>/stat is opened for each sample
+// rather than being kept open.
+static constexpr size_t kMaxOpenProcesses = 512;
+
+BootchartCollector::BootchartCollector(const std::string& proc)
+    : proc_(proc), proc_dir_(nullptr, closedir), size_(0) {
+}
+
+bool BootchartCollector::Open(const std::string& path) {
+  path_ = path;
+  out_fd_.reset(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0644));
+  proc_stat_fd_.reset(open((proc_ + "/stat").c_str(), O_RDONLY | O_CLOEXEC));
+  diskstats_fd_.reset(open((proc_ + "/diskstats").c_str(), O_RDONLY | O_CLOEXEC));
+  proc_dir_.reset(opendir(proc_.c_str()));
+  if (out_fd_ == -1 || proc_stat_fd_ == -1 || diskstats_fd_ == -1 || !proc_dir_) {
+    PLOG(ERROR) << "bootchart: failed to open files";
+    return false;
+  }
+
+  Append(&kMagic, sizeof(kMagic));
+  return Flush();
+}
+
+bool BootchartCollector::Sample() {
+  timespec now;
+  clock_gettime(CLOCK_BOOTTIME, &now);
+  int64_t uptime_jiffies = now.tv_sec * 100LL + now.tv_nsec / 10000000;
+  size_t record = BeginRecord(kSample);
+  Append(&uptime_jiffies, sizeof(uptime_jiffies));
+  EndRecord(record);
+
+  AppendFileRecord(kProcStat, proc_stat_fd_);
+  AppendFileRecord(kDiskStats, diskstats_fd_);
+  SampleProcesses();
+  return Flush();
+}
+
+void BootchartCollector::SampleProcesses() {
+  generation_++;
+  rewinddir(proc_dir_.get());
+  struct dirent* entry;
+  while ((entry = readdir(proc_dir_.get())) != NULL) {
+    // Only match numeric values.
+    int32_t pid = atoi(entry->d_name);
+    if (pid == 0) continue;
+
+    Process& process = processes_[pid];
+    process.generation = generation_;
+
+    size_t record = BeginRecord(kProcessStat);
+    Append(&pid, sizeof(pid));
+    size_t stat_start = size_;
+    // Once a process is gone its stat can't be read, even if its pid has
+    // been reused, so try again with a newly opened one.
+    if (process.stat_fd == -1 || !AppendFile(process.stat_fd)) {
+      process.stat_fd.reset(OpenProcFile(pid, "stat"));
+      if (process.stat_fd == -1 || !AppendFile(process.stat_fd)) {
+        size_ = record;
+        processes_.erase(pid);
+        continue;
+      }
+    }
+    EndRecord(record);
+
+    // /proc/<pid>/stat only has truncated task names; the converter gets
+    // the full name from the cmdline, which changes along with them on
+    // exec() and when zygote's children take their app's name.
+    const char* stat = &buffer_[stat_start];
+    size_t stat_size = size_ - stat_start;
+    auto open = static_cast<const char*>(memchr(stat, '(', stat_size));
+    auto close = static_cast<const char*>(memrchr(stat, ')', stat_size));
+    if (open != nullptr && close != nullptr && close > open &&
+        process.name.compare(0, std::string::npos, open + 1, close - open - 1) != 0) {
+      process.name.assign(open + 1, close - open - 1);
+      android::base::unique_fd cmdline_fd(OpenProcFile(pid, "cmdline"));
+      if (cmdline_fd != -1) {
+        // The converter names each stat after the cmdline before it, so set
+        // the stat record aside until the new cmdline has been written.
+        scratch_.assign(buffer_.begin() + record, buffer_.begin() + size_);
+        size_ = record;
+        AppendFileRecord(kCmdline, cmdline_fd, pid);
+        Append(scratch_.data(), scratch_.size());
+      }
+    }
+
+    if (processes_.size() > kMaxOpenProcesses) {
+      process.stat_fd.reset();
+    }
+  }
+
+  for (auto it = processes_.begin(); it != processes_.end();) {
+    if (it->second.generation != generation_) {
+      it = processes_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+int BootchartCollector::OpenProcFile(int32_t pid, const char* file) const {
+  std::string path = android::base::StringPrintf("%s/%d/%s", proc_.c_str(), pid, file);
+  return open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+void BootchartCollector::Append(const void* data, size_t size) {
+  Reserve(size);
+  memcpy(&buffer_[size_], data, size);
+  size_ += size;
+}
+
+// The buffer is kept from sample to sample, so only grows at the start.
+void BootchartCollector::Reserve(size_t size) {
+  if (buffer_.size() - size_ < size) {
+    buffer_.resize(std::max(buffer_.size() * 2, size_ + size));
+  }
+}
+
+// Appends everything that can be read from fd, from the start.
+bool BootchartCollector::AppendFile(int fd) {
+  size_t start = size_;
+  off_t offset = 0;
+  while (true) {
+    Reserve(4096);
+    ssize_t n = TEMP_FAILURE_RETRY(pread(fd, &buffer_[size_], buffer_.size() - size_, offset));
+    if (n < 0) {
+      size_ = start;
+      return false;
+    }
+    if (n == 0) return true;
+    size_ += n;
+    offset += n;
+  }
+}
+
+size_t BootchartCollector::BeginRecord(uint32_t type) {
+  size_t start = size_;
+  RecordHeader header = {type, 0};
+  Append(&header, sizeof(header));
+  return start;
+}
+
+void BootchartCollector::EndRecord(size_t start) {
+  uint32_t length = size_ - start - sizeof(RecordHeader);
+  memcpy(&buffer_[start + offsetof(RecordHeader, length)], &length, sizeof(length));
+}
+
+void BootchartCollector::AppendFileRecord(uint32_t type, int fd, int32_t pid) {
+  size_t record = BeginRecord(type);
+  if (type == kCmdline) Append(&pid, sizeof(pid));
+  if (AppendFile(fd)) {
+    EndRecord(record);
+  } else {
+    size_ = record;
+  }
+}
+
+bool BootchartCollector::Flush() {
+  bool ok = android::base::WriteFully(out_fd_, &buffer_[0], size_);
+  if (!ok) PLOG(ERROR) << "bootchart: failed to write " << path_;
+  size_ = 0;
+  return ok;
+}
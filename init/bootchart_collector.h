@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_BOOTCHART_COLLECTOR_H
+#define _INIT_BOOTCHART_COLLECTOR_H
+
+#include <dirent.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+// Samples /proc for bootchart, recording each sample in the compact format
+// described in bootchart_collector.cpp, which decode-bootchart.py turns into
+// the logs bootchart reads.
+class BootchartCollector {
+ public:
+  // Reads from proc, which is only anything but /proc in tests.
+  explicit BootchartCollector(const std::string& proc = "/proc");
+
+  // Creates the output file at path, and opens the files every sample reads.
+  bool Open(const std::string& path);
+
+  // Appends a sample to the output file.
+  bool Sample();
+
+ private:
+  struct Process {
+    android::base::unique_fd stat_fd;
+    // The name in the stat last time the cmdline was read.
+    std::string name;
+    unsigned generation = 0;
+  };
+
+  void SampleProcesses();
+  int OpenProcFile(int32_t pid, const char* file) const;
+
+  void Append(const void* data, size_t size);
+  void Reserve(size_t size);
+  bool AppendFile(int fd);
+  size_t BeginRecord(uint32_t type);
+  void EndRecord(size_t start);
+  void AppendFileRecord(uint32_t type, int fd, int32_t pid = 0);
+  bool Flush();
+
+  const std::string proc_;
+  std::string path_;
+  android::base::unique_fd out_fd_;
+  android::base::unique_fd proc_stat_fd_;
+  android::base::unique_fd diskstats_fd_;
+  std::unique_ptr<DIR, int(*)(DIR*)> proc_dir_;
+  std::unordered_map<int32_t, Process> processes_;
+  unsigned generation_ = 0;
+
+  std::vector<char> buffer_;
+  size_t size_;
+  // A process's stat record, while its cmdline record is put before it.
+  std::vector<char> scratch_;
+
+  BootchartCollector(const BootchartCollector&) = delete;
+  void operator=(const BootchartCollector&) = delete;
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bootchart_collector.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include <map>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+// Turns bootchart.bin into the contents of proc_ps.log, a string per sample,
+// the way decode-bootchart.py does: each stat gets the full name from the
+// last cmdline recorded for its pid.
+static std::vector<std::string> DecodeProcesses(const std::string& data) {
+  std::vector<std::string> samples;
+  std::map<int32_t, std::string> cmdlines;
+  size_t offset = sizeof(uint32_t);
+  while (offset + 2 * sizeof(uint32_t) <= data.size()) {
+    uint32_t type, length;
+    memcpy(&type, &data[offset], sizeof(type));
+    memcpy(&length, &data[offset + sizeof(type)], sizeof(length));
+    offset += sizeof(type) + sizeof(length);
+    std::string payload = data.substr(offset, length);
+    offset += length;
+
+    if (type == 1) {
+      samples.emplace_back();
+    } else if (type == 4 || type == 5) {
+      int32_t pid;
+      memcpy(&pid, &payload[0], sizeof(pid));
+      std::string text = payload.substr(sizeof(pid));
+      if (type == 5) {
+        cmdlines[pid] = text.substr(0, text.find('\0'));
+      } else {
+        auto cmdline = cmdlines.find(pid);
+        if (cmdline != cmdlines.end()) {
+          size_t open = text.find('(');
+          size_t close = text.rfind(')');
+          text.replace(open + 1, close - open - 1, cmdline->second);
+        }
+        samples.back() += text;
+      }
+    }
+  }
+  return samples;
+}
+
+static void WriteProcess(const std::string& proc, const std::string& name,
+                         const std::string& cmdline) {
+  ASSERT_TRUE(android::base::WriteStringToFile("42 (" + name + ") S 1 42\n", proc + "/42/stat"));
+  ASSERT_TRUE(android::base::WriteStringToFile(cmdline, proc + "/42/cmdline"));
+}
+
+TEST(bootchart_collector, names_processes_after_their_current_cmdline) {
+  TemporaryDir proc;
+  ASSERT_TRUE(android::base::WriteStringToFile("cpu 1 2 3\n", std::string(proc.path) + "/stat"));
+  ASSERT_TRUE(android::base::WriteStringToFile("", std::string(proc.path) + "/diskstats"));
+  ASSERT_EQ(0, mkdir((std::string(proc.path) + "/42").c_str(), 0755));
+  WriteProcess(proc.path, "app_process", std::string("zygote\0--start", 14));
+
+  TemporaryDir out;
+  std::string path = std::string(out.path) + "/bootchart.bin";
+  BootchartCollector collector(proc.path);
+  ASSERT_TRUE(collector.Open(path));
+  ASSERT_TRUE(collector.Sample());
+  // Like one of zygote's children taking its app's name.
+  WriteProcess(proc.path, "droid.launcher3", std::string("com.android.launcher3\0", 22));
+  ASSERT_TRUE(collector.Sample());
+  ASSERT_TRUE(collector.Sample());
+
+  std::string data;
+  ASSERT_TRUE(android::base::ReadFileToString(path, &data));
+  std::vector<std::string> samples = DecodeProcesses(data);
+  ASSERT_EQ(3U, samples.size());
+  EXPECT_EQ("42 (zygote) S 1 42\n", samples[0]);
+  EXPECT_EQ("42 (com.android.launcher3) S 1 42\n", samples[1]);
+  EXPECT_EQ("42 (com.android.launcher3) S 1 42\n", samples[2]);
+
+  // The cmdline is only read again when the name changes.
+  size_t cmdlines = 0;
+  for (size_t pos = data.find("com.android.launcher3"); pos != std::string::npos;
+       pos = data.find("com.android.launcher3", pos + 1)) {
+    cmdlines++;
+  }
+  EXPECT_EQ(1U, cmdlines);
+
+  unlink(path.c_str());
+  unlink((std::string(proc.path) + "/42/stat").c_str());
+  unlink((std::string(proc.path) + "/42/cmdline").c_str());
+  rmdir((std::string(proc.path) + "/42").c_str());
+  unlink((std::string(proc.path) + "/stat").c_str());
+  unlink((std::string(proc.path) + "/diskstats").c_str());
+}
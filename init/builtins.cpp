@@ -131,8 +131,15 @@ static int do_class_start(const std::vector<std::string>& args) {
          * which are explicitly disabled.  They must
          * be started individually.
          */
+    Timer t;
+    int started = 0;
     ServiceManager::GetInstance().
-        ForEachServiceInClass(args[1], [] (Service* s) { s->StartIfNotDisabled(); });
+        ForEachServiceInClass(args[1], [&started] (Service* s) {
+            bool was_running = s->flags() & SVC_RUNNING;
+            s->StartIfNotDisabled();
+            if (!was_running && (s->flags() & SVC_RUNNING)) ++started;
+        });
+    LOG(INFO) << "class_start " << args[1] << ": started " << started << " services in " << t;
     return 0;
 }
 
@@ -0,0 +1,112 @@
+#!/usr/bin/env python
+
+# Copyright (C) 2017 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Convert init's bootchart.bin into the logs bootchart reads.
+
+Usage: decode-bootchart.py bootchart.bin output-dir
+
+Writes proc_stat.log, proc_diskstats.log and proc_ps.log to output-dir, in
+the format init used to write them in directly: each sample is the uptime in
+jiffies on a line of its own, then the contents of /proc/stat, of
+/proc/diskstats, or of every /proc/<pid>/stat with the process's name
+replaced by its full name from /proc/<pid>/cmdline.
+
+See bootchart_collector.cpp for the format of bootchart.bin.
+"""
+
+import os
+import struct
+import sys
+
+MAGIC = 0x31544342
+
+SAMPLE = 1
+PROC_STAT = 2
+DISK_STATS = 3
+PROCESS_STAT = 4
+CMDLINE = 5
+
+def read_records(data):
+    """Yields the (type, payload) records in data, ignoring a truncated last one."""
+    if len(data) < 4 or struct.unpack_from('<I', data, 0)[0] != MAGIC:
+        raise ValueError('not a bootchart.bin file')
+    offset = 4
+    while offset + 8 <= len(data):
+        record_type, length = struct.unpack_from('<II', data, offset)
+        offset += 8
+        if offset + length > len(data):
+            break
+        yield record_type, data[offset:offset + length]
+        offset += length
+
+def with_full_name(stat, cmdline):
+    if not cmdline:
+        return stat
+    full_name = cmdline.split(b'\0')[0]
+    open_paren = stat.find(b'(')
+    close_paren = stat.rfind(b')')
+    if open_paren == -1 or close_paren == -1:
+        return stat
+    return stat[:open_paren + 1] + full_name + stat[close_paren:]
+
+def decode(data, output_dir):
+    def open_log(name):
+        return open(os.path.join(output_dir, name), 'wb')
+
+    stat_log = open_log('proc_stat.log')
+    disk_log = open_log('proc_diskstats.log')
+    proc_log = open_log('proc_ps.log')
+    cmdlines = {}
+    in_sample = False
+    samples = 0
+
+    for record_type, payload in read_records(data):
+        if record_type == SAMPLE:
+            if in_sample:
+                proc_log.write(b'\n')
+            in_sample = True
+            samples += 1
+            uptime = ('%d\n' % struct.unpack('<q', payload)[0]).encode('ascii')
+            stat_log.write(uptime)
+            disk_log.write(uptime)
+            proc_log.write(uptime)
+        elif record_type == PROC_STAT:
+            stat_log.write(payload + b'\n')
+        elif record_type == DISK_STATS:
+            disk_log.write(payload + b'\n')
+        elif record_type == CMDLINE:
+            pid = struct.unpack_from('<i', payload)[0]
+            cmdlines[pid] = payload[4:]
+        elif record_type == PROCESS_STAT:
+            pid = struct.unpack_from('<i', payload)[0]
+            proc_log.write(with_full_name(payload[4:], cmdlines.get(pid)))
+    if in_sample:
+        proc_log.write(b'\n')
+
+    for log in (stat_log, disk_log, proc_log):
+        log.close()
+    return samples
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: %s bootchart.bin output-dir' % sys.argv[0])
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    samples = decode(data, sys.argv[2])
+    print('Decoded %d samples' % samples)
+
+if __name__ == '__main__':
+    main()
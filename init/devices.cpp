@@ -17,7 +17,6 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <fnmatch.h>
 #include <libgen.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -34,8 +33,12 @@
 
 #include <linux/netlink.h>
 
+#include <algorithm>
+#include <functional>
 #include <memory>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <selinux/selinux.h>
 #include <selinux/label.h>
@@ -51,6 +54,7 @@
 #include <cutils/uevent.h>
 
 #include "devices.h"
+#include "path_matcher.h"
 #include "ueventd_parser.h"
 #include "util.h"
 #include "log.h"
@@ -65,18 +69,11 @@ extern struct selabel_handle *sehandle;
 static android::base::unique_fd device_fd;
 
 struct perms_ {
-    char *name;
-    char *attr;
+    std::string name;
+    std::string attr;
     mode_t perm;
     unsigned int uid;
     unsigned int gid;
-    unsigned short prefix;
-    unsigned short wildcard;
-};
-
-struct perm_node {
-    struct perms_ dp;
-    struct listnode plist;
 };
 
 struct platform_node {
@@ -86,71 +83,40 @@ struct platform_node {
     struct listnode list;
 };
 
-static list_declare(sys_perms);
-static list_declare(dev_perms);
+// Rules in the order they were parsed, indexed by the rule numbers of the
+// matching PathMatcher.
+static std::vector<perms_> sys_perms;
+static PathMatcher sys_perms_matcher;
+static std::vector<perms_> dev_perms;
+static PathMatcher dev_perms_matcher;
 static list_declare(platform_names);
 
 int add_dev_perms(const char *name, const char *attr,
                   mode_t perm, unsigned int uid, unsigned int gid,
                   unsigned short prefix,
                   unsigned short wildcard) {
-    struct perm_node *node = (perm_node*) calloc(1, sizeof(*node));
-    if (!node)
-        return -ENOMEM;
-
-    node->dp.name = strdup(name);
-    if (!node->dp.name) {
-        free(node);
-        return -ENOMEM;
-    }
-
     if (attr) {
-        node->dp.attr = strdup(attr);
-        if (!node->dp.attr) {
-            free(node->dp.name);
-            free(node);
-            return -ENOMEM;
-        }
-    }
-
-    node->dp.perm = perm;
-    node->dp.uid = uid;
-    node->dp.gid = gid;
-    node->dp.prefix = prefix;
-    node->dp.wildcard = wildcard;
-
-    if (attr)
-        list_add_tail(&sys_perms, &node->plist);
-    else
-        list_add_tail(&dev_perms, &node->plist);
-
-    return 0;
-}
-
-static bool perm_path_matches(const char *path, struct perms_ *dp)
-{
-    if (dp->prefix) {
-        if (strncmp(path, dp->name, strlen(dp->name)) == 0)
-            return true;
-    } else if (dp->wildcard) {
-        if (fnmatch(dp->name, path, FNM_PATHNAME) == 0)
-            return true;
+        sys_perms_matcher.Add(name, prefix, wildcard);
+        sys_perms.push_back({name, attr, perm, uid, gid});
     } else {
-        if (strcmp(path, dp->name) == 0)
-            return true;
+        dev_perms_matcher.Add(name, prefix, wildcard);
+        dev_perms.push_back({name, "", perm, uid, gid});
     }
-
-    return false;
+    return 0;
 }
 
-static bool match_subsystem(perms_* dp, const char* pattern,
-                            const char* path, const char* subsystem) {
-    if (!pattern || !subsystem || strstr(dp->name, subsystem) == NULL) {
-        return false;
-    }
-
+// Adds the sys rules matching the path a device has under its subsystem
+// directory, for the rules that name that subsystem.
+static void match_subsystem(const char* pattern, const char* path,
+                            const char* subsystem, std::vector<int>* matches) {
     std::string subsys_path = android::base::StringPrintf(pattern, subsystem, basename(path));
-    return perm_path_matches(subsys_path.c_str(), dp);
+    std::vector<int> subsys_matches;
+    sys_perms_matcher.FindAll(subsys_path.c_str(), &subsys_matches);
+    for (int rule : subsys_matches) {
+        if (sys_perms[rule].name.find(subsystem) != std::string::npos) {
+            matches->emplace_back(rule);
+        }
+    }
 }
 
 static void fixup_sys_perms(const char* upath, const char* subsystem) {
@@ -158,22 +124,23 @@ static void fixup_sys_perms(const char* upath, const char* subsystem) {
     // contain, so we prepend it...
     std::string path = std::string(SYSFS_PREFIX) + upath;
 
-    listnode* node;
-    list_for_each(node, &sys_perms) {
-        perms_* dp = &(node_to_item(node, perm_node, plist))->dp;
-        if (match_subsystem(dp, SYSFS_PREFIX "/class/%s/%s", path.c_str(), subsystem)) {
-            ; // matched
-        } else if (match_subsystem(dp, SYSFS_PREFIX "/bus/%s/devices/%s", path.c_str(), subsystem)) {
-            ; // matched
-        } else if (!perm_path_matches(path.c_str(), dp)) {
-            continue;
-        }
+    std::vector<int> matches;
+    sys_perms_matcher.FindAll(path.c_str(), &matches);
+    if (subsystem) {
+        match_subsystem(SYSFS_PREFIX "/class/%s/%s", path.c_str(), subsystem, &matches);
+        match_subsystem(SYSFS_PREFIX "/bus/%s/devices/%s", path.c_str(), subsystem, &matches);
+    }
 
-        std::string attr_file = path + "/" + dp->attr;
+    // Apply the rules in the order they were given, once each.
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    for (int rule : matches) {
+        const perms_& dp = sys_perms[rule];
+        std::string attr_file = path + "/" + dp.attr;
         LOG(INFO) << "fixup " << attr_file
-                  << " " << dp->uid << " " << dp->gid << " " << std::oct << dp->perm;
-        chown(attr_file.c_str(), dp->uid, dp->gid);
-        chmod(attr_file.c_str(), dp->perm);
+                  << " " << dp.uid << " " << dp.gid << " " << std::oct << dp.perm;
+        chown(attr_file.c_str(), dp.uid, dp.gid);
+        chmod(attr_file.c_str(), dp.perm);
     }
 
     if (access(path.c_str(), F_OK) == 0) {
@@ -185,38 +152,20 @@ static void fixup_sys_perms(const char* upath, const char* subsystem) {
 static mode_t get_device_perm(const char *path, const char **links,
                 unsigned *uid, unsigned *gid)
 {
-    struct listnode *node;
-    struct perm_node *perm_node;
-    struct perms_ *dp;
-
-    /* search the perms list in reverse so that ueventd.$hardware can
+    /* the last matching rule wins, so that ueventd.$hardware can
      * override ueventd.rc
      */
-    list_for_each_reverse(node, &dev_perms) {
-        bool match = false;
-
-        perm_node = node_to_item(node, struct perm_node, plist);
-        dp = &perm_node->dp;
-
-        if (perm_path_matches(path, dp)) {
-            match = true;
-        } else {
-            if (links) {
-                int i;
-                for (i = 0; links[i]; i++) {
-                    if (perm_path_matches(links[i], dp)) {
-                        match = true;
-                        break;
-                    }
-                }
-            }
+    int rule = dev_perms_matcher.FindLast(path);
+    if (links) {
+        for (int i = 0; links[i]; i++) {
+            rule = std::max(rule, dev_perms_matcher.FindLast(links[i]));
         }
+    }
 
-        if (match) {
-            *uid = dp->uid;
-            *gid = dp->gid;
-            return dp->perm;
-        }
+    if (rule != -1) {
+        *uid = dev_perms[rule].uid;
+        *gid = dev_perms[rule].gid;
+        return dev_perms[rule].perm;
     }
     /* Default if nothing found. */
     *uid = 0;
@@ -984,7 +933,7 @@ coldboot_action_t handle_device_fd(coldboot_callback fn)
 ** socket's buffer.
 */
 
-static coldboot_action_t do_coldboot(DIR *d, coldboot_callback fn)
+static coldboot_action_t do_coldboot(DIR *d, const std::function<coldboot_action_t()>& drain)
 {
     struct dirent *de;
     int dfd, fd;
@@ -996,7 +945,7 @@ static coldboot_action_t do_coldboot(DIR *d, coldboot_callback fn)
     if (fd >= 0) {
         write(fd, "add\n", 4);
         close(fd);
-        act = handle_device_fd(fn);
+        act = drain();
         if (should_stop_coldboot(act))
             return act;
     }
@@ -1015,7 +964,7 @@ static coldboot_action_t do_coldboot(DIR *d, coldboot_callback fn)
         if(d2 == 0)
             close(fd);
         else {
-            act = do_coldboot(d2, fn);
+            act = do_coldboot(d2, drain);
             closedir(d2);
         }
     }
@@ -1024,17 +973,134 @@ static coldboot_action_t do_coldboot(DIR *d, coldboot_callback fn)
     return act;
 }
 
-static coldboot_action_t coldboot(const char *path, coldboot_callback fn)
+static coldboot_action_t coldboot(const char *path,
+                                  const std::function<coldboot_action_t()>& drain)
 {
     std::unique_ptr<DIR, decltype(&closedir)> d(opendir(path), closedir);
     if (d) {
-        return do_coldboot(d.get(), fn);
+        return do_coldboot(d.get(), drain);
+    }
+
+    return COLDBOOT_CONTINUE;
+}
+
+static coldboot_action_t coldboot_all(const std::function<coldboot_action_t()>& drain)
+{
+    coldboot_action_t act = coldboot("/sys/class", drain);
+    if (!should_stop_coldboot(act)) {
+        act = coldboot("/sys/block", drain);
+        if (!should_stop_coldboot(act)) {
+            act = coldboot("/sys/devices", drain);
+        }
+    }
+    return act;
+}
+
+/* Parallel coldboot splits the work in two. First the /sys walk only
+** queues the regenerated uevents instead of handling each one as it
+** arrives. The queue is then split between worker processes, which
+** create the device nodes and links concurrently.
+**
+** Workers are processes rather than threads because make_device()
+** changes the process' egid and fscreate context.
+**
+** To get the same results as a serial coldboot:
+** - All uevents for a device go to the same worker, in the order they
+**   arrived.
+** - Platform device uevents are handled while queuing, so every worker
+**   starts with the full list of platform devices that
+**   find_platform_device() needs for link names.
+** - Firmware loading is also started while queuing, as it would have
+**   been.
+*/
+
+struct queued_uevent {
+    std::string msg;
+    unsigned int worker;
+};
+
+static coldboot_action_t queue_device_fd(std::vector<queued_uevent>* queue,
+                                         unsigned int num_workers)
+{
+    char msg[UEVENT_MSG_LEN+2];
+    int n;
+    while ((n = uevent_kernel_multicast_recv(device_fd, msg, UEVENT_MSG_LEN)) > 0) {
+        if(n >= UEVENT_MSG_LEN)   /* overflow -- discard */
+            continue;
+
+        msg[n] = '\0';
+        msg[n+1] = '\0';
+
+        struct uevent uevent;
+        parse_event(msg, &uevent);
+        if (!strncmp(uevent.subsystem, "platform", 8)) {
+            handle_device_event(&uevent);
+        } else {
+            unsigned int worker = std::hash<std::string>()(uevent.path) % num_workers;
+            queue->push_back({std::string(msg, n + 2), worker});
+        }
+        handle_firmware_event(&uevent);
     }
 
     return COLDBOOT_CONTINUE;
 }
 
-void device_init(const char* path, coldboot_callback fn) {
+static void handle_queued_uevents(const std::vector<queued_uevent>& queue, unsigned int worker)
+{
+    for (const auto& queued : queue) {
+        if (queued.worker == worker) {
+            struct uevent uevent;
+            parse_event(queued.msg.data(), &uevent);
+            handle_device_event(&uevent);
+        }
+    }
+}
+
+static void parallel_coldboot(unsigned int num_workers)
+{
+    Timer t;
+    std::vector<queued_uevent> queue;
+    coldboot_all([&]() { return queue_device_fd(&queue, num_workers); });
+    double queue_ms = t.duration_s() * 1000;
+
+    if (selinux_status_updated() > 0) {
+        struct selabel_handle *sehandle2;
+        sehandle2 = selinux_android_file_context_handle();
+        if (sehandle2) {
+            selabel_close(sehandle);
+            sehandle = sehandle2;
+        }
+    }
+
+    // This process takes worker 0's share of the queue itself, and any
+    // share a child couldn't be forked for.
+    std::vector<pid_t> children;
+    for (unsigned int worker = 1; worker < num_workers; worker++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            handle_queued_uevents(queue, worker);
+            _exit(EXIT_SUCCESS);
+        } else if (pid == -1) {
+            PLOG(ERROR) << "could not fork coldboot worker " << worker;
+            handle_queued_uevents(queue, worker);
+        } else {
+            children.push_back(pid);
+        }
+    }
+    handle_queued_uevents(queue, 0);
+
+    // ueventd ignores SIGCHLD, so the children are reaped automatically and
+    // waitpid() fails with ECHILD once each has exited.
+    for (pid_t pid : children) {
+        TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
+    }
+
+    LOG(INFO) << "Coldboot queued " << queue.size() << " uevents in " << queue_ms
+              << "ms and handled them with " << num_workers << " processes in "
+              << (t.duration_s() * 1000 - queue_ms) << "ms";
+}
+
+void device_init(const char* path, coldboot_callback fn, unsigned int num_workers) {
     if (!sehandle) {
         sehandle = selinux_android_file_context_handle();
     }
@@ -1057,16 +1123,14 @@ void device_init(const char* path, coldboot_callback fn) {
 
     Timer t;
     coldboot_action_t act;
-    if (!path) {
-        act = coldboot("/sys/class", fn);
-        if (!should_stop_coldboot(act)) {
-            act = coldboot("/sys/block", fn);
-            if (!should_stop_coldboot(act)) {
-                act = coldboot("/sys/devices", fn);
-            }
-        }
+    auto drain = [&fn]() { return handle_device_fd(fn); };
+    if (!path && !fn && num_workers > 1) {
+        parallel_coldboot(num_workers);
+        act = COLDBOOT_CONTINUE;
+    } else if (!path) {
+        act = coldboot_all(drain);
     } else {
-        act = coldboot(path, fn);
+        act = coldboot(path, drain);
     }
 
     // If we have a callback, then do as it says. If no, then the default is
@@ -46,7 +46,10 @@ struct uevent {
 
 typedef std::function<coldboot_action_t(struct uevent* uevent)> coldboot_callback;
 extern coldboot_action_t handle_device_fd(coldboot_callback fn = nullptr);
-extern void device_init(const char* path = nullptr, coldboot_callback fn = nullptr);
+// With no path or callback, coldboot handles the uevents it regenerates with
+// num_workers processes in parallel.
+extern void device_init(const char* path = nullptr, coldboot_callback fn = nullptr,
+                        unsigned int num_workers = 1);
 extern void device_close();
 
 extern int add_dev_perms(const char *name, const char *attr,
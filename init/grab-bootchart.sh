@@ -13,9 +13,10 @@ TARBALL=bootchart.tgz
 
 FILES="header proc_stat.log proc_ps.log proc_diskstats.log"
 
-for f in $FILES; do
+for f in header bootchart.bin; do
     adb "${@}" pull $LOGROOT/$f $TMPDIR/$f 2>&1 > /dev/null
 done
+$(dirname $0)/decode-bootchart.py $TMPDIR/bootchart.bin $TMPDIR
 (cd $TMPDIR && tar -czf $TARBALL $FILES)
 bootchart ${TMPDIR}/${TARBALL}
 gnome-open ${TARBALL%.tgz}.png
@@ -52,11 +52,14 @@
 #include <private/android_filesystem_config.h>
 
 #include <fstream>
+#include <functional>
+#include <map>
 #include <memory>
 #include <set>
 #include <vector>
 
 #include "action.h"
+#include "boot_trace.h"
 #include "bootchart.h"
 #include "devices.h"
 #include "fs_mgr.h"
@@ -89,18 +92,28 @@ const char *ENV[32];
 static std::unique_ptr<Timer> waiting_for_exec(nullptr);
 
 static int epoll_fd = -1;
+static std::map<int, std::function<void()>> epoll_handlers;
 
 static std::unique_ptr<Timer> waiting_for_prop(nullptr);
 static std::string wait_prop_name;
 static std::string wait_prop_value;
 
-void register_epoll_handler(int fd, void (*fn)()) {
+void register_epoll_handler(int fd, std::function<void()> handler) {
     epoll_event ev;
     ev.events = EPOLLIN;
-    ev.data.ptr = reinterpret_cast<void*>(fn);
+    ev.data.fd = fd;
     if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
         PLOG(ERROR) << "epoll_ctl failed";
+        return;
+    }
+    epoll_handlers[fd] = std::move(handler);
+}
+
+void unregister_epoll_handler(int fd) {
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+        PLOG(ERROR) << "epoll_ctl failed";
     }
+    epoll_handlers.erase(fd);
 }
 
 /* add_environment - add "key=value" to the current environment */
@@ -148,6 +161,7 @@ void stop_waiting_for_exec()
 {
     if (waiting_for_exec) {
         LOG(INFO) << "Wait for exec took " << *waiting_for_exec;
+        BootTrace::GetInstance().AddEvent(BootTrace::kWait, "exec", waiting_for_exec->start());
         waiting_for_exec.reset();
     }
 }
@@ -173,11 +187,17 @@ void property_changed(const char *name, const char *value)
 {
     if (property_triggers_enabled)
         ActionManager::GetInstance().QueuePropertyTrigger(name, value);
+    if (!strcmp(name, "sys.boot_completed") && !strcmp(value, "1")) {
+        ActionManager::GetInstance().LogTriggerStats();
+    }
     if (waiting_for_prop) {
         if (wait_prop_name == name && wait_prop_value == value) {
+            LOG(INFO) << "Wait for property took " << *waiting_for_prop;
+            BootTrace::GetInstance().AddEvent(BootTrace::kWait,
+                                              "property " + wait_prop_name + "=" + wait_prop_value,
+                                              waiting_for_prop->start());
             wait_prop_name.clear();
             wait_prop_value.clear();
-            LOG(INFO) << "Wait for property took " << *waiting_for_prop;
             waiting_for_prop.reset();
         }
     }
@@ -192,6 +212,11 @@ static void restart_processes()
 }
 
 void handle_control_message(const std::string& msg, const std::string& name) {
+    if (msg == "boot_trace") {
+        BootTrace::GetInstance().HandleControlMessage(name);
+        return;
+    }
+
     Service* svc = ServiceManager::GetInstance().FindServiceByName(name);
     if (svc == nullptr) {
         LOG(ERROR) << "no such service '" << name << "'";
@@ -228,6 +253,7 @@ static int wait_for_coldboot_done_action(const std::vector<std::string>& args) {
     }
 
     property_set("ro.boottime.init.cold_boot_wait", std::to_string(t.duration_ms()).c_str());
+    BootTrace::GetInstance().AddEvent(BootTrace::kWait, "coldboot", t.start());
     return 0;
 }
 
@@ -1344,7 +1370,12 @@ int main(int argc, char** argv) {
         if (nr == -1) {
             PLOG(ERROR) << "epoll_wait failed";
         } else if (nr == 1) {
-            ((void (*)()) ev.data.ptr)();
+            auto handler = epoll_handlers.find(ev.data.fd);
+            if (handler != epoll_handlers.end()) {
+                // Called on a copy, since the handler may unregister itself.
+                std::function<void()> fn = handler->second;
+                fn();
+            }
         }
     }
 
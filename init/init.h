@@ -17,6 +17,7 @@
 #ifndef _INIT_INIT_H
 #define _INIT_INIT_H
 
+#include <functional>
 #include <string>
 
 class Action;
@@ -31,7 +32,8 @@ void handle_control_message(const std::string& msg, const std::string& arg);
 
 void property_changed(const char *name, const char *value);
 
-void register_epoll_handler(int fd, void (*fn)());
+void register_epoll_handler(int fd, std::function<void()> handler);
+void unregister_epoll_handler(int fd);
 
 int add_environment(const char* key, const char* val);
 
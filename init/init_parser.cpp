@@ -22,6 +22,7 @@
 #include "init_parser.h"
 #include "log.h"
 #include "parser.h"
+#include "rc_cache.h"
 #include "service.h"
 #include "util.h"
 
@@ -40,73 +41,58 @@ void Parser::AddSectionParser(const std::string& name,
     section_parsers_[name] = std::move(parser);
 }
 
-void Parser::ParseData(const std::string& filename, const std::string& data) {
-    //TODO: Use a parser with const input and remove this copy
-    std::vector<char> data_copy(data.begin(), data.end());
-    data_copy.push_back('\0');
-
+void Parser::ParseLines(const std::string& filename, const std::vector<RcLine>& lines) {
     parse_state state;
     state.filename = filename.c_str();
-    state.line = 0;
-    state.ptr = &data_copy[0];
-    state.nexttoken = 0;
 
     SectionParser* section_parser = nullptr;
-    std::vector<std::string> args;
-
-    for (;;) {
-        switch (next_token(&state)) {
-        case T_EOF:
+    for (const auto& line : lines) {
+        const std::vector<std::string>& args = line.args;
+        state.line = line.line;
+        if (section_parsers_.count(args[0])) {
             if (section_parser) {
                 section_parser->EndSection();
             }
-            return;
-        case T_NEWLINE:
-            state.line++;
-            if (args.empty()) {
-                break;
+            section_parser = section_parsers_[args[0]].get();
+            std::string ret_err;
+            if (!section_parser->ParseSection(args, &ret_err)) {
+                parse_error(&state, "%s\n", ret_err.c_str());
+                section_parser = nullptr;
             }
-            if (section_parsers_.count(args[0])) {
-                if (section_parser) {
-                    section_parser->EndSection();
-                }
-                section_parser = section_parsers_[args[0]].get();
-                std::string ret_err;
-                if (!section_parser->ParseSection(args, &ret_err)) {
-                    parse_error(&state, "%s\n", ret_err.c_str());
-                    section_parser = nullptr;
-                }
-            } else if (section_parser) {
-                std::string ret_err;
-                if (!section_parser->ParseLineSection(args, state.filename,
-                                                      state.line, &ret_err)) {
-                    parse_error(&state, "%s\n", ret_err.c_str());
-                }
+        } else if (section_parser) {
+            std::string ret_err;
+            if (!section_parser->ParseLineSection(args, state.filename,
+                                                  state.line, &ret_err)) {
+                parse_error(&state, "%s\n", ret_err.c_str());
             }
-            args.clear();
-            break;
-        case T_TEXT:
-            args.emplace_back(state.text);
-            break;
         }
     }
+    if (section_parser) {
+        section_parser->EndSection();
+    }
 }
 
-bool Parser::ParseConfigFile(const std::string& path) {
+bool Parser::ParseConfigFile(const std::string& path, const RcCache* cache) {
     LOG(INFO) << "Parsing file " << path << "...";
     Timer t;
-    std::string data;
-    if (!read_file(path.c_str(), &data)) {
-        return false;
+    std::vector<RcLine> lines;
+    bool cached = cache && cache->Find(path, &lines);
+    if (!cached) {
+        std::string data;
+        if (!read_file(path.c_str(), &data)) {
+            return false;
+        }
+
+        data.push_back('\n'); // TODO: fix parse_config.
+        TokenizeRcData(data, &lines);
     }
 
-    data.push_back('\n'); // TODO: fix parse_config.
-    ParseData(path, data);
+    ParseLines(path, lines);
     for (const auto& sp : section_parsers_) {
         sp.second->EndFile(path);
     }
 
-    LOG(VERBOSE) << "(Parsing " << path << " took " << t << ".)";
+    LOG(VERBOSE) << "(Parsing " << path << (cached ? " from cache" : "") << " took " << t << ".)";
     return true;
 }
 
@@ -129,8 +115,9 @@ bool Parser::ParseConfigDir(const std::string& path) {
     }
     // Sort first so we load files in a consistent order (bug 31996208)
     std::sort(files.begin(), files.end());
+    std::unique_ptr<RcCache> cache = RcCache::Open(path + ".cache");
     for (const auto& file : files) {
-        if (!ParseConfigFile(file)) {
+        if (!ParseConfigFile(file, cache.get())) {
             LOG(ERROR) << "could not import file '" << file << "'";
         }
     }
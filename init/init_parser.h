@@ -18,9 +18,12 @@
 #define _INIT_INIT_PARSER_H_
 
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "rc_cache.h"
+
 class SectionParser {
 public:
     virtual ~SectionParser() {
@@ -57,8 +60,8 @@ public:
 private:
     Parser();
 
-    void ParseData(const std::string& filename, const std::string& data);
-    bool ParseConfigFile(const std::string& path);
+    void ParseLines(const std::string& filename, const std::vector<RcLine>& lines);
+    bool ParseConfigFile(const std::string& path, const RcCache* cache = nullptr);
     bool ParseConfigDir(const std::string& path);
 
     std::map<std::string, std::unique_ptr<SectionParser>> section_parsers_;
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "path_matcher.h"
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include <algorithm>
+
+PathMatcher::PathMatcher() : trie_(1), count_(0) {
+}
+
+int PathMatcher::FindChild(int node, char c) const {
+    for (const auto& [child_char, child] : trie_[node].children) {
+        if (child_char == c) {
+            return child;
+        }
+    }
+    return -1;
+}
+
+bool PathMatcher::WildcardMatches(const Wildcard& wildcard, const char* path) {
+    return strncmp(path, wildcard.pattern.c_str(), wildcard.literal_length) == 0 &&
+           fnmatch(wildcard.pattern.c_str(), path, FNM_PATHNAME) == 0;
+}
+
+int PathMatcher::Add(const std::string& pattern, bool prefix, bool wildcard) {
+    int rule = count_++;
+    if (prefix) {
+        int node = 0;
+        for (char c : pattern) {
+            int child = FindChild(node, c);
+            if (child == -1) {
+                child = trie_.size();
+                trie_[node].children.emplace_back(c, child);
+                trie_.emplace_back();
+            }
+            node = child;
+        }
+        trie_[node].rules.emplace_back(rule);
+    } else if (wildcard) {
+        wildcards_.push_back({pattern, pattern.find_first_of("*?[\\"), rule});
+    } else {
+        exact_[pattern].emplace_back(rule);
+    }
+    return rule;
+}
+
+int PathMatcher::FindLast(const char* path) const {
+    int last = -1;
+
+    auto exact = exact_.find(path);
+    if (exact != exact_.end()) {
+        last = exact->second.back();
+    }
+
+    int node = 0;
+    for (const char* p = path; node != -1; node = FindChild(node, *p++)) {
+        if (!trie_[node].rules.empty()) {
+            last = std::max(last, trie_[node].rules.back());
+        }
+        if (*p == '\0') break;
+    }
+
+    for (auto it = wildcards_.rbegin(); it != wildcards_.rend() && it->rule > last; ++it) {
+        if (WildcardMatches(*it, path)) {
+            last = it->rule;
+            break;
+        }
+    }
+    return last;
+}
+
+void PathMatcher::FindAll(const char* path, std::vector<int>* matches) const {
+    auto exact = exact_.find(path);
+    if (exact != exact_.end()) {
+        matches->insert(matches->end(), exact->second.begin(), exact->second.end());
+    }
+
+    int node = 0;
+    for (const char* p = path; node != -1; node = FindChild(node, *p++)) {
+        const auto& rules = trie_[node].rules;
+        matches->insert(matches->end(), rules.begin(), rules.end());
+        if (*p == '\0') break;
+    }
+
+    for (const auto& wildcard : wildcards_) {
+        if (WildcardMatches(wildcard, path)) {
+            matches->emplace_back(wildcard.rule);
+        }
+    }
+}
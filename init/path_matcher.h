@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_PATH_MATCHER_H
+#define _INIT_PATH_MATCHER_H
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Matches paths against the ueventd.rc permission rules. A rule is an exact
+// path, a prefix (a pattern whose only '*' is the last character, which is
+// dropped before it gets here), or an fnmatch(3) wildcard.
+//
+// Rules are numbered in the order they are added. Exact rules go in a hash
+// table and prefix rules in a trie, so only the wildcard rules are matched one
+// by one; most ueventd.rc rules are exact or prefixes.
+class PathMatcher {
+public:
+    PathMatcher();
+
+    // Returns the number given to the new rule.
+    int Add(const std::string& pattern, bool prefix, bool wildcard);
+
+    // Returns the highest numbered rule matching path, or -1.
+    int FindLast(const char* path) const;
+
+    // Appends every rule matching path to matches, in no particular order.
+    void FindAll(const char* path, std::vector<int>* matches) const;
+
+    int size() const { return count_; }
+
+private:
+    struct TrieNode {
+        std::vector<std::pair<char, int>> children;
+        // Prefix rules ending at this node, in increasing order.
+        std::vector<int> rules;
+    };
+
+    struct Wildcard {
+        std::string pattern;
+        // The length of the pattern up to its first special character, which
+        // paths can be compared against before calling fnmatch(3).
+        size_t literal_length;
+        int rule;
+    };
+
+    int FindChild(int node, char c) const;
+    static bool WildcardMatches(const Wildcard& wildcard, const char* path);
+
+    std::unordered_map<std::string, std::vector<int>> exact_;
+    std::vector<TrieNode> trie_;
+    std::vector<Wildcard> wildcards_;
+    int count_;
+};
+
+#endif
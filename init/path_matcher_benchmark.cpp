@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "path_matcher.h"
+
+// The /dev rules of rootdir/ueventd.rc followed by a device's
+// ueventd.$hardware.rc, as set_device_permission() hands them over: a
+// trailing '*' has been stripped from prefix rules.
+struct Rule {
+    const char* name;
+    bool prefix;
+    bool wildcard;
+};
+
+static const Rule kRules[] = {
+    {"/dev/null", false, false},          {"/dev/zero", false, false},
+    {"/dev/full", false, false},          {"/dev/ptmx", false, false},
+    {"/dev/tty", false, false},           {"/dev/random", false, false},
+    {"/dev/urandom", false, false},       {"/dev/hw_random", false, false},
+    {"/dev/ashmem", false, false},        {"/dev/binder", false, false},
+    {"/dev/hwbinder", false, false},      {"/dev/log/", true, false},
+    {"/dev/pmsg0", false, false},         {"/dev/msm_hw3dc", false, false},
+    {"/dev/kgsl", false, false},          {"/dev/dri/", true, false},
+    {"/dev/diag", false, false},          {"/dev/diag_arm9", false, false},
+    {"/dev/ttyMSM0", false, false},       {"/dev/uhid", false, false},
+    {"/dev/uinput", false, false},        {"/dev/alarm", false, false},
+    {"/dev/rtc0", false, false},          {"/dev/tty0", false, false},
+    {"/dev/graphics/", true, false},      {"/dev/msm_hw3dm", false, false},
+    {"/dev/input/", true, false},         {"/dev/eac", false, false},
+    {"/dev/cam", false, false},           {"/dev/pmem", false, false},
+    {"/dev/pmem_adsp", true, false},      {"/dev/pmem_camera", true, false},
+    {"/dev/oncrpc/", true, false},        {"/dev/adsp/", true, false},
+    {"/dev/snd/", true, false},           {"/dev/mt9t013", false, false},
+    {"/dev/msm_camera/", true, false},    {"/dev/akm8976_daemon", false, false},
+    {"/dev/akm8976_aot", false, false},   {"/dev/akm8973_daemon", false, false},
+    {"/dev/akm8973_aot", false, false},   {"/dev/bma150", false, false},
+    {"/dev/cm3602", false, false},        {"/dev/akm8976_pffd", false, false},
+    {"/dev/lightsensor", false, false},   {"/dev/msm_pcm_out", true, false},
+    {"/dev/msm_pcm_in", true, false},     {"/dev/msm_pcm_ctl", true, false},
+    {"/dev/msm_snd", true, false},        {"/dev/msm_mp3", true, false},
+    {"/dev/audience_a1026", true, false}, {"/dev/tpa2018d1", true, false},
+    {"/dev/msm_audpre", false, false},    {"/dev/msm_audio_ctl", false, false},
+    {"/dev/htc-acoustic", false, false},  {"/dev/vdec", false, false},
+    {"/dev/q6venc", false, false},        {"/dev/snd/dsp", false, false},
+    {"/dev/snd/dsp1", false, false},      {"/dev/snd/mixer", false, false},
+    {"/dev/smd0", false, false},          {"/dev/qmi", false, false},
+    {"/dev/qmi0", false, false},          {"/dev/qmi1", false, false},
+    {"/dev/qmi2", false, false},          {"/dev/bus/usb/", true, false},
+    {"/dev/mtp_usb", false, false},       {"/dev/usb_accessory", false, false},
+    {"/dev/tun", false, false},           {"/dev/ts0710mux", true, false},
+    {"/dev/ppp", false, false},           {"/dev/dvb", true, false},
+    // ueventd.$hardware.rc
+    {"/dev/kgsl-3d0", false, false},      {"/dev/ion", false, false},
+    {"/dev/video", true, false},          {"/dev/media", true, false},
+    {"/dev/v4l-subdev", true, false},     {"/dev/sensors", false, false},
+    {"/dev/qseecom", false, false},       {"/dev/smd", true, false},
+    {"/dev/smdcntl", true, false},        {"/dev/ipa", false, false},
+    {"/dev/wwan_ioctl", false, false},    {"/dev/rmnet_ctrl", false, false},
+    {"/dev/block/platform/soc/*/by-name/frp", false, true},
+    {"/dev/block/platform/soc/*/by-name/misc", false, true},
+    {"/dev/block/platform/soc/*/by-name/modemst*", false, true},
+    {"/dev/graphics/fb0", false, false},  {"/dev/hw_random", false, false},
+};
+
+// What ueventd saw during coldboot on a phone: the node it created and, for
+// block devices, the links it made to it.
+struct Uevent {
+    const char* path;
+    std::vector<const char*> links;
+};
+
+static const std::vector<Uevent> kUevents = {
+    {"/dev/null", {}},
+    {"/dev/zero", {}},
+    {"/dev/full", {}},
+    {"/dev/random", {}},
+    {"/dev/urandom", {}},
+    {"/dev/kmsg", {}},
+    {"/dev/tty", {}},
+    {"/dev/tty0", {}},
+    {"/dev/tty1", {}},
+    {"/dev/tty2", {}},
+    {"/dev/tty3", {}},
+    {"/dev/ptmx", {}},
+    {"/dev/ttyMSM0", {}},
+    {"/dev/ttyHS0", {}},
+    {"/dev/binder", {}},
+    {"/dev/hwbinder", {}},
+    {"/dev/ashmem", {}},
+    {"/dev/ion", {}},
+    {"/dev/kgsl-3d0", {}},
+    {"/dev/graphics/fb0", {}},
+    {"/dev/graphics/fb1", {}},
+    {"/dev/dri/card0", {}},
+    {"/dev/dri/renderD128", {}},
+    {"/dev/input/event0", {}},
+    {"/dev/input/event1", {}},
+    {"/dev/input/event2", {}},
+    {"/dev/input/event3", {}},
+    {"/dev/input/event4", {}},
+    {"/dev/input/mice", {}},
+    {"/dev/snd/controlC0", {}},
+    {"/dev/snd/pcmC0D0p", {}},
+    {"/dev/snd/pcmC0D1c", {}},
+    {"/dev/snd/pcmC0D2p", {}},
+    {"/dev/snd/timer", {}},
+    {"/dev/video0", {}},
+    {"/dev/video1", {}},
+    {"/dev/video32", {}},
+    {"/dev/media0", {}},
+    {"/dev/v4l-subdev0", {}},
+    {"/dev/v4l-subdev1", {}},
+    {"/dev/v4l-subdev2", {}},
+    {"/dev/smd7", {}},
+    {"/dev/smdcntl0", {}},
+    {"/dev/smdcntl8", {}},
+    {"/dev/ipa", {}},
+    {"/dev/rmnet_ctrl", {}},
+    {"/dev/qseecom", {}},
+    {"/dev/rtc0", {}},
+    {"/dev/uinput", {}},
+    {"/dev/uhid", {}},
+    {"/dev/hw_random", {}},
+    {"/dev/tun", {}},
+    {"/dev/ppp", {}},
+    {"/dev/cpu_dma_latency", {}},
+    {"/dev/network_latency", {}},
+    {"/dev/memory_bandwidth", {}},
+    {"/dev/loop-control", {}},
+    {"/dev/fuse", {}},
+    {"/dev/mtp_usb", {}},
+    {"/dev/usb_accessory", {}},
+    {"/dev/bus/usb/001/001", {}},
+    {"/dev/bus/usb/002/001", {}},
+    {"/dev/pmsg0", {}},
+    {"/dev/block/mmcblk0",
+     {"/dev/block/platform/soc/7824900.sdhci/mmcblk0",
+      "/dev/block/bootdevice/mmcblk0"}},
+    {"/dev/block/mmcblk0p1",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/modem",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p1",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p1"}},
+    {"/dev/block/mmcblk0p2",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/sbl1",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p2",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p2"}},
+    {"/dev/block/mmcblk0p9",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/modemst1",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p9",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p9"}},
+    {"/dev/block/mmcblk0p10",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/modemst2",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p10",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p10"}},
+    {"/dev/block/mmcblk0p16",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/misc",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p16",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p16"}},
+    {"/dev/block/mmcblk0p21",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/boot",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p21",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p21"}},
+    {"/dev/block/mmcblk0p22",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/system",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p22",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p22"}},
+    {"/dev/block/mmcblk0p25",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/frp",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p25",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p25"}},
+    {"/dev/block/mmcblk0p30",
+     {"/dev/block/platform/soc/7824900.sdhci/by-name/userdata",
+      "/dev/block/platform/soc/7824900.sdhci/by-num/p30",
+      "/dev/block/platform/soc/7824900.sdhci/mmcblk0p30"}},
+    {"/dev/block/loop0", {}},
+    {"/dev/block/loop1", {}},
+    {"/dev/block/ram0", {}},
+    {"/dev/block/zram0", {}},
+};
+
+// The matching ueventd did before PathMatcher: every rule, last to first.
+static bool LinearMatches(const char* path, const Rule& rule) {
+    if (rule.prefix) return strncmp(path, rule.name, strlen(rule.name)) == 0;
+    if (rule.wildcard) return fnmatch(rule.name, path, FNM_PATHNAME) == 0;
+    return strcmp(path, rule.name) == 0;
+}
+
+static int LinearFindLast(const Uevent& uevent) {
+    for (int i = sizeof(kRules) / sizeof(kRules[0]) - 1; i >= 0; i--) {
+        if (LinearMatches(uevent.path, kRules[i])) return i;
+        for (const char* link : uevent.links) {
+            if (LinearMatches(link, kRules[i])) return i;
+        }
+    }
+    return -1;
+}
+
+static void BM_linear_device_perms(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        for (const auto& uevent : kUevents) {
+            benchmark::DoNotOptimize(LinearFindLast(uevent));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kUevents.size());
+}
+BENCHMARK(BM_linear_device_perms);
+
+static void BM_path_matcher_device_perms(benchmark::State& state) {
+    PathMatcher matcher;
+    for (const auto& rule : kRules) {
+        matcher.Add(rule.name, rule.prefix, rule.wildcard);
+    }
+    for (const auto& uevent : kUevents) {
+        int rule = matcher.FindLast(uevent.path);
+        for (const char* link : uevent.links) {
+            rule = std::max(rule, matcher.FindLast(link));
+        }
+        if (rule != LinearFindLast(uevent)) {
+            state.SkipWithError(uevent.path);
+            return;
+        }
+    }
+
+    while (state.KeepRunning()) {
+        for (const auto& uevent : kUevents) {
+            int rule = matcher.FindLast(uevent.path);
+            for (const char* link : uevent.links) {
+                rule = std::max(rule, matcher.FindLast(link));
+            }
+            benchmark::DoNotOptimize(rule);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kUevents.size());
+}
+BENCHMARK(BM_path_matcher_device_perms);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "path_matcher.h"
+
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+static std::vector<int> FindAll(const PathMatcher& matcher, const char* path) {
+  std::vector<int> matches;
+  matcher.FindAll(path, &matches);
+  std::sort(matches.begin(), matches.end());
+  return matches;
+}
+
+TEST(path_matcher, empty) {
+  PathMatcher matcher;
+  EXPECT_EQ(-1, matcher.FindLast("/dev/null"));
+  EXPECT_TRUE(FindAll(matcher, "/dev/null").empty());
+}
+
+TEST(path_matcher, exact) {
+  PathMatcher matcher;
+  EXPECT_EQ(0, matcher.Add("/dev/null", false, false));
+  EXPECT_EQ(1, matcher.Add("/dev/tty", false, false));
+
+  EXPECT_EQ(0, matcher.FindLast("/dev/null"));
+  EXPECT_EQ(1, matcher.FindLast("/dev/tty"));
+  EXPECT_EQ(-1, matcher.FindLast("/dev/tty0"));
+  EXPECT_EQ(-1, matcher.FindLast("/dev/nul"));
+}
+
+TEST(path_matcher, prefix) {
+  PathMatcher matcher;
+  matcher.Add("/dev/input/", true, false);
+  matcher.Add("/dev/pmem_adsp", true, false);
+  matcher.Add("/dev/pmem", false, false);
+
+  EXPECT_EQ(0, matcher.FindLast("/dev/input/event0"));
+  EXPECT_EQ(0, matcher.FindLast("/dev/input/"));
+  EXPECT_EQ(-1, matcher.FindLast("/dev/input"));
+  EXPECT_EQ(1, matcher.FindLast("/dev/pmem_adsp2"));
+  EXPECT_EQ(2, matcher.FindLast("/dev/pmem"));
+  EXPECT_EQ(-1, matcher.FindLast("/dev/pmem_"));
+}
+
+TEST(path_matcher, wildcard) {
+  PathMatcher matcher;
+  matcher.Add("/dev/block/*/by-name/system", false, true);
+
+  EXPECT_EQ(0, matcher.FindLast("/dev/block/mmc0/by-name/system"));
+  // FNM_PATHNAME: '*' does not match a '/'.
+  EXPECT_EQ(-1, matcher.FindLast("/dev/block/platform/mmc0/by-name/system"));
+}
+
+TEST(path_matcher, last_rule_wins) {
+  PathMatcher matcher;
+  matcher.Add("/dev/", true, false);
+  matcher.Add("/dev/snd/*", false, true);
+  matcher.Add("/dev/snd/", true, false);
+  matcher.Add("/dev/snd/dsp", false, false);
+  matcher.Add("/dev/snd/d*", false, true);
+  matcher.Add("/dev/snd/dsp", false, false);
+
+  EXPECT_EQ(5, matcher.FindLast("/dev/snd/dsp"));
+  EXPECT_EQ(4, matcher.FindLast("/dev/snd/dsp1"));
+  EXPECT_EQ(2, matcher.FindLast("/dev/snd/mixer"));
+  EXPECT_EQ(0, matcher.FindLast("/dev/null"));
+
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4, 5}), FindAll(matcher, "/dev/snd/dsp"));
+  EXPECT_EQ(std::vector<int>({0, 1, 2}), FindAll(matcher, "/dev/snd/mixer"));
+  EXPECT_EQ(std::vector<int>({0}), FindAll(matcher, "/dev/null"));
+}
+
+TEST(path_matcher, empty_prefix_matches_everything) {
+  PathMatcher matcher;
+  matcher.Add("", true, false);
+
+  EXPECT_EQ(0, matcher.FindLast(""));
+  EXPECT_EQ(0, matcher.FindLast("/sys/devices"));
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "persistent_properties.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+
+const char PersistentPropertyStore::kFileName[] = "persistent_properties";
+
+// The log starts with kMagic, followed by records: a RecordHeader, then the
+// name and value, neither of them NUL-terminated.
+static const uint32_t kMagic = 0x31504550;  // "PEP1"
+
+struct RecordHeader {
+    uint16_t name_length;
+    uint16_t value_length;
+    uint32_t checksum;
+};
+
+// Don't bother compacting logs smaller than this.
+static const size_t kMinCompactBytes = 16 * 1024;
+
+static uint32_t Checksum(const char* name, size_t name_length,
+                         const char* value, size_t value_length) {
+    // FNV-1a, with the name and value separated so that moving bytes from one
+    // to the other changes it.
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < name_length; i++) hash = (hash ^ uint8_t(name[i])) * 16777619u;
+    hash = (hash ^ 0xff) * 16777619u;
+    for (size_t i = 0; i < value_length; i++) hash = (hash ^ uint8_t(value[i])) * 16777619u;
+    return hash;
+}
+
+static size_t RecordSize(const std::string& name, const std::string& value) {
+    return sizeof(RecordHeader) + name.size() + value.size();
+}
+
+static void AppendRecord(std::string* data, const std::string& name, const std::string& value) {
+    RecordHeader header;
+    header.name_length = name.size();
+    header.value_length = value.size();
+    header.checksum = Checksum(name.data(), name.size(), value.data(), value.size());
+    data->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    data->append(name);
+    data->append(value);
+}
+
+// Files must not be accessible to others, be owned by root/root, and not be a
+// hard link to any other file.
+static bool IsSecure(int fd, const char* name) {
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        PLOG(ERROR) << "fstat on property file \"" << name << "\" failed";
+        return false;
+    }
+    if (((sb.st_mode & (S_IRWXG | S_IRWXO)) != 0) || sb.st_uid != 0 || sb.st_gid != 0 ||
+        sb.st_nlink != 1) {
+        LOG(ERROR) << "skipping insecure property file " << name
+                   << " (uid=" << sb.st_uid << " gid=" << sb.st_gid
+                   << " nlink=" << sb.st_nlink << " mode=" << std::oct << sb.st_mode << ")";
+        return false;
+    }
+    return true;
+}
+
+PersistentPropertyStore::PersistentPropertyStore(const std::string& dir)
+    : dir_(dir),
+      path_(dir + "/" + kFileName),
+      log_bytes_(0),
+      live_bytes_(0),
+      needs_compaction_(false),
+      writing_(false),
+      stopping_(false) {
+}
+
+PersistentPropertyStore::~PersistentPropertyStore() {
+    if (!writer_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        stopping_ = true;
+        pending_cv_.notify_one();
+    }
+    writer_.join();
+}
+
+bool PersistentPropertyStore::Load(std::map<std::string, std::string>* properties) {
+    properties->clear();
+
+    android::base::unique_fd dir_fd(open(dir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (dir_fd == -1) {
+        PLOG(ERROR) << "Unable to open persistent property directory \"" << dir_ << "\"";
+        needs_compaction_ = true;
+    } else {
+        // Anything still in a per-property file predates the log.
+        LoadLegacyFiles(dir_fd, properties);
+        LoadLog(dir_fd, properties);
+    }
+
+    values_ = *properties;
+    for (const auto& [name, value] : values_) {
+        live_bytes_ += RecordSize(name, value);
+    }
+    if (!legacy_files_.empty() ||
+        (log_bytes_ > kMinCompactBytes && log_bytes_ > 2 * live_bytes_)) {
+        needs_compaction_ = true;
+    }
+
+    // The writer starts by opening, or if need be rewriting, the log.
+    writing_ = true;
+    writer_ = std::thread(&PersistentPropertyStore::WriterMain, this);
+    return dir_fd != -1;
+}
+
+void PersistentPropertyStore::LoadLegacyFiles(int dir_fd,
+                                              std::map<std::string, std::string>* properties) {
+    std::unique_ptr<DIR, int(*)(DIR*)> dir(fdopendir(dup(dir_fd)), closedir);
+    if (!dir) {
+        PLOG(ERROR) << "Unable to read persistent property directory \"" << dir_ << "\"";
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir.get())) != NULL) {
+        if (strncmp("persist.", entry->d_name, strlen("persist."))) {
+            continue;
+        }
+        if (entry->d_type != DT_REG) {
+            continue;
+        }
+
+        android::base::unique_fd fd(
+            openat(dir_fd, entry->d_name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+        if (fd == -1) {
+            PLOG(ERROR) << "Unable to open persistent property file \"" << entry->d_name << "\"";
+            continue;
+        }
+        if (!IsSecure(fd, entry->d_name)) {
+            continue;
+        }
+
+        std::string value;
+        if (!android::base::ReadFdToString(fd, &value)) {
+            PLOG(ERROR) << "Unable to read persistent property file " << entry->d_name;
+            continue;
+        }
+        // Values used to be read with a single read() of up to PROP_VALUE_MAX - 1
+        // bytes, stopping at any NUL.
+        value.resize(strnlen(value.c_str(), PROP_VALUE_MAX - 1));
+        (*properties)[entry->d_name] = value;
+        legacy_files_.emplace_back(entry->d_name);
+    }
+}
+
+void PersistentPropertyStore::LoadLog(int dir_fd, std::map<std::string, std::string>* properties) {
+    android::base::unique_fd fd(openat(dir_fd, kFileName, O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            PLOG(ERROR) << "Unable to open persistent property file \"" << path_ << "\"";
+        }
+        needs_compaction_ = true;
+        return;
+    }
+
+    std::string data;
+    if (!IsSecure(fd, kFileName) || !android::base::ReadFdToString(fd, &data)) {
+        needs_compaction_ = true;
+        return;
+    }
+
+    uint32_t magic = 0;
+    if (data.size() >= sizeof(magic)) memcpy(&magic, data.data(), sizeof(magic));
+    if (magic != kMagic) {
+        LOG(ERROR) << "Ignoring persistent property file \"" << path_ << "\" with bad magic";
+        needs_compaction_ = true;
+        return;
+    }
+
+    // A record cut short by a crash, or otherwise damaged, ends the log: the
+    // next compaction drops it and everything after it.
+    size_t offset = sizeof(magic);
+    while (offset < data.size()) {
+        RecordHeader header;
+        if (data.size() - offset < sizeof(header)) break;
+        memcpy(&header, &data[offset], sizeof(header));
+        size_t size = sizeof(header) + header.name_length + header.value_length;
+        if (data.size() - offset < size) break;
+
+        const char* name = &data[offset + sizeof(header)];
+        const char* value = name + header.name_length;
+        if (header.checksum != Checksum(name, header.name_length, value, header.value_length)) {
+            break;
+        }
+        (*properties)[std::string(name, header.name_length)] =
+                std::string(value, header.value_length);
+        offset += size;
+    }
+    if (offset != data.size()) {
+        LOG(ERROR) << "Ignoring " << data.size() - offset << " damaged bytes at the end of \""
+                   << path_ << "\"";
+        needs_compaction_ = true;
+    }
+    log_bytes_ = offset;
+}
+
+void PersistentPropertyStore::Write(const std::string& name, const std::string& value) {
+    if (name.size() > UINT16_MAX || value.size() > UINT16_MAX) {
+        LOG(ERROR) << "Unable to persist property " << name << ": too long";
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+    pending_[name] = value;
+    pending_cv_.notify_one();
+}
+
+void PersistentPropertyStore::Flush() {
+    std::unique_lock<std::mutex> lock(lock_);
+    flushed_cv_.wait(lock, [this] { return !writer_.joinable() || (pending_.empty() && !writing_); });
+}
+
+void PersistentPropertyStore::WriterMain() {
+    if (needs_compaction_) {
+        Compact();
+    } else {
+        fd_.reset(open(path_.c_str(), O_WRONLY | O_APPEND | O_NOFOLLOW | O_CLOEXEC));
+        if (fd_ == -1) {
+            PLOG(ERROR) << "Unable to open persistent property file \"" << path_ << "\"";
+            needs_compaction_ = true;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+        writing_ = false;
+        flushed_cv_.notify_all();
+        pending_cv_.wait(lock, [this] { return !pending_.empty() || stopping_; });
+        if (pending_.empty()) break;
+
+        // Everything written while this batch is synced goes in the next one.
+        std::map<std::string, std::string> batch;
+        batch.swap(pending_);
+        writing_ = true;
+        lock.unlock();
+        Append(batch);
+        lock.lock();
+    }
+}
+
+void PersistentPropertyStore::Append(const std::map<std::string, std::string>& batch) {
+    std::string data;
+    for (const auto& [name, value] : batch) {
+        auto it = values_.find(name);
+        if (it != values_.end()) {
+            if (it->second == value) continue;
+            live_bytes_ -= RecordSize(name, it->second);
+            it->second = value;
+        } else {
+            values_.emplace(name, value);
+        }
+        live_bytes_ += RecordSize(name, value);
+        AppendRecord(&data, name, value);
+    }
+    if (data.empty()) return;
+
+    if (needs_compaction_) {
+        Compact();
+        return;
+    }
+
+    if (!android::base::WriteStringToFd(data, fd_) || fdatasync(fd_) == -1) {
+        PLOG(ERROR) << "Unable to write persistent properties to \"" << path_ << "\"";
+        // The log may now end in a partial record; start afresh.
+        Compact();
+        return;
+    }
+    log_bytes_ += data.size();
+
+    if (log_bytes_ > kMinCompactBytes && log_bytes_ > 2 * live_bytes_) {
+        Compact();
+    }
+}
+
+void PersistentPropertyStore::Compact() {
+    needs_compaction_ = true;
+
+    std::string data(reinterpret_cast<const char*>(&kMagic), sizeof(kMagic));
+    for (const auto& [name, value] : values_) {
+        AppendRecord(&data, name, value);
+    }
+
+    std::string temp_path = path_ + ".tmp";
+    android::base::unique_fd fd(open(temp_path.c_str(),
+                                     O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600));
+    if (fd == -1) {
+        PLOG(ERROR) << "Unable to write persistent properties to temp file " << temp_path;
+        return;
+    }
+    if (!android::base::WriteStringToFd(data, fd) || fsync(fd) == -1) {
+        PLOG(ERROR) << "Unable to write persistent properties to temp file " << temp_path;
+        unlink(temp_path.c_str());
+        return;
+    }
+    if (rename(temp_path.c_str(), path_.c_str()) == -1) {
+        PLOG(ERROR) << "Unable to rename persistent property file " << temp_path << " to "
+                    << path_;
+        unlink(temp_path.c_str());
+        return;
+    }
+
+    // Make the rename durable before deleting what it replaces.
+    android::base::unique_fd dir_fd(open(dir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (dir_fd != -1) fsync(dir_fd);
+    for (const auto& name : legacy_files_) {
+        unlink((dir_ + "/" + name).c_str());
+    }
+    legacy_files_.clear();
+
+    // The temp file's offset is already at its end, so appends can go there.
+    fd_ = std::move(fd);
+    log_bytes_ = data.size();
+    live_bytes_ = data.size() - sizeof(kMagic);
+    needs_compaction_ = false;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_PERSISTENT_PROPERTIES_H
+#define _INIT_PERSISTENT_PROPERTIES_H
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+// Stores persist.* properties in a single file in a directory, by default
+// /data/property/persistent_properties.
+//
+// The file is a log of name/value records: setting a property appends a
+// record, and the last record for a name wins. Appends and their fsync happen
+// on a writer thread, so that property_set() never waits for the disk; writes
+// made while the previous batch is being synced are coalesced into the next
+// one. Once the log is mostly overwritten records, it is rewritten with just
+// the current values.
+//
+// Older releases kept one file per property in the same directory. Load()
+// reads those too, and they are deleted once their values are in the log.
+class PersistentPropertyStore {
+public:
+    explicit PersistentPropertyStore(const std::string& dir);
+    // Flushes any pending writes.
+    ~PersistentPropertyStore();
+
+    // Reads the stored properties into *properties and starts the writer
+    // thread. Returns false if the directory could not be read; writes will
+    // still be attempted.
+    bool Load(std::map<std::string, std::string>* properties);
+
+    // Queues name=value to be written. Only valid after Load().
+    void Write(const std::string& name, const std::string& value);
+
+    // Waits for every queued write to reach the disk.
+    void Flush();
+
+    // The file the log is kept in, inside the directory.
+    static const char kFileName[];
+
+private:
+    PersistentPropertyStore(const PersistentPropertyStore&) = delete;
+    PersistentPropertyStore& operator=(const PersistentPropertyStore&) = delete;
+
+    void LoadLegacyFiles(int dir_fd, std::map<std::string, std::string>* properties);
+    void LoadLog(int dir_fd, std::map<std::string, std::string>* properties);
+
+    void WriterMain();
+    void Append(const std::map<std::string, std::string>& batch);
+    void Compact();
+
+    const std::string dir_;
+    const std::string path_;
+
+    // Owned by the writer thread once it has started.
+    android::base::unique_fd fd_;
+    std::map<std::string, std::string> values_;
+    size_t log_bytes_;
+    size_t live_bytes_;
+    bool needs_compaction_;
+    std::vector<std::string> legacy_files_;
+
+    std::mutex lock_;
+    std::condition_variable pending_cv_;
+    std::condition_variable flushed_cv_;
+    std::map<std::string, std::string> pending_;
+    bool writing_;
+    bool stopping_;
+    std::thread writer_;
+};
+
+#endif
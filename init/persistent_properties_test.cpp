@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "persistent_properties.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+using android::base::StringPrintf;
+
+typedef std::map<std::string, std::string> PropertyMap;
+
+static PropertyMap Reload(const char* dir) {
+  PersistentPropertyStore store(dir);
+  PropertyMap properties;
+  EXPECT_TRUE(store.Load(&properties));
+  return properties;
+}
+
+static std::string LogPath(const char* dir) {
+  return StringPrintf("%s/%s", dir, PersistentPropertyStore::kFileName);
+}
+
+static off_t FileSize(const std::string& path) {
+  struct stat sb;
+  return stat(path.c_str(), &sb) == 0 ? sb.st_size : -1;
+}
+
+TEST(persistent_properties, empty) {
+  TemporaryDir dir;
+  EXPECT_TRUE(Reload(dir.path).empty());
+}
+
+TEST(persistent_properties, write_and_reload) {
+  TemporaryDir dir;
+  {
+    PersistentPropertyStore store(dir.path);
+    PropertyMap properties;
+    ASSERT_TRUE(store.Load(&properties));
+    store.Write("persist.a", "1");
+    store.Write("persist.b", "two");
+    store.Write("persist.a", "3");
+    store.Flush();
+    store.Write("persist.c", "");
+  }
+
+  EXPECT_EQ(PropertyMap({{"persist.a", "3"}, {"persist.b", "two"}, {"persist.c", ""}}),
+            Reload(dir.path));
+}
+
+TEST(persistent_properties, migrates_legacy_files) {
+  TemporaryDir dir;
+  std::string legacy = StringPrintf("%s/persist.sys.timezone", dir.path);
+  ASSERT_TRUE(android::base::WriteStringToFile("Europe/London", legacy, 0600, 0, 0));
+  std::string insecure = StringPrintf("%s/persist.insecure", dir.path);
+  ASSERT_TRUE(android::base::WriteStringToFile("x", insecure, 0644, 0, 0));
+
+  {
+    PersistentPropertyStore store(dir.path);
+    PropertyMap properties;
+    ASSERT_TRUE(store.Load(&properties));
+    EXPECT_EQ(PropertyMap({{"persist.sys.timezone", "Europe/London"}}), properties);
+    store.Flush();
+  }
+
+  EXPECT_EQ(-1, access(legacy.c_str(), F_OK));
+  EXPECT_EQ(0, access(insecure.c_str(), F_OK));
+  EXPECT_EQ(PropertyMap({{"persist.sys.timezone", "Europe/London"}}), Reload(dir.path));
+}
+
+TEST(persistent_properties, ignores_damaged_tail) {
+  TemporaryDir dir;
+  {
+    PersistentPropertyStore store(dir.path);
+    PropertyMap properties;
+    ASSERT_TRUE(store.Load(&properties));
+    store.Write("persist.a", "1");
+    store.Flush();
+    store.Write("persist.b", "2");
+  }
+
+  // Cut the last record short, as a crash during an append might.
+  std::string path = LogPath(dir.path);
+  ASSERT_EQ(0, truncate(path.c_str(), FileSize(path) - 1));
+  EXPECT_EQ(PropertyMap({{"persist.a", "1"}}), Reload(dir.path));
+
+  // The damage is gone once the log has been rewritten, and appends work again.
+  {
+    PersistentPropertyStore store(dir.path);
+    PropertyMap properties;
+    ASSERT_TRUE(store.Load(&properties));
+    store.Write("persist.c", "3");
+  }
+  EXPECT_EQ(PropertyMap({{"persist.a", "1"}, {"persist.c", "3"}}), Reload(dir.path));
+}
+
+TEST(persistent_properties, compacts_overwritten_records) {
+  TemporaryDir dir;
+  std::string value(80, 'v');
+  PersistentPropertyStore store(dir.path);
+  PropertyMap properties;
+  ASSERT_TRUE(store.Load(&properties));
+  for (int i = 0; i < 1000; i++) {
+    store.Write("persist.counter", std::to_string(i) + value);
+    store.Flush();
+  }
+  store.Write("persist.other", "x");
+  store.Flush();
+
+  EXPECT_LT(FileSize(LogPath(dir.path)), 32 * 1024);
+  EXPECT_EQ(PropertyMap({{"persist.counter", "999" + value}, {"persist.other", "x"}}),
+            Reload(dir.path));
+}
@@ -27,12 +27,16 @@
 #include <errno.h>
 #include <sys/poll.h>
 
+#include <algorithm>
+#include <map>
 #include <memory>
+#include <unordered_set>
 #include <vector>
 
 #include <cutils/misc.h>
 #include <cutils/sockets.h>
 #include <cutils/multiuser.h>
+#include <private/property_batch.h>
 
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
@@ -56,6 +60,7 @@
 
 #include "property_service.h"
 #include "init.h"
+#include "persistent_properties.h"
 #include "util.h"
 #include "log.h"
 
@@ -65,9 +70,19 @@ using android::base::StringPrintf;
 #define RECOVERY_MOUNT_POINT "/recovery"
 
 static int persistent_properties_loaded = 0;
+static std::unique_ptr<PersistentPropertyStore> persistent_properties;
 
 static int property_set_fd = -1;
 
+// The (source context, property) pairs check_mac_perms() has allowed, so
+// that clients setting the same properties over and over only pay for the
+// label lookup and access check once. Denials aren't cached, so that each
+// one is still audited. Emptied whenever the policy or enforcing mode
+// changes, which needs the SELinux status page.
+static bool selinux_status_opened = false;
+static std::unordered_set<std::string> allowed_property_sets;
+static constexpr size_t kMaxAllowedPropertySets = 4096;
+
 void property_init() {
     if (__system_property_area_init()) {
         LOG(ERROR) << "Failed to initialize property area";
@@ -85,6 +100,14 @@ static bool check_mac_perms(const std::string& name, char* sctx, struct ucred* c
       return false;
     }
 
+    if (selinux_status_opened && selinux_status_updated() > 0) {
+      allowed_property_sets.clear();
+    }
+    std::string cache_key = std::string(sctx) + '\0' + name;
+    if (allowed_property_sets.count(cache_key) != 0) {
+      return true;
+    }
+
     char* tctx = nullptr;
     if (selabel_lookup(sehandle_prop, &tctx, name.c_str(), 1) != 0) {
       return false;
@@ -98,6 +121,12 @@ static bool check_mac_perms(const std::string& name, char* sctx, struct ucred* c
     bool has_access = (selinux_check_access(sctx, tctx, "property_service", "set", &audit_data) == 0);
 
     freecon(tctx);
+    if (has_access && selinux_status_opened) {
+      if (allowed_property_sets.size() >= kMaxAllowedPropertySets) {
+        allowed_property_sets.clear();
+      }
+      allowed_property_sets.emplace(std::move(cache_key));
+    }
     return has_access;
 }
 
@@ -124,29 +153,6 @@ std::string property_get(const char* name) {
     return value;
 }
 
-static void write_persistent_property(const char *name, const char *value)
-{
-    char tempPath[PATH_MAX];
-    char path[PATH_MAX];
-    int fd;
-
-    snprintf(tempPath, sizeof(tempPath), "%s/.temp.XXXXXX", PERSISTENT_PROPERTY_DIR);
-    fd = mkstemp(tempPath);
-    if (fd < 0) {
-        PLOG(ERROR) << "Unable to write persistent property to temp file " << tempPath;
-        return;
-    }
-    write(fd, value, strlen(value));
-    fsync(fd);
-    close(fd);
-
-    snprintf(path, sizeof(path), "%s/%s", PERSISTENT_PROPERTY_DIR, name);
-    if (rename(tempPath, path)) {
-        PLOG(ERROR) << "Unable to rename persistent property file " << tempPath << " to " << path;
-        unlink(tempPath);
-    }
-}
-
 bool is_legal_property_name(const std::string& name) {
     size_t namelen = name.size();
 
@@ -214,7 +220,7 @@ uint32_t property_set(const std::string& name, const std::string& value) {
     // Don't write properties to disk until after we have read all default
     // properties to prevent them from being overwritten by default values.
     if (persistent_properties_loaded && android::base::StartsWith(name, "persist.")) {
-        write_persistent_property(name.c_str(), value.c_str());
+        persistent_properties->Write(name, value);
     }
     property_changed(name.c_str(), value.c_str());
     return PROP_SUCCESS;
@@ -226,7 +232,9 @@ class SocketConnection {
       : socket_(socket), cred_(cred) {}
 
   ~SocketConnection() {
-    close(socket_);
+    if (socket_ != -1) {
+      close(socket_);
+    }
   }
 
   bool RecvUint32(uint32_t* value, uint32_t* timeout_ms) {
@@ -273,6 +281,13 @@ class SocketConnection {
     return socket_;
   }
 
+  // Takes the socket away, for it to outlive this connection.
+  int Release() {
+    int socket = socket_;
+    socket_ = -1;
+    return socket;
+  }
+
   const struct ucred& cred() {
     return cred_;
   }
@@ -340,52 +355,210 @@ class SocketConnection {
   DISALLOW_IMPLICIT_CONSTRUCTORS(SocketConnection);
 };
 
+// Sets name=value, or for ctl.* sends a control message, if the sender is
+// allowed to. Returns PROP_SUCCESS or the PROP_ERROR_* to report.
+static uint32_t check_and_set_property(const std::string& name,
+                                       const std::string& value,
+                                       const char* cmd_name,
+                                       struct ucred cr,
+                                       char* source_ctx) {
+  if (!is_legal_property_name(name)) {
+    LOG(ERROR) << "sys_prop(" << cmd_name << "): illegal property name \"" << name << "\"";
+    return PROP_ERROR_INVALID_NAME;
+  }
+
+  if (android::base::StartsWith(name, "ctl.")) {
+    if (check_control_mac_perms(value.c_str(), source_ctx, &cr)) {
+      handle_control_message(name.c_str() + 4, value.c_str());
+      return PROP_SUCCESS;
+    }
+    LOG(ERROR) << "sys_prop(" << cmd_name << "): Unable to " << (name.c_str() + 4)
+               << " service ctl [" << value << "]"
+               << " uid:" << cr.uid
+               << " gid:" << cr.gid
+               << " pid:" << cr.pid;
+    return PROP_ERROR_HANDLE_CONTROL_MESSAGE;
+  }
+
+  if (check_mac_perms(name, source_ctx, &cr)) {
+    return property_set(name, value);
+  }
+  LOG(ERROR) << "sys_prop(" << cmd_name << "): permission denied uid:" << cr.uid << " name:" << name;
+  return PROP_ERROR_PERMISSION_DENIED;
+}
+
 static void handle_property_set(SocketConnection& socket,
                                 const std::string& name,
                                 const std::string& value,
                                 bool legacy_protocol) {
   const char* cmd_name = legacy_protocol ? "PROP_MSG_SETPROP" : "PROP_MSG_SETPROP2";
-  if (!is_legal_property_name(name)) {
-    LOG(ERROR) << "sys_prop(" << cmd_name << "): illegal property name \"" << name << "\"";
-    socket.SendUint32(PROP_ERROR_INVALID_NAME);
-    return;
-  }
-
-  struct ucred cr = socket.cred();
   char* source_ctx = nullptr;
   getpeercon(socket.socket(), &source_ctx);
 
-  if (android::base::StartsWith(name, "ctl.")) {
-    if (check_control_mac_perms(value.c_str(), source_ctx, &cr)) {
-      handle_control_message(name.c_str() + 4, value.c_str());
-      if (!legacy_protocol) {
-        socket.SendUint32(PROP_SUCCESS);
+  uint32_t result = check_and_set_property(name, value, cmd_name, socket.cred(), source_ctx);
+  // The legacy protocol only ever replies to a bad name.
+  if (!legacy_protocol || result == PROP_ERROR_INVALID_NAME) {
+    socket.SendUint32(result);
+  }
+
+  freecon(source_ctx);
+}
+
+// A PROP_MSG_SETPROP_BATCH client. Its connection stays registered with epoll
+// until the client closes it or leaves it idle, and each wakeup handles every
+// request that has arrived in full, sending back all of their results at once.
+class BatchConnection {
+ public:
+  BatchConnection(int socket, const struct ucred& cred)
+      : socket_(socket), cred_(cred), source_ctx_(nullptr), last_active_(boot_clock::now()) {
+    // The peer's context can't change, so look it up once for every request.
+    getpeercon(socket_, &source_ctx_);
+  }
+
+  ~BatchConnection() {
+    freecon(source_ctx_);
+    close(socket_);
+  }
+
+  uid_t uid() const { return cred_.uid; }
+
+  // Whether nothing has arrived for timeout, and nothing is waiting to be read.
+  bool IsIdle(boot_clock::time_point now, boot_clock::duration timeout) const {
+    char c;
+    return now - last_active_ >= timeout &&
+           TEMP_FAILURE_RETRY(recv(socket_, &c, 1, MSG_PEEK | MSG_DONTWAIT)) == -1 &&
+           (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+
+  // Returns false once the connection should be closed.
+  bool HandleRequests() {
+    last_active_ = boot_clock::now();
+    bool closed = false;
+    char buffer[4096];
+    // Stop once there's as much as the client may send before reading its
+    // results; epoll wakes init again for the rest.
+    while (input_.size() < kMaxInput) {
+      size_t size = std::min(sizeof(buffer), kMaxInput - input_.size());
+      ssize_t result = TEMP_FAILURE_RETRY(recv(socket_, buffer, size, MSG_DONTWAIT));
+      if (result > 0) {
+        input_.append(buffer, result);
+        continue;
       }
-    } else {
-      LOG(ERROR) << "sys_prop(" << cmd_name << "): Unable to " << (name.c_str() + 4)
-                 << " service ctl [" << value << "]"
-                 << " uid:" << cr.uid
-                 << " gid:" << cr.gid
-                 << " pid:" << cr.pid;
-      if (!legacy_protocol) {
-        socket.SendUint32(PROP_ERROR_HANDLE_CONTROL_MESSAGE);
+      if (result == 0) {
+        closed = true;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error reading from uid " << cred_.uid;
+        return false;
       }
-    }
-  } else {
-    if (check_mac_perms(name, source_ctx, &cr)) {
-      uint32_t result = property_set(name, value);
-      if (!legacy_protocol) {
-        socket.SendUint32(result);
+      break;
+    }
+
+    std::vector<uint32_t> results;
+    size_t offset = 0;
+    while (true) {
+      std::string name;
+      std::string value;
+      size_t next = offset;
+      int parsed = ParseString(&next, &name);
+      if (parsed > 0) parsed = ParseString(&next, &value);
+      if (parsed < 0) return false;
+      if (parsed == 0) break;
+      offset = next;
+
+      // Clients wait for their results before sending more than this.
+      if (results.size() == PROP_BATCH_MAX_PENDING) {
+        LOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): uid " << cred_.uid
+                   << " sent too many requests without reading the results";
+        return false;
       }
-    } else {
-      LOG(ERROR) << "sys_prop(" << cmd_name << "): permission denied uid:" << cr.uid << " name:" << name;
-      if (!legacy_protocol) {
-        socket.SendUint32(PROP_ERROR_PERMISSION_DENIED);
+      results.push_back(check_and_set_property(name, value, "PROP_MSG_SETPROP_BATCH", cred_,
+                                               source_ctx_));
+    }
+    input_.erase(0, offset);
+
+    if (!results.empty()) {
+      size_t size = results.size() * sizeof(results[0]);
+      ssize_t result = TEMP_FAILURE_RETRY(send(socket_, &results[0], size,
+                                               MSG_DONTWAIT | MSG_NOSIGNAL));
+      if (result != static_cast<ssize_t>(size)) {
+        PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error sending results to uid "
+                    << cred_.uid;
+        return false;
       }
     }
+    return !closed;
   }
 
-  freecon(source_ctx);
+ private:
+  // Returns 1 if a whole string was parsed from input_, 0 if more of it has
+  // yet to arrive, or -1 if it can't be valid.
+  int ParseString(size_t* offset, std::string* value) {
+    uint32_t len;
+    if (input_.size() - *offset < sizeof(len)) {
+      return 0;
+    }
+    memcpy(&len, &input_[*offset], sizeof(len));
+
+    // http://b/35166374: don't allow init to make arbitrarily large allocations.
+    if (len > kMaxStringLength) {
+      LOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): asked to read huge string: " << len;
+      return -1;
+    }
+    if (input_.size() - *offset - sizeof(len) < len) {
+      return 0;
+    }
+
+    value->assign(input_, *offset + sizeof(len), len);
+    *offset += sizeof(len) + len;
+    return 1;
+  }
+
+  static constexpr uint32_t kMaxStringLength = 0xffff;
+  // PROP_BATCH_MAX_PENDING requests of the largest name and value.
+  static constexpr size_t kMaxInput =
+      PROP_BATCH_MAX_PENDING * 2 * (sizeof(uint32_t) + kMaxStringLength);
+
+  int socket_;
+  struct ucred cred_;
+  char* source_ctx_;
+  std::string input_;
+  boot_clock::time_point last_active_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(BatchConnection);
+};
+
+static constexpr size_t kMaxBatchConnections = 64;
+static constexpr size_t kMaxBatchConnectionsPerUid = 4;
+static constexpr auto kBatchConnectionIdleTimeout = 10s;
+static std::map<int, std::unique_ptr<BatchConnection>> batch_connections;
+
+static void handle_batch_connection(int fd) {
+  auto connection = batch_connections.find(fd);
+  if (connection != batch_connections.end() && !connection->second->HandleRequests()) {
+    unregister_epoll_handler(fd);
+    batch_connections.erase(connection);
+  }
+}
+
+// Makes room for another batch connection from uid. Connections that have sat
+// idle for kBatchConnectionIdleTimeout are closed first, so that nobody can
+// keep the slots by holding connections open; libcutils reconnects when the
+// client next flushes. Returns false if uid or everyone together would still
+// be over their limit.
+static bool make_room_for_batch_connection(uid_t uid) {
+  boot_clock::time_point now = boot_clock::now();
+  size_t uid_connections = 0;
+  for (auto it = batch_connections.begin(); it != batch_connections.end();) {
+    if (it->second->IsIdle(now, kBatchConnectionIdleTimeout)) {
+      unregister_epoll_handler(it->first);
+      it = batch_connections.erase(it);
+      continue;
+    }
+    if (it->second->uid() == uid) uid_connections++;
+    ++it;
+  }
+  return uid_connections < kMaxBatchConnectionsPerUid &&
+         batch_connections.size() < kMaxBatchConnections;
 }
 
 static void handle_property_set_fd() {
@@ -446,6 +619,19 @@ static void handle_property_set_fd() {
         break;
       }
 
+    case PROP_MSG_SETPROP_BATCH: {
+        if (!make_room_for_batch_connection(cr.uid)) {
+          LOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): too many connections, refusing uid "
+                     << cr.uid;
+          return;
+        }
+
+        int fd = socket.Release();
+        batch_connections.emplace(fd, std::make_unique<BatchConnection>(fd, cr));
+        register_epoll_handler(fd, [fd]() { handle_batch_connection(fd); });
+        break;
+      }
+
     default:
         LOG(ERROR) << "sys_prop: invalid command " << cmd;
         socket.SendUint32(PROP_ERROR_INVALID_CMD);
@@ -530,57 +716,24 @@ static void load_properties_from_file(const char* filename, const char* filter)
 }
 
 static void load_persistent_properties() {
-    persistent_properties_loaded = 1;
+    Timer t;
+    // Replacing the store flushes any writes still queued for the old one.
+    persistent_properties.reset(new PersistentPropertyStore(PERSISTENT_PROPERTY_DIR));
 
-    std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(PERSISTENT_PROPERTY_DIR), closedir);
-    if (!dir) {
-        PLOG(ERROR) << "Unable to open persistent property directory \""
-                    << PERSISTENT_PROPERTY_DIR << "\"";
-        return;
+    std::map<std::string, std::string> properties;
+    persistent_properties->Load(&properties);
+    for (const auto& [name, value] : properties) {
+        property_set(name, value);
     }
+    // They're already stored, so only write the ones set from now on.
+    persistent_properties_loaded = 1;
+    LOG(VERBOSE) << "(Loading " << properties.size() << " persistent properties took " << t
+                 << ".)";
+}
 
-    struct dirent* entry;
-    while ((entry = readdir(dir.get())) != NULL) {
-        if (strncmp("persist.", entry->d_name, strlen("persist."))) {
-            continue;
-        }
-        if (entry->d_type != DT_REG) {
-            continue;
-        }
-
-        // Open the file and read the property value.
-        int fd = openat(dirfd(dir.get()), entry->d_name, O_RDONLY | O_NOFOLLOW);
-        if (fd == -1) {
-            PLOG(ERROR) << "Unable to open persistent property file \"" << entry->d_name << "\"";
-            continue;
-        }
-
-        struct stat sb;
-        if (fstat(fd, &sb) == -1) {
-            PLOG(ERROR) << "fstat on property file \"" << entry->d_name << "\" failed";
-            close(fd);
-            continue;
-        }
-
-        // File must not be accessible to others, be owned by root/root, and
-        // not be a hard link to any other file.
-        if (((sb.st_mode & (S_IRWXG | S_IRWXO)) != 0) || sb.st_uid != 0 || sb.st_gid != 0 || sb.st_nlink != 1) {
-            PLOG(ERROR) << "skipping insecure property file " << entry->d_name
-                        << " (uid=" << sb.st_uid << " gid=" << sb.st_gid
-                        << " nlink=" << sb.st_nlink << " mode=" << std::oct << sb.st_mode << ")";
-            close(fd);
-            continue;
-        }
-
-        char value[PROP_VALUE_MAX];
-        int length = read(fd, value, sizeof(value) - 1);
-        if (length >= 0) {
-            value[length] = 0;
-            property_set(entry->d_name, value);
-        } else {
-            PLOG(ERROR) << "Unable to read persistent property file " << entry->d_name;
-        }
-        close(fd);
+void flush_persistent_properties() {
+    if (persistent_properties) {
+        persistent_properties->Flush();
     }
 }
 
@@ -662,5 +815,7 @@ void start_property_service() {
 
     listen(property_set_fd, 8);
 
+    selinux_status_opened = (selinux_status_open(true) >= 0);
+
     register_epoll_handler(property_set_fd, handle_property_set_fd);
 }
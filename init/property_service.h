@@ -30,6 +30,7 @@ struct property_audit_data {
 void property_init(void);
 void property_load_boot_defaults(void);
 void load_persist_props(void);
+void flush_persistent_properties(void);
 void load_system_props(void);
 void start_property_service(void);
 std::string property_get(const char* name);
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <cutils/properties.h>
+
+// These set properties through the running init, so need a device and a user
+// allowed to set debug.* properties, such as root.
+
+static const char* kNames[] = {
+    "debug.init.benchmark.0", "debug.init.benchmark.1", "debug.init.benchmark.2",
+    "debug.init.benchmark.3", "debug.init.benchmark.4", "debug.init.benchmark.5",
+    "debug.init.benchmark.6", "debug.init.benchmark.7",
+};
+
+static void BM_property_set(benchmark::State& state) {
+    int i = 0;
+    while (state.KeepRunning()) {
+        if (property_set(kNames[i % 8], std::to_string(i).c_str()) != 0) {
+            state.SkipWithError("property_set failed");
+            return;
+        }
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_property_set);
+
+// Sets state.range(0) properties per flush.
+static void BM_property_batch_set(benchmark::State& state) {
+    property_batch_t* batch = property_batch_open();
+    if (batch == nullptr) {
+        state.SkipWithError("property_batch_open failed");
+        return;
+    }
+
+    int i = 0;
+    while (state.KeepRunning()) {
+        for (int j = 0; j < state.range(0); j++, i++) {
+            property_batch_set(batch, kNames[i % 8], std::to_string(i).c_str());
+        }
+        if (property_batch_flush(batch) != 0) {
+            state.SkipWithError("property_batch_flush failed");
+            break;
+        }
+    }
+    property_batch_close(batch);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_property_batch_set)->Arg(1)->Arg(8)->Arg(64);
@@ -18,9 +18,12 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include <string>
+
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
 
+#include <cutils/properties.h>
 #include <gtest/gtest.h>
 
 TEST(property_service, very_long_name_35166374) {
@@ -46,3 +49,25 @@ TEST(property_service, very_long_name_35166374) {
   ASSERT_EQ(static_cast<ssize_t>(sizeof(data)), send(fd, &data, sizeof(data), 0));
   ASSERT_EQ(0, close(fd));
 }
+
+TEST(property_service, batch) {
+  property_batch_t* batch = property_batch_open();
+  ASSERT_TRUE(batch != nullptr);
+
+  // More than fit in one round trip.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(0, property_batch_set(batch, "debug.init.test.batch", std::to_string(i).c_str()));
+  }
+  ASSERT_EQ(0, property_batch_flush(batch));
+  char value[PROP_VALUE_MAX];
+  ASSERT_GT(__system_property_get("debug.init.test.batch", value), 0);
+  EXPECT_STREQ("99", value);
+
+  // A failure is reported by the flush, and doesn't end the batch.
+  ASSERT_EQ(0, property_batch_set(batch, "debug..bad", "1"));
+  ASSERT_EQ(0, property_batch_set(batch, "debug.init.test.batch", "after"));
+  EXPECT_EQ(-1, property_batch_flush(batch));
+  EXPECT_EQ(0, property_batch_close(batch));
+  ASSERT_GT(__system_property_get("debug.init.test.batch", value), 0);
+  EXPECT_STREQ("after", value);
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rc_cache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+
+#include "parser.h"
+
+// The cache is kMagic and kVersion, each a uint32_t, then for each file:
+//   uint32_t path length, the path;
+//   uint64_t size, int64_t mtime seconds, int64_t mtime nanoseconds;
+//   uint64_t length of the lines, the lines.
+// Each line is a uint32_t line number and a uint32_t token count, then for
+// each token its uint32_t length and the token. Numbers are little-endian,
+// and unaligned.
+static const uint32_t kMagic = 0x31435249;  // "IRC1"
+// Bump this whenever the format or the tokenizer changes.
+static const uint32_t kVersion = 1;
+
+void TokenizeRcData(const std::string& data, std::vector<RcLine>* lines) {
+    //TODO: Use a parser with const input and remove this copy
+    std::vector<char> data_copy(data.begin(), data.end());
+    data_copy.push_back('\0');
+
+    parse_state state;
+    state.filename = nullptr;
+    state.line = 0;
+    state.ptr = &data_copy[0];
+    state.nexttoken = 0;
+
+    std::vector<std::string> args;
+    for (;;) {
+        switch (next_token(&state)) {
+        case T_EOF:
+            return;
+        case T_NEWLINE:
+            state.line++;
+            if (!args.empty()) {
+                lines->push_back({state.line, std::move(args)});
+                args.clear();
+            }
+            break;
+        case T_TEXT:
+            args.emplace_back(state.text);
+            break;
+        }
+    }
+}
+
+namespace {
+
+class Writer {
+public:
+    explicit Writer(std::string* out) : out_(out) {
+    }
+
+    template <typename T>
+    void Append(T value) {
+        out_->append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void AppendString(const std::string& s) {
+        Append<uint32_t>(s.size());
+        out_->append(s);
+    }
+
+private:
+    std::string* out_;
+};
+
+class Reader {
+public:
+    Reader(const char* data, size_t size) : p_(data), end_(data + size) {
+    }
+
+    template <typename T>
+    bool Read(T* value) {
+        if (static_cast<size_t>(end_ - p_) < sizeof(*value)) return false;
+        memcpy(value, p_, sizeof(*value));
+        p_ += sizeof(*value);
+        return true;
+    }
+
+    // Points *data at the next size bytes.
+    bool Skip(size_t size, const char** data) {
+        if (static_cast<size_t>(end_ - p_) < size) return false;
+        *data = p_;
+        p_ += size;
+        return true;
+    }
+
+    bool ReadString(std::string* s) {
+        uint32_t size;
+        const char* data;
+        if (!Read(&size) || !Skip(size, &data)) return false;
+        s->assign(data, size);
+        return true;
+    }
+
+    bool done() const { return p_ == end_; }
+
+private:
+    const char* p_;
+    const char* end_;
+};
+
+}  // namespace
+
+std::string RcCache::Compile(const std::vector<Input>& files) {
+    std::string out;
+    Writer writer(&out);
+    writer.Append(kMagic);
+    writer.Append(kVersion);
+    for (const auto& file : files) {
+        std::vector<RcLine> lines;
+        TokenizeRcData(file.data, &lines);
+
+        std::string encoded;
+        Writer line_writer(&encoded);
+        for (const auto& line : lines) {
+            line_writer.Append<uint32_t>(line.line);
+            line_writer.Append<uint32_t>(line.args.size());
+            for (const auto& arg : line.args) {
+                line_writer.AppendString(arg);
+            }
+        }
+
+        writer.AppendString(file.path);
+        writer.Append<uint64_t>(file.size);
+        writer.Append<int64_t>(file.mtime.tv_sec);
+        writer.Append<int64_t>(file.mtime.tv_nsec);
+        writer.Append<uint64_t>(encoded.size());
+        out.append(encoded);
+    }
+    return out;
+}
+
+RcCache::RcCache(void* map, size_t map_size) : map_(map), map_size_(map_size) {
+}
+
+RcCache::~RcCache() {
+    munmap(map_, map_size_);
+}
+
+std::unique_ptr<RcCache> RcCache::Open(const std::string& path) {
+    android::base::unique_fd fd(open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || sb.st_size == 0) {
+        return nullptr;
+    }
+    // Trust the cache no more than read_file() trusts the files it stands for.
+    if (!S_ISREG(sb.st_mode) || (sb.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        LOG(ERROR) << "ignoring insecure .rc cache " << path;
+        return nullptr;
+    }
+    void* map = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        PLOG(ERROR) << "could not map " << path;
+        return nullptr;
+    }
+
+    std::unique_ptr<RcCache> cache(new RcCache(map, sb.st_size));
+    if (!cache->Index()) {
+        LOG(ERROR) << "ignoring invalid .rc cache " << path;
+        return nullptr;
+    }
+    return cache;
+}
+
+bool RcCache::Index() {
+    Reader reader(static_cast<const char*>(map_), map_size_);
+    uint32_t magic, version;
+    if (!reader.Read(&magic) || magic != kMagic || !reader.Read(&version) ||
+        version != kVersion) {
+        return false;
+    }
+
+    while (!reader.done()) {
+        std::string path;
+        Entry entry;
+        int64_t mtime_sec, mtime_nsec;
+        uint64_t lines_size;
+        if (!reader.ReadString(&path) || !reader.Read(&entry.size) || !reader.Read(&mtime_sec) ||
+            !reader.Read(&mtime_nsec) || !reader.Read(&lines_size) ||
+            !reader.Skip(lines_size, &entry.lines)) {
+            return false;
+        }
+        entry.mtime.tv_sec = mtime_sec;
+        entry.mtime.tv_nsec = mtime_nsec;
+        entry.lines_size = lines_size;
+        entries_[path] = entry;
+    }
+    return true;
+}
+
+bool RcCache::Find(const std::string& path, std::vector<RcLine>* lines) const {
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return false;
+    }
+    const Entry& entry = it->second;
+
+    // Leave symlinks and group- or world-writable files to read_file(), which
+    // refuses them.
+    struct stat sb;
+    if (lstat(path.c_str(), &sb) == -1 || !S_ISREG(sb.st_mode) ||
+        (sb.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        return false;
+    }
+    if (static_cast<uint64_t>(sb.st_size) != entry.size ||
+        sb.st_mtim.tv_sec != entry.mtime.tv_sec || sb.st_mtim.tv_nsec != entry.mtime.tv_nsec) {
+        LOG(VERBOSE) << path << " has changed since it was cached";
+        return false;
+    }
+
+    Reader reader(entry.lines, entry.lines_size);
+    std::vector<RcLine> result;
+    while (!reader.done()) {
+        uint32_t line, argc;
+        // Compile() never writes an empty line, and the parser needs args[0].
+        if (!reader.Read(&line) || !reader.Read(&argc) || argc == 0) {
+            return false;
+        }
+        result.push_back({static_cast<int>(line), {}});
+        std::vector<std::string>& args = result.back().args;
+        for (uint32_t i = 0; i < argc; ++i) {
+            args.emplace_back();
+            if (!reader.ReadString(&args.back())) {
+                return false;
+            }
+        }
+    }
+    *lines = std::move(result);
+    return true;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_RC_CACHE_H
+#define _INIT_RC_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A non-empty line of an .rc file, split into its tokens.
+struct RcLine {
+    int line;
+    std::vector<std::string> args;
+};
+
+// Splits data, the contents of an .rc file, into lines of tokens.
+void TokenizeRcData(const std::string& data, std::vector<RcLine>* lines);
+
+// The tokenized contents of a directory of .rc files, compiled ahead of time
+// by init_rc_cache so that init can skip reading and tokenizing the files
+// themselves. A cached file is only used while its size and modification
+// time match what was compiled; anything else is parsed as text.
+//
+// The cache for a directory like /system/etc/init is /system/etc/init.cache.
+class RcCache {
+public:
+    ~RcCache();
+
+    // Maps the cache at path. Returns nullptr if there's no valid cache, or
+    // it's a symlink or group- or world-writable.
+    static std::unique_ptr<RcCache> Open(const std::string& path);
+
+    // Fills lines with the contents of the file at path, if the cache has it,
+    // the file hasn't changed since, and read_file() would accept it.
+    bool Find(const std::string& path, std::vector<RcLine>* lines) const;
+
+    struct Input {
+        // Where the file will be on the device.
+        std::string path;
+        std::string data;
+        uint64_t size;
+        struct timespec mtime;
+    };
+
+    // Compiles files into the contents of a cache.
+    static std::string Compile(const std::vector<Input>& files);
+
+private:
+    struct Entry {
+        uint64_t size;
+        struct timespec mtime;
+        const char* lines;
+        size_t lines_size;
+    };
+
+    RcCache(void* map, size_t map_size);
+    RcCache(const RcCache&) = delete;
+    void operator=(const RcCache&) = delete;
+
+    bool Index();
+
+    void* map_;
+    size_t map_size_;
+    std::map<std::string, Entry> entries_;
+};
+
+#endif
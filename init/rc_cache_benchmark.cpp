@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <benchmark/benchmark.h>
+
+#include "rc_cache.h"
+
+// Compares getting the tokens of the device's own .rc files by reading and
+// tokenizing them, as init does without a cache, with getting them from a
+// cache. Building actions and services from the tokens costs the same
+// either way, so isn't measured.
+static const char kRcDir[] = "/system/etc/init";
+
+static std::vector<std::string> ListRcFiles() {
+    std::vector<std::string> files;
+    std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(kRcDir), closedir);
+    if (!dir) return files;
+    dirent* entry;
+    while ((entry = readdir(dir.get())) != nullptr) {
+        if (entry->d_type == DT_REG) files.push_back(std::string(kRcDir) + "/" + entry->d_name);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static void BM_ParseRcText(benchmark::State& state) {
+    std::vector<std::string> files = ListRcFiles();
+    if (files.empty()) {
+        state.SkipWithError("no .rc files");
+        return;
+    }
+    size_t lines_read = 0;
+    while (state.KeepRunning()) {
+        for (const auto& file : files) {
+            std::string data;
+            android::base::ReadFileToString(file, &data);
+            data.push_back('\n');
+            std::vector<RcLine> lines;
+            TokenizeRcData(data, &lines);
+            lines_read += lines.size();
+        }
+    }
+    state.SetItemsProcessed(lines_read);
+}
+BENCHMARK(BM_ParseRcText);
+
+static void BM_ParseRcCache(benchmark::State& state) {
+    std::vector<std::string> files = ListRcFiles();
+    if (files.empty()) {
+        state.SkipWithError("no .rc files");
+        return;
+    }
+    std::vector<RcCache::Input> inputs;
+    for (const auto& file : files) {
+        RcCache::Input input;
+        input.path = file;
+        struct stat sb;
+        if (!android::base::ReadFileToString(file, &input.data) || stat(file.c_str(), &sb) == -1) {
+            state.SkipWithError("couldn't read .rc files");
+            return;
+        }
+        input.data.push_back('\n');
+        input.size = sb.st_size;
+        input.mtime = sb.st_mtim;
+        inputs.push_back(std::move(input));
+    }
+    TemporaryFile cache_file;
+    android::base::WriteStringToFile(RcCache::Compile(inputs), cache_file.path);
+
+    size_t lines_read = 0;
+    while (state.KeepRunning()) {
+        std::unique_ptr<RcCache> cache = RcCache::Open(cache_file.path);
+        for (const auto& file : files) {
+            std::vector<RcLine> lines;
+            if (!cache || !cache->Find(file, &lines)) {
+                state.SkipWithError("cache miss");
+                return;
+            }
+            lines_read += lines.size();
+        }
+    }
+    state.SetItemsProcessed(lines_read);
+}
+BENCHMARK(BM_ParseRcCache);
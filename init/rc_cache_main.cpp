@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compiles a directory of .rc files into the cache init looks for next to
+// it on the device. See RcCache.
+//
+// Usage: init_rc_cache [--mtime=SECONDS] OUTPUT DEVICE_DIR HOST_DIR
+//
+// HOST_DIR holds the files that will be in DEVICE_DIR on the device. Use
+// --mtime when the image will give every file the same modification time.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+
+#include "rc_cache.h"
+
+static int Usage() {
+    fprintf(stderr, "usage: init_rc_cache [--mtime=SECONDS] OUTPUT DEVICE_DIR HOST_DIR\n");
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char** argv) {
+    bool override_mtime = false;
+    int64_t mtime = 0;
+    int arg = 1;
+    if (arg < argc && strncmp(argv[arg], "--mtime=", 8) == 0) {
+        if (!android::base::ParseInt(argv[arg] + 8, &mtime)) return Usage();
+        override_mtime = true;
+        ++arg;
+    }
+    if (argc - arg != 3) return Usage();
+    const std::string output = argv[arg];
+    const std::string device_dir = argv[arg + 1];
+    const std::string host_dir = argv[arg + 2];
+
+    std::unique_ptr<DIR, int(*)(DIR*)> dir(opendir(host_dir.c_str()), closedir);
+    if (!dir) {
+        perror(host_dir.c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<RcCache::Input> files;
+    dirent* entry;
+    while ((entry = readdir(dir.get())) != nullptr) {
+        std::string host_path = host_dir + "/" + entry->d_name;
+        struct stat sb;
+        if (stat(host_path.c_str(), &sb) == -1) {
+            perror(host_path.c_str());
+            return EXIT_FAILURE;
+        }
+        if (!S_ISREG(sb.st_mode)) continue;
+
+        RcCache::Input file;
+        file.path = device_dir + "/" + entry->d_name;
+        if (!android::base::ReadFileToString(host_path, &file.data)) {
+            perror(host_path.c_str());
+            return EXIT_FAILURE;
+        }
+        // init appends a newline before parsing, so the cache must too.
+        file.data.push_back('\n');
+        file.size = sb.st_size;
+        file.mtime = sb.st_mtim;
+        if (override_mtime) {
+            file.mtime.tv_sec = mtime;
+            file.mtime.tv_nsec = 0;
+        }
+        files.push_back(std::move(file));
+    }
+
+    if (!android::base::WriteStringToFile(RcCache::Compile(files), output)) {
+        perror(output.c_str());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
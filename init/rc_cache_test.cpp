@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rc_cache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+static const char kRc[] =
+    "# A comment.\n"
+    "on boot\n"
+    "    setprop a \"quoted value\"\n"
+    "\n"
+    "service foo /system/bin/foo \\\n"
+    "        --flag\n"
+    "    class main\n";
+
+static void ExpectSameLines(const std::vector<RcLine>& expected,
+                            const std::vector<RcLine>& actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i].line, actual[i].line);
+    EXPECT_EQ(expected[i].args, actual[i].args);
+  }
+}
+
+static RcCache::Input MakeInput(const std::string& path) {
+  RcCache::Input input;
+  input.path = path;
+  EXPECT_TRUE(android::base::ReadFileToString(path, &input.data));
+  input.data.push_back('\n');
+  struct stat sb;
+  EXPECT_EQ(0, stat(path.c_str(), &sb));
+  input.size = sb.st_size;
+  input.mtime = sb.st_mtim;
+  return input;
+}
+
+TEST(rc_cache, tokenize) {
+  std::vector<RcLine> lines;
+  TokenizeRcData(kRc, &lines);
+  ExpectSameLines({{2, {"on", "boot"}},
+                   {3, {"setprop", "a", "quoted value"}},
+                   {6, {"service", "foo", "/system/bin/foo", "--flag"}},
+                   {7, {"class", "main"}}},
+                  lines);
+}
+
+TEST(rc_cache, round_trip) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/foo.rc";
+  ASSERT_TRUE(android::base::WriteStringToFile(kRc, path));
+  std::string cache_path = std::string(dir.path) + ".cache";
+  ASSERT_TRUE(android::base::WriteStringToFile(RcCache::Compile({MakeInput(path)}), cache_path));
+
+  std::unique_ptr<RcCache> cache = RcCache::Open(cache_path);
+  ASSERT_NE(nullptr, cache);
+  std::vector<RcLine> expected;
+  TokenizeRcData(std::string(kRc) + "\n", &expected);
+  std::vector<RcLine> lines;
+  ASSERT_TRUE(cache->Find(path, &lines));
+  ExpectSameLines(expected, lines);
+
+  EXPECT_FALSE(cache->Find(std::string(dir.path) + "/bar.rc", &lines));
+  unlink(cache_path.c_str());
+  unlink(path.c_str());
+}
+
+TEST(rc_cache, ignores_changed_files) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/foo.rc";
+  ASSERT_TRUE(android::base::WriteStringToFile(kRc, path));
+  TemporaryFile cache_file;
+  ASSERT_TRUE(android::base::WriteStringToFile(RcCache::Compile({MakeInput(path)}),
+                                               cache_file.path));
+
+  ASSERT_TRUE(android::base::WriteStringToFile("on boot\n", path));
+  std::unique_ptr<RcCache> cache = RcCache::Open(cache_file.path);
+  ASSERT_NE(nullptr, cache);
+  std::vector<RcLine> lines;
+  EXPECT_FALSE(cache->Find(path, &lines));
+  unlink(path.c_str());
+}
+
+TEST(rc_cache, rejects_invalid_caches) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/foo.rc";
+  ASSERT_TRUE(android::base::WriteStringToFile(kRc, path));
+  std::string contents = RcCache::Compile({MakeInput(path)});
+
+  TemporaryFile cache_file;
+  ASSERT_TRUE(android::base::WriteStringToFile(contents.substr(0, contents.size() - 1),
+                                               cache_file.path));
+  EXPECT_EQ(nullptr, RcCache::Open(cache_file.path));
+
+  contents[0] = 'X';
+  ASSERT_TRUE(android::base::WriteStringToFile(contents, cache_file.path));
+  EXPECT_EQ(nullptr, RcCache::Open(cache_file.path));
+
+  EXPECT_EQ(nullptr, RcCache::Open(std::string(dir.path) + "/does-not-exist"));
+  unlink(path.c_str());
+}
+
+TEST(rc_cache, rejects_insecure_caches) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/foo.rc";
+  ASSERT_TRUE(android::base::WriteStringToFile(kRc, path));
+  TemporaryFile cache_file;
+  ASSERT_TRUE(android::base::WriteStringToFile(RcCache::Compile({MakeInput(path)}),
+                                               cache_file.path));
+  ASSERT_NE(nullptr, RcCache::Open(cache_file.path));
+
+  std::string link = std::string(dir.path) + "/link.cache";
+  ASSERT_EQ(0, symlink(cache_file.path, link.c_str()));
+  EXPECT_EQ(nullptr, RcCache::Open(link));
+
+  ASSERT_EQ(0, chmod(cache_file.path, 0620));
+  EXPECT_EQ(nullptr, RcCache::Open(cache_file.path));
+  ASSERT_EQ(0, chmod(cache_file.path, 0602));
+  EXPECT_EQ(nullptr, RcCache::Open(cache_file.path));
+  unlink(link.c_str());
+  unlink(path.c_str());
+}
+
+TEST(rc_cache, ignores_files_read_file_refuses) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/foo.rc";
+  ASSERT_TRUE(android::base::WriteStringToFile(kRc, path));
+  ASSERT_EQ(0, chmod(path.c_str(), 0644));
+  std::string link = std::string(dir.path) + "/link.rc";
+  ASSERT_EQ(0, symlink(path.c_str(), link.c_str()));
+  RcCache::Input link_input = MakeInput(path);
+  link_input.path = link;
+  TemporaryFile cache_file;
+  ASSERT_TRUE(android::base::WriteStringToFile(RcCache::Compile({MakeInput(path), link_input}),
+                                               cache_file.path));
+
+  std::unique_ptr<RcCache> cache = RcCache::Open(cache_file.path);
+  ASSERT_NE(nullptr, cache);
+  std::vector<RcLine> lines;
+  EXPECT_TRUE(cache->Find(path, &lines));
+  EXPECT_FALSE(cache->Find(link, &lines));
+
+  // Changing the mode leaves the size and modification time alone.
+  ASSERT_EQ(0, chmod(path.c_str(), 0664));
+  EXPECT_FALSE(cache->Find(path, &lines));
+  ASSERT_EQ(0, chmod(path.c_str(), 0646));
+  EXPECT_FALSE(cache->Find(path, &lines));
+  unlink(link.c_str());
+  unlink(path.c_str());
+}
+
+TEST(rc_cache, rejects_empty_lines) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/foo.rc";
+  ASSERT_TRUE(android::base::WriteStringToFile(kRc, path));
+  RcCache::Input input = MakeInput(path);
+
+  // A cache holding input with a single line of no tokens, which Compile()
+  // itself never writes.
+  std::string contents = RcCache::Compile({});
+  auto append = [&contents](auto value) {
+    contents.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  append(static_cast<uint32_t>(path.size()));
+  contents += path;
+  append(static_cast<uint64_t>(input.size));
+  append(static_cast<int64_t>(input.mtime.tv_sec));
+  append(static_cast<int64_t>(input.mtime.tv_nsec));
+  append(static_cast<uint64_t>(2 * sizeof(uint32_t)));
+  append(static_cast<uint32_t>(1));
+  append(static_cast<uint32_t>(0));
+
+  TemporaryFile cache_file;
+  ASSERT_TRUE(android::base::WriteStringToFile(contents, cache_file.path));
+  std::unique_ptr<RcCache> cache = RcCache::Open(cache_file.path);
+  ASSERT_NE(nullptr, cache);
+  std::vector<RcLine> lines;
+  EXPECT_FALSE(cache->Find(path, &lines));
+  unlink(path.c_str());
+}
@@ -312,6 +312,7 @@ static void DoSync() {
 
 static void __attribute__((noreturn)) DoThermalOff() {
     LOG(WARNING) << "Thermal system shutdown";
+    flush_persistent_properties();
     DoSync();
     RebootSystem(ANDROID_RB_THERMOFF, "");
     abort();
@@ -404,6 +405,7 @@ void DoReboot(unsigned int cmd, const std::string& reason, const std::string& re
     }
 
     // 4. sync, try umount, and optionally run fsck for user shutdown
+    flush_persistent_properties();
     DoSync();
     UmountStat stat = TryUmountAndFsck(runFsck);
     LogShutdownTime(stat, &t);
@@ -30,6 +30,8 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include <map>
+
 #include <selinux/selinux.h>
 
 #include <android-base/file.h>
@@ -41,6 +43,7 @@
 #include <processgroup/processgroup.h>
 
 #include "action.h"
+#include "boot_trace.h"
 #include "init.h"
 #include "init_parser.h"
 #include "log.h"
@@ -88,6 +91,39 @@ static std::string ComputeContextFromExecutable(std::string& service_name,
     return computed_context;
 }
 
+// The contexts computed for executables, by path. An executable that is
+// replaced or relabeled gets a new inode or ctime, so its context is
+// computed again.
+struct ExecutableContext {
+    dev_t dev;
+    ino_t ino;
+    struct timespec ctime;
+    std::string context;
+};
+static std::map<std::string, ExecutableContext> executable_contexts;
+
+static std::string GetContextForExecutable(std::string& service_name,
+                                           const std::string& service_path,
+                                           const struct stat& sb, bool* cached) {
+    auto it = executable_contexts.find(service_path);
+    if (it != executable_contexts.end()) {
+        const ExecutableContext& e = it->second;
+        if (e.dev == sb.st_dev && e.ino == sb.st_ino && e.ctime.tv_sec == sb.st_ctim.tv_sec &&
+            e.ctime.tv_nsec == sb.st_ctim.tv_nsec) {
+            *cached = true;
+            return e.context;
+        }
+    }
+
+    *cached = false;
+    LOG(INFO) << "computing context for service '" << service_name << "'";
+    std::string context = ComputeContextFromExecutable(service_name, service_path);
+    if (!context.empty()) {
+        executable_contexts[service_path] = {sb.st_dev, sb.st_ino, sb.st_ctim, context};
+    }
+    return context;
+}
+
 static void SetUpPidNamespace(const std::string& service_name) {
     constexpr unsigned int kSafeFlags = MS_NODEV | MS_NOEXEC | MS_NOSUID;
 
@@ -570,6 +606,7 @@ bool Service::Start() {
         return false;
     }
 
+    Timer t;
     bool needs_console = (flags_ & SVC_CONSOLE);
     if (needs_console) {
         if (console_.empty()) {
@@ -595,11 +632,11 @@ bool Service::Start() {
     }
 
     std::string scon;
+    bool context_cached = false;
     if (!seclabel_.empty()) {
         scon = seclabel_;
     } else {
-        LOG(INFO) << "computing context for service '" << name_ << "'";
-        scon = ComputeContextFromExecutable(name_, args_[0]);
+        scon = GetContextForExecutable(name_, args_[0], sb, &context_cached);
         if (scon == "") {
             return false;
         }
@@ -607,6 +644,7 @@ bool Service::Start() {
 
     LOG(INFO) << "starting service '" << name_ << "'...";
 
+    Timer fork_timer;
     pid_t pid = -1;
     if (namespace_flags_) {
         pid = clone(nullptr, nullptr, namespace_flags_ | SIGCHLD, nullptr);
@@ -617,6 +655,16 @@ bool Service::Start() {
     if (pid == 0) {
         umask(077);
 
+        // Done here rather than by init after the fork, so that init can get
+        // on with starting the next service. Any pid namespace's children
+        // inherit it.
+        if (oom_score_adjust_ != -1000) {
+            if (!WriteStringToFile(StringPrintf("%d", oom_score_adjust_),
+                                   "/proc/self/oom_score_adj")) {
+                PLOG(ERROR) << "couldn't write oom_score_adj";
+            }
+        }
+
         if (namespace_flags_ & CLONE_NEWPID) {
             // This will fork again to run an init process inside the PID
             // namespace.
@@ -691,14 +739,7 @@ bool Service::Start() {
         pid_ = 0;
         return false;
     }
-
-    if (oom_score_adjust_ != -1000) {
-        std::string oom_str = StringPrintf("%d", oom_score_adjust_);
-        std::string oom_file = StringPrintf("/proc/%d/oom_score_adj", pid);
-        if (!WriteStringToFile(oom_str, oom_file)) {
-            PLOG(ERROR) << "couldn't write oom_score_adj: " << strerror(errno);
-        }
-    }
+    double fork_ms = fork_timer.duration_s() * 1000;
 
     time_started_ = boot_clock::now();
     pid_ = pid;
@@ -717,6 +758,10 @@ bool Service::Start() {
     }
 
     NotifyStateChange("running");
+    BootTrace::GetInstance().AddEvent(
+        BootTrace::kService, name_, t.start(),
+        StringPrintf("pid %d, fork %.2fms%s", pid_, fork_ms,
+                     context_cached ? ", cached context" : ""));
     return true;
 }
 
@@ -943,7 +988,7 @@ void ServiceManager::ForEachService(const std::function<void(Service*)>& callbac
 }
 
 void ServiceManager::ForEachServiceInClass(const std::string& classname,
-                                           void (*func)(Service* svc)) const {
+                                           const std::function<void(Service*)>& func) const {
     for (const auto& s : services_) {
         if (classname == s->classname()) {
             func(s.get());
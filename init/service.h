@@ -184,7 +184,7 @@ public:
     Service* FindServiceByKeychord(int keychord_id) const;
     void ForEachService(const std::function<void(Service*)>& callback) const;
     void ForEachServiceInClass(const std::string& classname,
-                               void (*func)(Service* svc)) const;
+                               const std::function<void(Service*)>& func) const;
     void ForEachServiceWithFlags(unsigned matchflags,
                              void (*func)(Service* svc)) const;
     void ReapAnyOutstandingChildren();
@@ -26,6 +26,9 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
+
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <selinux/selinux.h>
 
@@ -74,7 +77,15 @@ int ueventd_main(int argc, char **argv)
     std::string hardware = property_get("ro.hardware");
     ueventd_parse_config_file(android::base::StringPrintf("/ueventd.%s.rc", hardware.c_str()).c_str());
 
-    device_init();
+    // Coldboot is serial unless ro.ueventd.coldboot_workers asks for more
+    // processes to handle the uevents it regenerates.
+    unsigned int coldboot_workers = 1;
+    std::string workers = property_get("ro.ueventd.coldboot_workers");
+    if (!workers.empty() && !android::base::ParseUint(workers.c_str(), &coldboot_workers, 64u)) {
+        LOG(ERROR) << "invalid ro.ueventd.coldboot_workers '" << workers << "'";
+        coldboot_workers = 1;
+    }
+    device_init(nullptr, nullptr, std::max(1u, coldboot_workers));
 
     pollfd ufd;
     ufd.events = POLLIN;
@@ -59,6 +59,10 @@ class Timer {
     return std::chrono::duration_cast<std::chrono::milliseconds>(boot_clock::now() - start_).count();
   }
 
+  boot_clock::time_point start() const {
+    return start_;
+  }
+
  private:
   boot_clock::time_point start_;
 };
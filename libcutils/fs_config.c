@@ -31,8 +31,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
 #include <sys/types.h>
 
+#include <cutils/threads.h>
 #include <log/log.h>
 #include <private/android_filesystem_config.h>
 #include <utils/Compat.h>
@@ -228,52 +232,422 @@ static const struct fs_path_config android_files[] = {
     /* clang-format on */
 };
 
-static int fs_config_open(int dir, int which, const char* target_out_path) {
-    int fd = -1;
+static bool fs_config_cmp(bool dir, const char* prefix, size_t len, const char* path, size_t plen) {
+    if (dir) {
+        if (plen < len) {
+            return false;
+        }
+    } else {
+        /* If name ends in * then allow partial matches. */
+        if (prefix[len - 1] == '*') {
+            return !strncmp(prefix, path, len - 1);
+        }
+        if (plen != len) {
+            return false;
+        }
+    }
+    return !strncmp(prefix, path, len);
+}
+
+/* Returns the name of config file |which| under target_out_path, or NULL.
+ * The caller must free the result. */
+static char* fs_config_target_name(int dir, int which, const char* target_out_path) {
+    char* name = NULL;
 
     if (target_out_path && *target_out_path) {
         /* target_out_path is the path to the directory holding content of
          * system partition but as we cannot guaranty it ends with '/system'
          * we need this below skip_len logic */
-        char* name = NULL;
         int target_out_path_len = strlen(target_out_path);
         int skip_len = strlen("/system");
 
         if (target_out_path[target_out_path_len] == '/') {
             skip_len++;
         }
-        if (asprintf(&name, "%s%s", target_out_path, conf[which][dir] + skip_len) != -1) {
-            fd = TEMP_FAILURE_RETRY(open(name, O_RDONLY | O_BINARY));
-            free(name);
+        if (asprintf(&name, "%s%s", target_out_path, conf[which][dir] + skip_len) == -1) {
+            name = NULL;
         }
     }
+    return name;
+}
+
+/* A rule from a config file or from the built-in tables, in the form used
+ * by the lookup index.  A rule matches a path whose first |len| bytes equal
+ * |prefix| and, unless |wildcard| is set, whose length is exactly |len|.
+ * Directory rules and file rules ending in '*' are wildcards. */
+struct fs_config_rule {
+    const char* prefix;
+    size_t len;
+    bool wildcard;
+    unsigned mode;
+    unsigned uid;
+    unsigned gid;
+    uint64_t capabilities;
+};
+
+/* One of the conf[] files as it was when the index was built. */
+struct fs_config_source {
+    char* target_name;  /* under target_out_path, or NULL */
+    const char* loaded; /* target_name, conf[which][dir], or NULL if neither existed */
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    void* data;
+    size_t data_len;
+};
+
+/* Load-once index over the config files and the built-in table for either
+ * directories or files.  Rules are kept in "first match" order; every
+ * distinct (prefix, len, wildcard) key is hashed to the first rule that has
+ * it, and a lookup takes the earliest rule among the keys that match the
+ * path: the exact path itself plus each of its prefixes whose length is in
+ * |wildcard_lens|. */
+struct fs_config_index {
+    bool built;
+    char* target_out_path;
+    struct fs_config_source sources[sizeof(conf) / sizeof(conf[0])];
+    struct fs_config_rule* rules;
+    size_t rule_count;
+    const struct fs_path_config* fallback;
+    uint32_t* slots; /* rule index + 1, or 0 if empty */
+    size_t slot_mask;
+    size_t* wildcard_lens; /* sorted, unique */
+    size_t wildcard_len_count;
+};
+
+static mutex_t fs_config_lock = MUTEX_INITIALIZER;
+static struct fs_config_index fs_config_indexes[2]; /* [dir] */
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+static inline uint32_t fs_config_hash_step(uint32_t hash, char c) {
+    return (hash ^ (uint8_t)c) * FNV_PRIME;
+}
+
+static uint32_t fs_config_hash(const char* s, size_t len) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        hash = fs_config_hash_step(hash, s[i]);
+    }
+    return hash;
+}
+
+static bool fs_config_same_file(const struct fs_config_source* src, const char* name,
+                                const struct stat* st) {
+    return src->loaded == name && src->dev == st->st_dev && src->ino == st->st_ino &&
+           src->size == st->st_size && src->mtime == st->st_mtime;
+}
+
+/* Returns true if config file |which| is no longer the one that was indexed. */
+static bool fs_config_source_stale(const struct fs_config_source* src, int dir, int which) {
+    struct stat st;
+
+    if (src->target_name && !stat(src->target_name, &st)) {
+        return !fs_config_same_file(src, src->target_name, &st);
+    }
+    if (!stat(conf[which][dir], &st)) {
+        return !fs_config_same_file(src, conf[which][dir], &st);
+    }
+    return src->loaded != NULL;
+}
+
+static bool fs_config_index_stale(const struct fs_config_index* index, int dir,
+                                  const char* target_out_path) {
+    const char* built_for = index->target_out_path ? index->target_out_path : "";
+    size_t which;
+
+    if (!index->built) return true;
+    if (strcmp(built_for, target_out_path ? target_out_path : "")) return true;
+    for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        if (fs_config_source_stale(&index->sources[which], dir, which)) return true;
+    }
+    return false;
+}
+
+static void fs_config_source_unload(struct fs_config_source* src) {
+    if (src->data) {
+#if !defined(_WIN32)
+        munmap(src->data, src->data_len);
+#else
+        free(src->data);
+#endif
+    }
+    free(src->target_name);
+    memset(src, 0, sizeof(*src));
+}
+
+/* Maps config file |which| into memory, preferring the copy under target_out_path. */
+static void fs_config_source_load(struct fs_config_source* src, int dir, int which,
+                                  const char* target_out_path) {
+    const char* name = NULL;
+    struct stat st;
+    int fd = -1;
+
+    src->target_name = fs_config_target_name(dir, which, target_out_path);
+    if (src->target_name) {
+        fd = TEMP_FAILURE_RETRY(open(src->target_name, O_RDONLY | O_BINARY));
+        name = src->target_name;
+    }
     if (fd < 0) {
         fd = TEMP_FAILURE_RETRY(open(conf[which][dir], O_RDONLY | O_BINARY));
+        name = conf[which][dir];
     }
-    return fd;
+    if (fd < 0) return;
+
+    if (fstat(fd, &st)) {
+        close(fd);
+        return;
+    }
+    src->loaded = name;
+    src->dev = st.st_dev;
+    src->ino = st.st_ino;
+    src->size = st.st_size;
+    src->mtime = st.st_mtime;
+
+    if (st.st_size > 0) {
+#if !defined(_WIN32)
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            src->data = data;
+            src->data_len = st.st_size;
+        }
+#else
+        void* data = malloc(st.st_size);
+        if (data) {
+            ssize_t len = TEMP_FAILURE_RETRY(read(fd, data, st.st_size));
+            if (len > 0) {
+                src->data = data;
+                src->data_len = len;
+            } else {
+                free(data);
+            }
+        }
+#endif
+        if (!src->data) {
+            ALOGE("%s could not be loaded: %s", name, strerror(errno));
+        }
+    }
+    close(fd);
 }
 
-static bool fs_config_cmp(bool dir, const char* prefix, size_t len, const char* path, size_t plen) {
-    if (dir) {
-        if (plen < len) {
-            return false;
+static void fs_config_rule_init(struct fs_config_rule* rule, int dir, const char* prefix,
+                                size_t len) {
+    rule->prefix = prefix;
+    rule->len = len;
+    rule->wildcard = dir;
+    /* If name ends in * then allow partial matches. */
+    if (!dir && len && prefix[len - 1] == '*') {
+        rule->len = len - 1;
+        rule->wildcard = true;
+    }
+}
+
+/* Appends the rules in a loaded config file, stopping at the first bad record. */
+static bool fs_config_add_file_rules(struct fs_config_index* index, int dir,
+                                     const struct fs_config_source* src, size_t* capacity) {
+    const uint8_t* p = src->data;
+    const uint8_t* end = p + src->data_len;
+
+    while ((size_t)(end - p) >= sizeof(struct fs_path_config_from_file)) {
+        const struct fs_path_config_from_file* header = (const struct fs_path_config_from_file*)p;
+        const char* prefix = (const char*)p + sizeof(*header);
+        uint16_t host_len = get2LE((const uint8_t*)&header->len);
+        ssize_t len, remainder = host_len - sizeof(*header);
+        struct fs_config_rule* rule;
+
+        if (remainder <= 0) {
+            ALOGE("%s len is corrupted", src->loaded);
+            break;
         }
-    } else {
-        /* If name ends in * then allow partial matches. */
-        if (prefix[len - 1] == '*') {
-            return !strncmp(prefix, path, len - 1);
+        if (end - (const uint8_t*)prefix < remainder) {
+            ALOGE("%s prefix is truncated", src->loaded);
+            break;
         }
-        if (plen != len) {
-            return false;
+        len = strnlen(prefix, remainder);
+        if (len >= remainder) { /* missing a terminating null */
+            ALOGE("%s is corrupted", src->loaded);
+            break;
         }
+
+        if (index->rule_count == *capacity) {
+            size_t new_capacity = *capacity ? *capacity * 2 : 64;
+            struct fs_config_rule* rules =
+                realloc(index->rules, new_capacity * sizeof(struct fs_config_rule));
+            if (!rules) {
+                ALOGE("%s out of memory", src->loaded);
+                return false;
+            }
+            index->rules = rules;
+            *capacity = new_capacity;
+        }
+        rule = &index->rules[index->rule_count++];
+        fs_config_rule_init(rule, dir, prefix, len);
+        rule->mode = get2LE((const uint8_t*)&header->mode);
+        rule->uid = get2LE((const uint8_t*)&header->uid);
+        rule->gid = get2LE((const uint8_t*)&header->gid);
+        rule->capabilities = get8LE((const uint8_t*)&header->capabilities);
+
+        p += host_len;
     }
-    return !strncmp(prefix, path, len);
+    return true;
+}
+
+static bool fs_config_add_builtin_rules(struct fs_config_index* index, int dir,
+                                        size_t* capacity) {
+    const struct fs_path_config* pc;
+    size_t count = 0;
+
+    for (pc = dir ? android_dirs : android_files; pc->prefix; pc++) {
+        ++count;
+    }
+    if (index->rule_count + count > *capacity) {
+        struct fs_config_rule* rules =
+            realloc(index->rules, (index->rule_count + count) * sizeof(struct fs_config_rule));
+        if (!rules) return false;
+        index->rules = rules;
+        *capacity = index->rule_count + count;
+    }
+    for (pc = dir ? android_dirs : android_files; pc->prefix; pc++) {
+        struct fs_config_rule* rule = &index->rules[index->rule_count++];
+        fs_config_rule_init(rule, dir, pc->prefix, strlen(pc->prefix));
+        rule->mode = pc->mode;
+        rule->uid = pc->uid;
+        rule->gid = pc->gid;
+        rule->capabilities = pc->capabilities;
+    }
+    index->fallback = pc;
+    return true;
+}
+
+static int fs_config_size_cmp(const void* a, const void* b) {
+    size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Hashes every rule whose key has not been seen in an earlier rule. */
+static bool fs_config_hash_rules(struct fs_config_index* index) {
+    size_t slot_count = 16;
+    size_t i, j;
+
+    while (slot_count < index->rule_count * 2) {
+        slot_count *= 2;
+    }
+    index->slots = calloc(slot_count, sizeof(uint32_t));
+    index->wildcard_lens = malloc((index->rule_count + 1) * sizeof(size_t));
+    if (!index->slots || !index->wildcard_lens) return false;
+    index->slot_mask = slot_count - 1;
+
+    for (i = 0; i < index->rule_count; ++i) {
+        const struct fs_config_rule* rule = &index->rules[i];
+        size_t slot = fs_config_hash(rule->prefix, rule->len) & index->slot_mask;
+        bool duplicate = false;
+
+        for (; index->slots[slot]; slot = (slot + 1) & index->slot_mask) {
+            const struct fs_config_rule* other = &index->rules[index->slots[slot] - 1];
+            if (other->wildcard == rule->wildcard && other->len == rule->len &&
+                !memcmp(other->prefix, rule->prefix, rule->len)) {
+                duplicate = true;
+                break;
+            }
+        }
+        if (duplicate) continue;
+        index->slots[slot] = i + 1;
+        if (rule->wildcard) {
+            index->wildcard_lens[index->wildcard_len_count++] = rule->len;
+        }
+    }
+
+    qsort(index->wildcard_lens, index->wildcard_len_count, sizeof(size_t), fs_config_size_cmp);
+    for (i = 0, j = 0; i < index->wildcard_len_count; ++i) {
+        if (!j || index->wildcard_lens[j - 1] != index->wildcard_lens[i]) {
+            index->wildcard_lens[j++] = index->wildcard_lens[i];
+        }
+    }
+    index->wildcard_len_count = j;
+    return true;
+}
+
+static void fs_config_index_clear(struct fs_config_index* index) {
+    size_t which;
+
+    for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        fs_config_source_unload(&index->sources[which]);
+    }
+    free(index->target_out_path);
+    free(index->rules);
+    free(index->slots);
+    free(index->wildcard_lens);
+    memset(index, 0, sizeof(*index));
+}
+
+static void fs_config_index_build(struct fs_config_index* index, int dir,
+                                  const char* target_out_path) {
+    size_t capacity = 0;
+    size_t which;
+
+    fs_config_index_clear(index);
+    index->built = true;
+    if (target_out_path && *target_out_path) {
+        index->target_out_path = strdup(target_out_path);
+    }
+    for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        struct fs_config_source* src = &index->sources[which];
+
+        fs_config_source_load(src, dir, which, target_out_path);
+        if (src->data && !fs_config_add_file_rules(index, dir, src, &capacity)) break;
+    }
+    if (!fs_config_add_builtin_rules(index, dir, &capacity) || !fs_config_hash_rules(index)) {
+        ALOGE("out of memory indexing fs_config rules");
+        fs_config_index_clear(index);
+    }
+}
+
+/* Lowers *best to the index of the first rule with the given key, if any. */
+static void fs_config_index_probe(const struct fs_config_index* index, uint32_t hash,
+                                  bool wildcard, const char* path, size_t len, size_t* best) {
+    size_t slot;
+
+    for (slot = hash & index->slot_mask; index->slots[slot];
+         slot = (slot + 1) & index->slot_mask) {
+        size_t i = index->slots[slot] - 1;
+        const struct fs_config_rule* rule = &index->rules[i];
+        if (rule->wildcard == wildcard && rule->len == len && !memcmp(rule->prefix, path, len)) {
+            if (i < *best) *best = i;
+            return;
+        }
+    }
+}
+
+/* Returns the index of the first rule matching |path|, or rule_count if none does. */
+static size_t fs_config_index_find(const struct fs_config_index* index, const char* path,
+                                   size_t plen) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    size_t best = index->rule_count;
+    size_t next = 0;
+    size_t i;
+
+    /* Hash the path once, probing for wildcards at each length that has any. */
+    for (i = 0;; ++i) {
+        if (next < index->wildcard_len_count && index->wildcard_lens[next] == i) {
+            fs_config_index_probe(index, hash, true, path, i, &best);
+            ++next;
+        }
+        if (i == plen) break;
+        hash = fs_config_hash_step(hash, path[i]);
+    }
+    fs_config_index_probe(index, hash, false, path, plen, &best);
+    return best;
 }
 
 void fs_config(const char* path, int dir, const char* target_out_path, unsigned* uid, unsigned* gid,
                unsigned* mode, uint64_t* capabilities) {
+    struct fs_config_index* index = &fs_config_indexes[dir ? 1 : 0];
     const struct fs_path_config* pc;
-    size_t which, plen;
+    size_t plen;
 
     if (path[0] == '/') {
         path++;
@@ -281,55 +655,32 @@ void fs_config(const char* path, int dir, const char* target_out_path, unsigned*
 
     plen = strlen(path);
 
-    for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
-        struct fs_path_config_from_file header;
-
-        int fd = fs_config_open(dir, which, target_out_path);
-        if (fd < 0) continue;
-
-        while (TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) == sizeof(header)) {
-            char* prefix;
-            uint16_t host_len = get2LE((const uint8_t*)&header.len);
-            ssize_t len, remainder = host_len - sizeof(header);
-            if (remainder <= 0) {
-                ALOGE("%s len is corrupted", conf[which][dir]);
-                break;
-            }
-            prefix = calloc(1, remainder);
-            if (!prefix) {
-                ALOGE("%s out of memory", conf[which][dir]);
-                break;
-            }
-            if (TEMP_FAILURE_RETRY(read(fd, prefix, remainder)) != remainder) {
-                free(prefix);
-                ALOGE("%s prefix is truncated", conf[which][dir]);
-                break;
-            }
-            len = strnlen(prefix, remainder);
-            if (len >= remainder) { /* missing a terminating null */
-                free(prefix);
-                ALOGE("%s is corrupted", conf[which][dir]);
+    mutex_lock(&fs_config_lock);
+    if (fs_config_index_stale(index, dir, target_out_path)) {
+        fs_config_index_build(index, dir, target_out_path);
+    }
+    if (index->slots) {
+        size_t i = fs_config_index_find(index, path, plen);
+        if (i < index->rule_count) {
+            const struct fs_config_rule* rule = &index->rules[i];
+            *uid = rule->uid;
+            *gid = rule->gid;
+            *mode = (*mode & (~07777)) | rule->mode;
+            *capabilities = rule->capabilities;
+            mutex_unlock(&fs_config_lock);
+            return;
+        }
+        pc = index->fallback;
+    } else {
+        /* The index could not be built; scan the built-in rules directly. */
+        for (pc = dir ? android_dirs : android_files; pc->prefix; pc++) {
+            if (fs_config_cmp(dir, pc->prefix, strlen(pc->prefix), path, plen)) {
                 break;
             }
-            if (fs_config_cmp(dir, prefix, len, path, plen)) {
-                free(prefix);
-                close(fd);
-                *uid = get2LE((const uint8_t*)&(header.uid));
-                *gid = get2LE((const uint8_t*)&(header.gid));
-                *mode = (*mode & (~07777)) | get2LE((const uint8_t*)&(header.mode));
-                *capabilities = get8LE((const uint8_t*)&(header.capabilities));
-                return;
-            }
-            free(prefix);
         }
-        close(fd);
     }
+    mutex_unlock(&fs_config_lock);
 
-    for (pc = dir ? android_dirs : android_files; pc->prefix; pc++) {
-        if (fs_config_cmp(dir, pc->prefix, strlen(pc->prefix), path, plen)) {
-            break;
-        }
-    }
     *uid = pc->uid;
     *gid = pc->gid;
     *mode = (*mode & (~07777)) | pc->mode;
@@ -17,63 +17,121 @@
 #include <cutils/hashmap.h>
 #include <assert.h>
 #include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <cutils/threads.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <sys/types.h>
 
+/*
+ * Open addressing with linear probing. Entries live directly in the bucket
+ * array, so a lookup touches one or two cache lines instead of following a
+ * chain of separately allocated entries.
+ *
+ * Removed entries become tombstones rather than shifting their neighbours
+ * back. This keeps hashmapForEach() safe against removal of the current
+ * entry, and it lets lock-free readers walk a probe sequence while a writer
+ * is modifying it. Tombstones are dropped the next time the table is rebuilt.
+ *
+ * A map made with hashmapCreateConcurrent() never reuses a slot in place. A
+ * reader that has matched a key therefore can't see a value that was stored
+ * for a different key. A rebuilt table is published atomically, and the old
+ * one is freed once every lookup that could have loaded it has finished, so
+ * a map never holds more than its current table however busy its readers.
+ */
+
+/* Marks a bucket whose entry was removed. */
+static char tombstone;
+#define TOMBSTONE ((void*) &tombstone)
+
 typedef struct Entry Entry;
 struct Entry {
-    void* key;
+    _Atomic(void*) key; /* NULL if the bucket has never been used */
+    _Atomic(void*) value;
     int hash;
-    void* value;
-    Entry* next;
 };
 
-struct Hashmap {
-    Entry** buckets;
+typedef struct Table Table;
+struct Table {
     size_t bucketCount;
+    Entry buckets[];
+};
+
+struct Hashmap {
+    _Atomic(Table*) table;
     int (*hash)(void* key);
     bool (*equals)(void* keyA, void* keyB);
-    mutex_t lock; 
+    mutex_t lock;
     size_t size;
+    size_t tombstones;
+    bool concurrentReads;
+    /* For concurrent maps, lookups in progress are counted in the slot for
+     * the epoch they started in. Each rebuild starts a new epoch. */
+    atomic_uint epoch;
+    atomic_uint readers[2];
 };
 
-Hashmap* hashmapCreate(size_t initialCapacity,
-        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+static Table* createTable(size_t bucketCount) {
+    Table* table = calloc(1, sizeof(Table) + bucketCount * sizeof(Entry));
+    if (table != NULL) {
+        table->bucketCount = bucketCount;
+    }
+    return table;
+}
+
+static Hashmap* createHashmap(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB),
+        bool concurrentReads) {
     assert(hash != NULL);
     assert(equals != NULL);
-    
+
     Hashmap* map = malloc(sizeof(Hashmap));
     if (map == NULL) {
         return NULL;
     }
-    
+
     // 0.75 load factor.
     size_t minimumBucketCount = initialCapacity * 4 / 3;
-    map->bucketCount = 1;
-    while (map->bucketCount <= minimumBucketCount) {
+    size_t bucketCount = 1;
+    while (bucketCount <= minimumBucketCount) {
         // Bucket count must be power of 2.
-        map->bucketCount <<= 1; 
+        bucketCount <<= 1;
     }
 
-    map->buckets = calloc(map->bucketCount, sizeof(Entry*));
-    if (map->buckets == NULL) {
+    Table* table = createTable(bucketCount);
+    if (table == NULL) {
         free(map);
         return NULL;
     }
-    
+    atomic_init(&map->table, table);
+    atomic_init(&map->epoch, 0);
+    atomic_init(&map->readers[0], 0);
+    atomic_init(&map->readers[1], 0);
+
     map->size = 0;
+    map->tombstones = 0;
+    map->concurrentReads = concurrentReads;
 
     map->hash = hash;
     map->equals = equals;
-    
+
     mutex_init(&map->lock);
-    
+
     return map;
 }
 
+Hashmap* hashmapCreate(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+    return createHashmap(initialCapacity, hash, equals, false);
+}
+
+Hashmap* hashmapCreateConcurrent(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
+    return createHashmap(initialCapacity, hash, equals, true);
+}
+
 /**
  * Hashes the given key.
  */
@@ -89,7 +147,7 @@ static inline int hashKey(Hashmap* map, void* key) {
     h ^= (((unsigned int) h) >> 14);
     h += (h << 4);
     h ^= (((unsigned int) h) >> 10);
-       
+
     return h;
 }
 
@@ -101,35 +159,106 @@ static inline size_t calculateIndex(size_t bucketCount, int hash) {
     return ((size_t) hash) & (bucketCount - 1);
 }
 
-static void expandIfNecessary(Hashmap* map) {
-    // If the load factor exceeds 0.75...
-    if (map->size > (map->bucketCount * 3 / 4)) {
-        // Start off with a 0.33 load factor.
-        size_t newBucketCount = map->bucketCount << 1;
-        Entry** newBuckets = calloc(newBucketCount, sizeof(Entry*));
-        if (newBuckets == NULL) {
-            // Abort expansion.
-            return;
+/* Writers hold the map's lock, so they can read the table without ordering. */
+static inline Table* writerTable(Hashmap* map) {
+    return atomic_load_explicit(&map->table, memory_order_relaxed);
+}
+
+static inline void* loadKey(Entry* entry) {
+    return atomic_load_explicit(&entry->key, memory_order_acquire);
+}
+
+static inline void* loadValue(Entry* entry) {
+    return atomic_load_explicit(&entry->value, memory_order_acquire);
+}
+
+static inline void storeValue(Entry* entry, void* value) {
+    atomic_store_explicit(&entry->value, value, memory_order_release);
+}
+
+/* Fills an unused bucket. The key is stored last so readers never see a
+ * key without its hash and value. */
+static inline void fillEntry(Entry* entry, void* key, int hash, void* value) {
+    entry->hash = hash;
+    atomic_store_explicit(&entry->value, value, memory_order_relaxed);
+    atomic_store_explicit(&entry->key, key, memory_order_release);
+}
+
+/*
+ * Waits until no lookup can still be using a table replaced before this
+ * call. Starting a new epoch sends later lookups, which can only see the new
+ * table, to the other readers slot, so only the old slot has to drain; a
+ * steady stream of new readers can't hold the old table up. Lookups never
+ * take the lock, so this only waits for the ones already in progress.
+ */
+static void waitForReaders(Hashmap* map) {
+    unsigned int epoch = atomic_load(&map->epoch);
+    atomic_store(&map->epoch, epoch + 1);
+    while (atomic_load(&map->readers[epoch & 1]) != 0) {
+        sched_yield();
+    }
+}
+
+/* Copies the live entries into a new table, dropping tombstones. */
+static void rebuild(Hashmap* map, size_t newBucketCount) {
+    Table* oldTable = writerTable(map);
+    Table* newTable = createTable(newBucketCount);
+    if (newTable == NULL) {
+        // Abort expansion.
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < oldTable->bucketCount; i++) {
+        Entry* entry = &oldTable->buckets[i];
+        void* key = atomic_load_explicit(&entry->key, memory_order_relaxed);
+        if (key == NULL || key == TOMBSTONE) {
+            continue;
         }
-        
-        // Move over existing entries.
-        size_t i;
-        for (i = 0; i < map->bucketCount; i++) {
-            Entry* entry = map->buckets[i];
-            while (entry != NULL) {
-                Entry* next = entry->next;
-                size_t index = calculateIndex(newBucketCount, entry->hash);
-                entry->next = newBuckets[index];
-                newBuckets[index] = entry;
-                entry = next;
-            }
+        size_t index = calculateIndex(newBucketCount, entry->hash);
+        while (atomic_load_explicit(&newTable->buckets[index].key, memory_order_relaxed)
+                != NULL) {
+            index = calculateIndex(newBucketCount, index + 1);
         }
+        fillEntry(&newTable->buckets[index], key, entry->hash,
+                atomic_load_explicit(&entry->value, memory_order_relaxed));
+    }
 
-        // Copy over internals.
-        free(map->buckets);
-        map->buckets = newBuckets;
-        map->bucketCount = newBucketCount;
+    if (!map->concurrentReads) {
+        atomic_store_explicit(&map->table, newTable, memory_order_relaxed);
+    } else {
+        // Both sides use sequentially consistent operations, so a reader that
+        // registers after the new epoch starts loads the new table.
+        atomic_store(&map->table, newTable);
+        waitForReaders(map);
     }
+    free(oldTable);
+    map->tombstones = 0;
+}
+
+/*
+ * Makes room for one more entry, growing or cleaning the table once the load
+ * factor, counting tombstones, would exceed 0.75. Returns false and sets
+ * errno if memory allocation fails and the table is too full to go on.
+ */
+static bool reserveEntry(Hashmap* map) {
+    size_t bucketCount = writerTable(map)->bucketCount;
+
+    if (map->size + map->tombstones + 1 > bucketCount * 3 / 4) {
+        // Leave the rebuilt table at most half full.
+        size_t newBucketCount = bucketCount;
+        while (map->size + 1 > newBucketCount / 2) {
+            newBucketCount <<= 1;
+        }
+        rebuild(map, newBucketCount);
+
+        // There must always be an empty bucket to end a probe sequence.
+        if (map->size + map->tombstones + 1 >= writerTable(map)->bucketCount) {
+            errno = ENOMEM;
+            return false;
+        }
+    }
+    return true;
 }
 
 void hashmapLock(Hashmap* map) {
@@ -141,16 +270,7 @@ void hashmapUnlock(Hashmap* map) {
 }
 
 void hashmapFree(Hashmap* map) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry* next = entry->next;
-            free(entry);
-            entry = next;
-        }
-    }
-    free(map->buckets);
+    free(writerTable(map));
     mutex_destroy(&map->lock);
     free(map);
 }
@@ -170,18 +290,6 @@ int hashmapHash(void* key, size_t keySize) {
     return h;
 }
 
-static Entry* createEntry(void* key, int hash, void* value) {
-    Entry* entry = malloc(sizeof(Entry));
-    if (entry == NULL) {
-        return NULL;
-    }
-    entry->key = key;
-    entry->hash = hash;
-    entry->value = value;
-    entry->next = NULL;
-    return entry;
-}
-
 static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
         bool (*equals)(void*, void*)) {
     if (keyA == keyB) {
@@ -193,154 +301,211 @@ static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
     return equals(keyA, keyB);
 }
 
-void* hashmapPut(Hashmap* map, void* key, void* value) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
+/*
+ * Finds the entry for key. If there is none, returns NULL and sets *slot
+ * to the bucket a new entry should go in.
+ */
+static Entry* findEntry(Hashmap* map, Table* table, void* key, int hash, Entry** slot) {
+    size_t index = calculateIndex(table->bucketCount, hash);
+    Entry* reusable = NULL;
 
-    Entry** p = &(map->buckets[index]);
     while (true) {
-        Entry* current = *p;
+        Entry* entry = &table->buckets[index];
+        void* current = loadKey(entry);
 
-        // Add a new entry.
         if (current == NULL) {
-            *p = createEntry(key, hash, value);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            map->size++;
-            expandIfNecessary(map);
+            *slot = reusable != NULL ? reusable : entry;
             return NULL;
         }
-
-        // Replace existing entry.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* oldValue = current->value;
-            current->value = value;
-            return oldValue;
+        if (current == TOMBSTONE) {
+            // Readers may still be looking at the old contents of this bucket.
+            if (reusable == NULL && !map->concurrentReads) {
+                reusable = entry;
+            }
+        } else if (equalKeys(current, entry->hash, key, hash, map->equals)) {
+            return entry;
         }
 
-        // Move to next entry.
-        p = &current->next;
+        index = calculateIndex(table->bucketCount, index + 1);
     }
 }
 
-void* hashmapGet(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return entry->value;
-        }
-        entry = entry->next;
+/*
+ * Makes room for a key findEntry() didn't find, returning the bucket to store
+ * it in. Returns NULL and sets errno if memory allocation fails.
+ */
+static Entry* reserveSlot(Hashmap* map, Entry* slot, void* key, int hash) {
+    Table* table = writerTable(map);
+    if (!reserveEntry(map)) {
+        return NULL;
     }
+    if (writerTable(map) != table) {
+        findEntry(map, writerTable(map), key, hash, &slot);
+    }
+    return slot;
+}
 
-    return NULL;
+static void addEntry(Hashmap* map, Entry* slot, void* key, int hash, void* value) {
+    if (loadKey(slot) == TOMBSTONE) {
+        map->tombstones--;
+    }
+    fillEntry(slot, key, hash, value);
+    map->size++;
 }
 
-bool hashmapContainsKey(Hashmap* map, void* key) {
+void* hashmapPut(Hashmap* map, void* key, void* value) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return true;
-        }
-        entry = entry->next;
+    Entry* slot;
+    Entry* entry = findEntry(map, writerTable(map), key, hash, &slot);
+
+    // Replace existing entry.
+    if (entry != NULL) {
+        void* oldValue = loadValue(entry);
+        storeValue(entry, value);
+        return oldValue;
     }
 
-    return false;
+    // Add a new entry.
+    slot = reserveSlot(map, slot, key, hash);
+    if (slot == NULL) {
+        return NULL;
+    }
+    addEntry(map, slot, key, hash, value);
+    return NULL;
 }
 
-void* hashmapMemoize(Hashmap* map, void* key, 
-        void* (*initialValue)(void* key, void* context), void* context) {
+/* Lookups may run without the lock in concurrent maps, so they only read. */
+static inline Entry* lookupEntry(Table* table, Hashmap* map, void* key) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
+    size_t index = calculateIndex(table->bucketCount, hash);
 
-    Entry** p = &(map->buckets[index]);
     while (true) {
-        Entry* current = *p;
+        Entry* entry = &table->buckets[index];
+        void* current = loadKey(entry);
 
-        // Add a new entry.
         if (current == NULL) {
-            *p = createEntry(key, hash, NULL);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            void* value = initialValue(key, context);
-            (*p)->value = value;
-            map->size++;
-            expandIfNecessary(map);
-            return value;
+            return NULL;
         }
+        if (current != TOMBSTONE && equalKeys(current, entry->hash, key, hash, map->equals)) {
+            return entry;
+        }
+
+        index = calculateIndex(table->bucketCount, index + 1);
+    }
+}
 
-        // Return existing value.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            return current->value;
+/* Returns the table for a lookup, keeping it alive until endRead(). */
+static inline Table* beginRead(Hashmap* map, unsigned int* epoch) {
+    if (!map->concurrentReads) {
+        return writerTable(map);
+    }
+    while (true) {
+        *epoch = atomic_load(&map->epoch);
+        atomic_fetch_add(&map->readers[*epoch & 1], 1);
+        if (atomic_load(&map->epoch) == *epoch) {
+            return atomic_load(&map->table);
         }
+        // A rebuild started a new epoch meanwhile, and a later one would not
+        // wait for this slot. Register again in the current epoch.
+        atomic_fetch_sub(&map->readers[*epoch & 1], 1);
+    }
+}
 
-        // Move to next entry.
-        p = &current->next;
+static inline void endRead(Hashmap* map, unsigned int epoch) {
+    if (map->concurrentReads) {
+        atomic_fetch_sub(&map->readers[epoch & 1], 1);
     }
 }
 
+void* hashmapGet(Hashmap* map, void* key) {
+    unsigned int epoch = 0;
+    Table* table = beginRead(map, &epoch);
+    Entry* entry = lookupEntry(table, map, key);
+    void* value = entry != NULL ? loadValue(entry) : NULL;
+    endRead(map, epoch);
+    return value;
+}
+
+bool hashmapContainsKey(Hashmap* map, void* key) {
+    unsigned int epoch = 0;
+    Table* table = beginRead(map, &epoch);
+    bool found = lookupEntry(table, map, key) != NULL;
+    endRead(map, epoch);
+    return found;
+}
+
+void* hashmapMemoize(Hashmap* map, void* key,
+        void* (*initialValue)(void* key, void* context), void* context) {
+    int hash = hashKey(map, key);
+    Entry* slot;
+    Entry* entry = findEntry(map, writerTable(map), key, hash, &slot);
+
+    // Return existing value.
+    if (entry != NULL) {
+        return loadValue(entry);
+    }
+
+    // Add a new entry.
+    slot = reserveSlot(map, slot, key, hash);
+    if (slot == NULL) {
+        return NULL;
+    }
+    void* value = initialValue(key, context);
+    addEntry(map, slot, key, hash, value);
+    return value;
+}
+
 void* hashmapRemove(Hashmap* map, void* key) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    // Pointer to the current entry.
-    Entry** p = &(map->buckets[index]);
-    Entry* current;
-    while ((current = *p) != NULL) {
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* value = current->value;
-            *p = current->next;
-            free(current);
-            map->size--;
-            return value;
-        }
+    Entry* slot;
+    Entry* entry = findEntry(map, writerTable(map), key, hash, &slot);
 
-        p = &current->next;
+    if (entry == NULL) {
+        return NULL;
     }
 
-    return NULL;
+    void* value = loadValue(entry);
+    atomic_store_explicit(&entry->key, TOMBSTONE, memory_order_release);
+    storeValue(entry, NULL);
+    map->size--;
+    map->tombstones++;
+    return value;
 }
 
-void hashmapForEach(Hashmap* map, 
+void hashmapForEach(Hashmap* map,
         bool (*callback)(void* key, void* value, void* context),
         void* context) {
     size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry *next = entry->next;
-            if (!callback(entry->key, entry->value, context)) {
-                return;
-            }
-            entry = next;
+    // The callback may add entries and so rebuild the table; pick up the
+    // current table on every step, as the chained implementation did.
+    for (i = 0; i < writerTable(map)->bucketCount; i++) {
+        Entry* entry = &writerTable(map)->buckets[i];
+        void* key = loadKey(entry);
+        if (key == NULL || key == TOMBSTONE) {
+            continue;
+        }
+        if (!callback(key, loadValue(entry), context)) {
+            return;
         }
     }
 }
 
 size_t hashmapCurrentCapacity(Hashmap* map) {
-    size_t bucketCount = map->bucketCount;
+    size_t bucketCount = writerTable(map)->bucketCount;
     return bucketCount * 3 / 4;
 }
 
 size_t hashmapCountCollisions(Hashmap* map) {
+    Table* table = writerTable(map);
     size_t collisions = 0;
     size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            if (entry->next != NULL) {
-                collisions++;
-            }
-            entry = entry->next;
+    // Counts entries that could not be stored in their home bucket.
+    for (i = 0; i < table->bucketCount; i++) {
+        Entry* entry = &table->buckets[i];
+        void* key = loadKey(entry);
+        if (key != NULL && key != TOMBSTONE
+                && calculateIndex(table->bucketCount, entry->hash) != i) {
+            collisions++;
         }
     }
     return collisions;
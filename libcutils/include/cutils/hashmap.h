@@ -41,6 +41,26 @@ typedef struct Hashmap Hashmap;
 Hashmap* hashmapCreate(size_t initialCapacity,
         int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB));
 
+/**
+ * Creates a new hash map whose readers don't need the lock. Returns NULL if
+ * memory allocation fails.
+ *
+ * hashmapGet() and hashmapContainsKey() may be called without hashmapLock(),
+ * concurrently with each other and with a writer that holds the lock. All
+ * other functions still require the lock as usual. A reader may still be
+ * comparing against a removed key, or returning a replaced or removed value,
+ * so callers must not free those until no reader can be using them.
+ *
+ * A writer that rebuilds the table waits for lookups already in progress to
+ * finish, so hash and equals must not wait for the map's lock.
+ *
+ * @param initialCapacity number of expected entries
+ * @param hash function which hashes keys
+ * @param equals function which compares keys for equality
+ */
+Hashmap* hashmapCreateConcurrent(size_t initialCapacity,
+        int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB));
+
 /**
  * Frees the hash map. Does not free the keys or values themselves.
  */
@@ -139,7 +159,7 @@ bool hashmapIntEquals(void* keyA, void* keyB);
 size_t hashmapCurrentCapacity(Hashmap* map);
 
 /**
- * Counts the number of entry collisions.
+ * Counts the number of entries not stored in their home bucket.
  */
 size_t hashmapCountCollisions(Hashmap* map);
 
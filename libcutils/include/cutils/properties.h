@@ -114,6 +114,86 @@ int property_set(const char *key, const char *value);
 
 int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);
 
+/* Property batches are for callers that set many properties in a row: they
+** keep one connection to the property service open and send it queued sets
+** together, rather than connecting and waiting for a reply for each one as
+** property_set() does.
+*/
+typedef struct property_batch property_batch_t;
+
+/* property_batch_open: returns a new batch, or NULL if the property service
+** could not be reached. Free it with property_batch_close().
+*/
+property_batch_t* property_batch_open(void);
+
+/* property_batch_set: queues key=value to be set. Queued sets are sent once
+** enough have built up, and by property_batch_flush(). Returns 0, or < 0 if
+** the connection to the property service failed.
+*/
+int property_batch_set(property_batch_t* batch, const char *key, const char *value);
+
+/* property_batch_flush: sends every queued set and waits until they have all
+** been handled. Returns 0 if every set since the last flush succeeded, < 0
+** otherwise.
+*/
+int property_batch_flush(property_batch_t* batch);
+
+/* property_batch_close: flushes and frees the batch, returning the result of
+** the flush.
+*/
+int property_batch_close(property_batch_t* batch);
+
+/* Property snapshots are for callers that read every property, and keep
+** doing so: they walk the property area once and copy out every name,
+** value and serial into a single immutable block, sorted by name.
+**
+** A snapshot taken with a previous snapshot only reads the properties
+** whose serial has changed since, reusing the rest. Diffing two snapshots
+** then reports just the properties that were added, changed or removed.
+*/
+typedef struct property_snapshot property_snapshot_t;
+
+typedef struct {
+    const char* name;
+    const char* value;
+    uint32_t serial;
+} property_snapshot_entry_t;
+
+/* property_snapshot_create: returns a snapshot of all properties, or NULL on
+** failure. If previous is nonnull, unchanged properties are copied from it
+** rather than read again. Free the result with property_snapshot_free().
+*/
+property_snapshot_t* property_snapshot_create(const property_snapshot_t* previous);
+
+void property_snapshot_free(property_snapshot_t* snapshot);
+
+/* property_snapshot_entries: returns the snapshot's entries sorted by name,
+** storing their number in *count. They live as long as the snapshot.
+*/
+const property_snapshot_entry_t* property_snapshot_entries(const property_snapshot_t* snapshot,
+                                                           size_t* count);
+
+/* property_snapshot_find: returns the value of name in the snapshot, or NULL
+** if it was not set.
+*/
+const char* property_snapshot_find(const property_snapshot_t* snapshot, const char* name);
+
+/* property_snapshot_is_current: returns 1 if no property has been added or
+** changed since the snapshot was taken, 0 otherwise. This is a single
+** atomic load, for pollers to check before taking a new snapshot.
+*/
+int property_snapshot_is_current(const property_snapshot_t* snapshot);
+
+/* property_snapshot_diff: calls fn for every property whose value differs
+** between the two snapshots, in name order. old_value is NULL for properties
+** added since old_snapshot, and new_value is NULL for ones that are gone.
+*/
+void property_snapshot_diff(const property_snapshot_t* old_snapshot,
+                            const property_snapshot_t* new_snapshot,
+                            void (*fn)(const char* name, const char* old_value,
+                                       const char* new_value, void* cookie),
+                            void* cookie);
+
 #if defined(__BIONIC_FORTIFY)
 #define __property_get_err_str "property_get() called with too small of a buffer"
 
@@ -17,6 +17,7 @@
 #ifndef __CUTILS_STR_PARMS_H
 #define __CUTILS_STR_PARMS_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 
@@ -55,6 +56,60 @@ char *str_parms_to_str(struct str_parms *str_parms);
 /* debug */
 void str_parms_dump(struct str_parms *str_parms);
 
+/*
+ * Allocation-free parsing.
+ *
+ * A str_parms_view parses a "key1=value1;key2=value2" string with the same
+ * rules as str_parms_create_str(), but it points into the caller's string
+ * instead of copying it. The string must outlive the view and must not
+ * change while the view is in use. The first STR_PARMS_VIEW_INLINE_PAIRS
+ * distinct keys are stored inside the view itself. Only longer strings
+ * allocate memory.
+ */
+
+/* A key or value inside the parsed string. It is not NUL terminated. */
+struct str_parms_span {
+    const char *data;
+    size_t len;
+};
+
+struct str_parms_pair {
+    struct str_parms_span key;
+    struct str_parms_span value;
+};
+
+#define STR_PARMS_VIEW_INLINE_PAIRS 16
+
+struct str_parms_view {
+    struct str_parms_pair *pairs;  /* in order of first appearance */
+    size_t count;
+    size_t capacity;
+    struct str_parms_pair inline_pairs[STR_PARMS_VIEW_INLINE_PAIRS];
+};
+
+// Parses 'string' into 'view'. If a key appears more than once, the last value wins;
+// finding repeats compares each key with the ones before it, so this is meant for
+// the short strings str_parms usually carries. Returns 0, or -ENOMEM if the string
+// has more pairs than fit inline and memory can't be allocated.
+// str_parms_view_release must be called either way.
+int str_parms_view_init(struct str_parms_view *view, const char *string);
+void str_parms_view_release(struct str_parms_view *view);
+
+// These behave like the str_parms_get_* and str_parms_has_key functions above.
+// Numbers are parsed in place, so values of any length are accepted.
+int str_parms_view_has_key(const struct str_parms_view *view, const char *key);
+int str_parms_view_get_str(const struct str_parms_view *view, const char *key,
+                           char *out_val, int len);
+int str_parms_view_get_int(const struct str_parms_view *view, const char *key,
+                           int *out_val);
+int str_parms_view_get_float(const struct str_parms_view *view, const char *key,
+                             float *out_val);
+
+// Writes the pairs as "key1=value1;key2=value2" into 'buf' like snprintf: the result
+// is truncated to 'len' - 1 characters and NUL terminated. Returns the length of the
+// untruncated string.
+size_t str_parms_view_to_str(const struct str_parms_view *view, char *buf, size_t len);
+
 __END_DECLS
 
 #endif /* __CUTILS_STR_PARMS_H */
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PROPERTY_BATCH_H
+#define _PROPERTY_BATCH_H
+
+/* The property service command behind property_batch_open(), alongside
+** bionic's PROP_MSG_SETPROP and PROP_MSG_SETPROP2.
+**
+** After the command, the client sends any number of requests laid out as for
+** PROP_MSG_SETPROP2: a uint32_t name length, the name, a uint32_t value length
+** and the value. init answers each with a uint32_t PROP_SUCCESS or
+** PROP_ERROR_* result, in order, and keeps the connection open until the
+** client closes it.
+**
+** Clients must not have more than PROP_BATCH_MAX_PENDING requests
+** unanswered: init gives up on a client that doesn't read its results.
+**
+** init lets each uid have at most four of these connections open, and
+** closes connections that have been idle for 10 seconds when a new one
+** arrives. It never closes one with requests waiting to be read, so a client
+** that finds its connection closed before sending anything can reconnect
+** and send its requests again.
+*/
+#define PROP_MSG_SETPROP_BATCH 0x00030001
+
+#define PROP_BATCH_MAX_PENDING 64
+
+#endif
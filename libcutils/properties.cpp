@@ -24,11 +24,19 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <cutils/properties.h>
 #include <cutils/sockets.h>
 #include <log/log.h>
+#include <private/property_batch.h>
 
 int8_t property_get_bool(const char *key, int8_t default_value) {
     if (!key) {
@@ -142,3 +150,357 @@ int property_list(void (*fn)(const char* name, const char* value, void* cookie),
     callback_data data = { fn, cookie };
     return __system_property_foreach(property_list_callback, &data);
 }
+
+// Where each property was found by __system_property_foreach().
+struct snapshot_walk_step {
+    const prop_info* pi;
+    size_t entry;  // index into property_snapshot::entries
+};
+
+// A snapshot is one malloc()ed block: this header, the entries, the walk
+// steps in foreach() order, then the names and values the entries point to.
+struct property_snapshot {
+    uint32_t area_serial;
+    size_t count;
+    const snapshot_walk_step* walk;
+    property_snapshot_entry_t entries[];
+};
+
+namespace {
+
+struct snapshot_item {
+    size_t name;   // offset into the string pool
+    size_t value;  // offset into the string pool
+    uint32_t serial;
+    const prop_info* pi;
+};
+
+struct snapshot_builder {
+    const property_snapshot_t* previous;
+    // The previous snapshot's walk steps sorted by prop_info, only built if
+    // foreach() stops visiting properties in the same order as last time.
+    std::vector<snapshot_walk_step> previous_by_pi;
+    // True while every property has matched the previous walk step by step.
+    bool same_walk;
+
+    std::string pool;
+    std::vector<snapshot_item> items;
+    const prop_info* current;
+};
+
+}  // namespace
+
+static void snapshot_add(snapshot_builder* builder, const char* name, const char* value,
+                         uint32_t serial) {
+    snapshot_item item;
+    item.name = builder->pool.size();
+    builder->pool.append(name, strlen(name) + 1);
+    item.value = builder->pool.size();
+    builder->pool.append(value, strlen(value) + 1);
+    item.serial = serial;
+    item.pi = builder->current;
+    builder->items.push_back(item);
+}
+
+static void snapshot_read_callback(void* cookie, const char* name, const char* value,
+                                   unsigned serial) {
+    snapshot_add(reinterpret_cast<snapshot_builder*>(cookie), name, value, serial);
+}
+
+// Returns the previous snapshot's entry for pi, or NULL.
+static const property_snapshot_entry_t* snapshot_find_previous(snapshot_builder* builder,
+                                                               const prop_info* pi) {
+    const property_snapshot_t* previous = builder->previous;
+    size_t step = builder->items.size();
+    if (builder->same_walk && step < previous->count && previous->walk[step].pi == pi) {
+        return &previous->entries[previous->walk[step].entry];
+    }
+
+    // A property has been added, so this walk no longer lines up with the
+    // previous one: fall back to searching by prop_info.
+    if (builder->same_walk) {
+        builder->same_walk = false;
+        builder->previous_by_pi.assign(previous->walk, previous->walk + previous->count);
+        std::sort(builder->previous_by_pi.begin(), builder->previous_by_pi.end(),
+                  [](const snapshot_walk_step& lhs, const snapshot_walk_step& rhs) {
+                      return lhs.pi < rhs.pi;
+                  });
+    }
+    auto it = std::lower_bound(builder->previous_by_pi.begin(), builder->previous_by_pi.end(), pi,
+                               [](const snapshot_walk_step& lhs, const prop_info* rhs) {
+                                   return lhs.pi < rhs;
+                               });
+    if (it == builder->previous_by_pi.end() || it->pi != pi) {
+        return NULL;
+    }
+    return &previous->entries[it->entry];
+}
+
+static void snapshot_foreach_callback(const prop_info* pi, void* cookie) {
+    snapshot_builder* builder = reinterpret_cast<snapshot_builder*>(cookie);
+    builder->current = pi;
+
+    // prop_infos are never freed or moved, so one with the same serial as
+    // last time still holds the same value.
+    if (builder->previous != NULL) {
+        const property_snapshot_entry_t* entry = snapshot_find_previous(builder, pi);
+        if (entry != NULL && entry->serial == __system_property_serial(pi)) {
+            snapshot_add(builder, entry->name, entry->value, entry->serial);
+            return;
+        }
+    }
+    __system_property_read_callback(pi, snapshot_read_callback, builder);
+}
+
+property_snapshot_t* property_snapshot_create(const property_snapshot_t* previous) {
+    snapshot_builder builder;
+    builder.previous = previous;
+    builder.same_walk = previous != NULL;
+    if (previous != NULL) {
+        builder.items.reserve(previous->count);
+    }
+
+    // Read before walking, so that a change made during the walk leaves the
+    // snapshot out of date rather than wrongly current.
+    uint32_t area_serial = __system_property_area_serial();
+    if (__system_property_foreach(snapshot_foreach_callback, &builder) != 0) {
+        return NULL;
+    }
+
+    // items[i] is the i-th property visited; order[j] is the one whose name
+    // comes j-th. If the walk matched the previous one throughout, the
+    // properties are the same and so is their name order.
+    size_t count = builder.items.size();
+    std::vector<size_t> order(count);
+    const char* pool = builder.pool.data();
+    if (builder.same_walk && count == previous->count) {
+        for (size_t i = 0; i < count; i++) {
+            order[previous->walk[i].entry] = i;
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            order[i] = i;
+        }
+        const std::vector<snapshot_item>& items = builder.items;
+        std::sort(order.begin(), order.end(), [pool, &items](size_t lhs, size_t rhs) {
+            return strcmp(pool + items[lhs].name, pool + items[rhs].name) < 0;
+        });
+    }
+
+    size_t size = sizeof(property_snapshot) + count * sizeof(property_snapshot_entry_t) +
+                  count * sizeof(snapshot_walk_step) + builder.pool.size();
+    property_snapshot_t* snapshot = reinterpret_cast<property_snapshot_t*>(malloc(size));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    snapshot->area_serial = area_serial;
+    snapshot->count = count;
+    snapshot_walk_step* walk = reinterpret_cast<snapshot_walk_step*>(&snapshot->entries[count]);
+    snapshot->walk = walk;
+    char* strings = reinterpret_cast<char*>(&walk[count]);
+    memcpy(strings, pool, builder.pool.size());
+    for (size_t j = 0; j < count; j++) {
+        const snapshot_item& item = builder.items[order[j]];
+        snapshot->entries[j].name = strings + item.name;
+        snapshot->entries[j].value = strings + item.value;
+        snapshot->entries[j].serial = item.serial;
+        walk[order[j]].pi = item.pi;
+        walk[order[j]].entry = j;
+    }
+    return snapshot;
+}
+
+void property_snapshot_free(property_snapshot_t* snapshot) {
+    free(snapshot);
+}
+
+const property_snapshot_entry_t* property_snapshot_entries(const property_snapshot_t* snapshot,
+                                                           size_t* count) {
+    *count = snapshot->count;
+    return snapshot->entries;
+}
+
+const char* property_snapshot_find(const property_snapshot_t* snapshot, const char* name) {
+    const property_snapshot_entry_t* end = snapshot->entries + snapshot->count;
+    const property_snapshot_entry_t* entry = std::lower_bound(
+            snapshot->entries, end, name,
+            [](const property_snapshot_entry_t& lhs, const char* rhs) {
+                return strcmp(lhs.name, rhs) < 0;
+            });
+    if (entry == end || strcmp(entry->name, name) != 0) {
+        return NULL;
+    }
+    return entry->value;
+}
+
+int property_snapshot_is_current(const property_snapshot_t* snapshot) {
+    return __system_property_area_serial() == snapshot->area_serial;
+}
+
+void property_snapshot_diff(const property_snapshot_t* old_snapshot,
+                            const property_snapshot_t* new_snapshot,
+                            void (*fn)(const char* name, const char* old_value,
+                                       const char* new_value, void* cookie),
+                            void* cookie) {
+    const property_snapshot_entry_t* old_entry = old_snapshot->entries;
+    const property_snapshot_entry_t* old_end = old_entry + old_snapshot->count;
+    const property_snapshot_entry_t* new_entry = new_snapshot->entries;
+    const property_snapshot_entry_t* new_end = new_entry + new_snapshot->count;
+
+    while (old_entry != old_end || new_entry != new_end) {
+        int order;
+        if (old_entry == old_end) {
+            order = 1;
+        } else if (new_entry == new_end) {
+            order = -1;
+        } else {
+            order = strcmp(old_entry->name, new_entry->name);
+        }
+
+        if (order < 0) {
+            fn(old_entry->name, old_entry->value, NULL, cookie);
+            ++old_entry;
+        } else if (order > 0) {
+            fn(new_entry->name, NULL, new_entry->value, cookie);
+            ++new_entry;
+        } else {
+            // An unchanged serial means an unchanged value; a changed one
+            // may just mean the property was set to the same value again.
+            if (old_entry->serial != new_entry->serial &&
+                strcmp(old_entry->value, new_entry->value) != 0) {
+                fn(new_entry->name, old_entry->value, new_entry->value, cookie);
+            }
+            ++old_entry;
+            ++new_entry;
+        }
+    }
+}
+
+struct property_batch {
+    int fd;
+    // Requests queued but not yet sent.
+    std::string requests;
+    size_t queued;
+    bool failed;
+};
+
+static void batch_append_string(std::string* requests, const char* s) {
+    uint32_t length = strlen(s);
+    requests->append(reinterpret_cast<const char*>(&length), sizeof(length));
+    requests->append(s, length);
+}
+
+static bool batch_send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t result = TEMP_FAILURE_RETRY(send(fd, data, size, MSG_NOSIGNAL));
+        if (result <= 0) return false;
+        data += result;
+        size -= result;
+    }
+    return true;
+}
+
+static bool batch_recv_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t result = TEMP_FAILURE_RETRY(recv(fd, data, size, MSG_WAITALL));
+        if (result <= 0) return false;
+        data += result;
+        size -= result;
+    }
+    return true;
+}
+
+// Connects to the property service and starts a batch. Returns the socket,
+// or -1.
+static int batch_connect() {
+    int fd = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_LOCAL;
+    strlcpy(addr.sun_path, "/dev/socket/" PROP_SERVICE_NAME, sizeof(addr.sun_path));
+    uint32_t cmd = PROP_MSG_SETPROP_BATCH;
+    if (TEMP_FAILURE_RETRY(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) == -1 ||
+        !batch_send_all(fd, reinterpret_cast<const char*>(&cmd), sizeof(cmd))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Sends the queued requests. init closes batches that have been idle for a
+// while, only ever with none of their requests unread, so if the connection
+// is gone before anything was sent it's safe to reconnect and send them all.
+static bool batch_send_requests(property_batch_t* batch) {
+    const char* data = batch->requests.data();
+    size_t size = batch->requests.size();
+    ssize_t result = TEMP_FAILURE_RETRY(send(batch->fd, data, size, MSG_NOSIGNAL));
+    if (result == -1 && (errno == EPIPE || errno == ECONNRESET)) {
+        close(batch->fd);
+        batch->fd = batch_connect();
+        return batch->fd != -1 && batch_send_all(batch->fd, data, size);
+    }
+    if (result <= 0) return false;
+    return batch_send_all(batch->fd, data + result, size - result);
+}
+
+// Sends the queued requests and reads their results.
+static bool batch_send_queued(property_batch_t* batch) {
+    if (batch->queued == 0) return true;
+
+    uint32_t results[PROP_BATCH_MAX_PENDING];
+    size_t count = batch->queued;
+    bool sent = batch->fd != -1 && batch_send_requests(batch) &&
+                batch_recv_all(batch->fd, reinterpret_cast<char*>(results),
+                               count * sizeof(results[0]));
+    batch->requests.clear();
+    batch->queued = 0;
+
+    if (!sent) {
+        if (batch->fd != -1) {
+            ALOGE("property_batch: lost connection to the property service: %s", strerror(errno));
+            close(batch->fd);
+            batch->fd = -1;
+        }
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] != PROP_SUCCESS) batch->failed = true;
+    }
+    return true;
+}
+
+property_batch_t* property_batch_open() {
+    int fd = batch_connect();
+    if (fd == -1) return nullptr;
+
+    property_batch_t* batch = new property_batch_t;
+    batch->fd = fd;
+    batch->queued = 0;
+    batch->failed = false;
+    return batch;
+}
+
+int property_batch_set(property_batch_t* batch, const char* key, const char* value) {
+    batch_append_string(&batch->requests, key);
+    batch_append_string(&batch->requests, value);
+    if (++batch->queued == PROP_BATCH_MAX_PENDING && !batch_send_queued(batch)) {
+        batch->failed = true;
+        return -1;
+    }
+    return 0;
+}
+
+int property_batch_flush(property_batch_t* batch) {
+    if (!batch_send_queued(batch)) batch->failed = true;
+    int result = batch->failed ? -1 : 0;
+    batch->failed = false;
+    return result;
+}
+
+int property_batch_close(property_batch_t* batch) {
+    int result = property_batch_flush(batch);
+    if (batch->fd != -1) close(batch->fd);
+    delete batch;
+    return result;
+}
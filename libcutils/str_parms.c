@@ -19,6 +19,7 @@
 
 #define _GNU_SOURCE 1
 #include <errno.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -143,43 +144,34 @@ void str_parms_destroy(struct str_parms *str_parms)
     free(str_parms);
 }
 
+static int view_parse(struct str_parms_view *view, const char *string, bool unique_keys);
+
 struct str_parms *str_parms_create_str(const char *_string)
 {
     struct str_parms *str_parms;
-    char *str;
-    char *kvpair;
-    char *tmpstr;
-    int items = 0;
+    struct str_parms_view view;
+    size_t i;
 
     str_parms = str_parms_create();
     if (!str_parms)
         goto err_create_str_parms;
 
-    str = strdup(_string);
-    if (!str)
-        goto err_strdup;
-
     ALOGV("%s: source string == '%s'\n", __func__, _string);
 
-    kvpair = strtok_r(str, ";", &tmpstr);
-    while (kvpair && *kvpair) {
-        char *eq = strchr(kvpair, '='); /* would love strchrnul */
-        char *value;
-        char *key;
-        void *old_val;
+    /* repeated keys are left to the hashmap, which keeps the last value */
+    if (view_parse(&view, _string, false))
+        goto err_parse;
 
-        if (eq == kvpair)
-            goto next_pair;
+    for (i = 0; i < view.count; i++) {
+        const struct str_parms_pair *pair = &view.pairs[i];
+        char *key = strndup(pair->key.data, pair->key.len);
+        char *value = strndup(pair->value.data, pair->value.len);
+        void *old_val;
 
-        if (eq) {
-            key = strndup(kvpair, eq - kvpair);
-            if (*(++eq))
-                value = strdup(eq);
-            else
-                value = strdup("");
-        } else {
-            key = strdup(kvpair);
-            value = strdup("");
+        if (!key || !value) {
+            free(key);
+            free(value);
+            goto err_parse;
         }
 
         /* if we replaced a value, free it */
@@ -191,20 +183,17 @@ struct str_parms *str_parms_create_str(const char *_string)
         } else {
             RELEASE_OWNERSHIP(key);
         }
-
-        items++;
-next_pair:
-        kvpair = strtok_r(NULL, ";", &tmpstr);
     }
 
-    if (!items)
+    if (!view.count)
         ALOGV("%s: no items found in string\n", __func__);
 
-    free(str);
+    str_parms_view_release(&view);
 
     return str_parms;
 
-err_strdup:
+err_parse:
+    str_parms_view_release(&view);
     str_parms_destroy(str_parms);
 err_create_str_parms:
     return NULL;
@@ -336,37 +325,48 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     return 0;
 }
 
-static bool combine_strings(void *key, void *value, void *context)
+static bool measure_entry(void *key, void *value, void *context)
 {
-    char **old_str = context;
-    char *new_str;
-    int ret;
+    size_t *len = context;
 
-    ret = asprintf(&new_str, "%s%s%s=%s",
-                   *old_str ? *old_str : "",
-                   *old_str ? ";" : "",
-                   (char *)key,
-                   (char *)value);
-    if (*old_str)
-        free(*old_str);
-
-    if (ret >= 0) {
-        *old_str = new_str;
-        return true;
-    }
+    /* "key=value" plus a ';' separator or the terminating NUL */
+    *len += strlen((char *)key) + strlen((char *)value) + 2;
+    return true;
+}
 
-    *old_str = NULL;
-    return false;
+static bool append_entry(void *key, void *value, void *context)
+{
+    char **p = context;
+    size_t key_len = strlen((char *)key);
+    size_t value_len = strlen((char *)value);
+
+    memcpy(*p, key, key_len);
+    (*p)[key_len] = '=';
+    memcpy(*p + key_len + 1, value, value_len);
+    (*p)[key_len + 1 + value_len] = ';';
+    *p += key_len + value_len + 2;
+    return true;
 }
 
 char *str_parms_to_str(struct str_parms *str_parms)
 {
-    char *str = NULL;
+    size_t len = 0;
+    char *str;
+    char *p;
+
+    if (hashmapSize(str_parms->map) == 0)
+        return strdup("");
 
-    if (hashmapSize(str_parms->map) > 0)
-        hashmapForEach(str_parms->map, combine_strings, &str);
-    else
-        str = strdup("");
+    /* size the result first so it is built in a single allocation */
+    hashmapForEach(str_parms->map, measure_entry, &len);
+    str = malloc(len);
+    if (!str)
+        return NULL;
+
+    p = str;
+    hashmapForEach(str_parms->map, append_entry, &p);
+    /* replace the last separator */
+    str[len - 1] = '\0';
     return str;
 }
 
@@ -380,3 +380,189 @@ void str_parms_dump(struct str_parms *str_parms)
 {
     hashmapForEach(str_parms->map, dump_entry, str_parms);
 }
+
+static struct str_parms_pair *view_find(const struct str_parms_view *view,
+                                        const char *key, size_t key_len)
+{
+    size_t i;
+
+    for (i = 0; i < view->count; i++) {
+        struct str_parms_pair *pair = &view->pairs[i];
+        if (pair->key.len == key_len && !memcmp(pair->key.data, key, key_len))
+            return pair;
+    }
+    return NULL;
+}
+
+static int view_grow(struct str_parms_view *view)
+{
+    size_t capacity = view->capacity * 2;
+    struct str_parms_pair *pairs;
+
+    if (view->pairs == view->inline_pairs) {
+        pairs = malloc(capacity * sizeof(*pairs));
+        if (pairs)
+            memcpy(pairs, view->inline_pairs, view->count * sizeof(*pairs));
+    } else {
+        pairs = realloc(view->pairs, capacity * sizeof(*pairs));
+    }
+    if (!pairs)
+        return -ENOMEM;
+
+    view->pairs = pairs;
+    view->capacity = capacity;
+    return 0;
+}
+
+/* With unique_keys, a repeated key replaces the value of its first pair,
+ * which takes a scan of the pairs found so far. */
+static int view_parse(struct str_parms_view *view, const char *string, bool unique_keys)
+{
+    const char *p = string;
+
+    view->pairs = view->inline_pairs;
+    view->count = 0;
+    view->capacity = STR_PARMS_VIEW_INLINE_PAIRS;
+
+    /* same rules as strtok_r(";") in the original parser: empty pairs and
+     * pairs with an empty key are skipped */
+    while (*p) {
+        size_t len = strcspn(p, ";");
+        const char *eq = memchr(p, '=', len);
+
+        if (len && eq != p) {
+            struct str_parms_pair *pair;
+            struct str_parms_span key = { p, eq ? (size_t)(eq - p) : len };
+            struct str_parms_span value = { p + len, 0 };
+
+            if (eq) {
+                value.data = eq + 1;
+                value.len = len - key.len - 1;
+            }
+
+            /* if a key repeats, its last value wins */
+            pair = unique_keys ? view_find(view, key.data, key.len) : NULL;
+            if (!pair) {
+                if (view->count == view->capacity && view_grow(view))
+                    return -ENOMEM;
+                pair = &view->pairs[view->count++];
+                pair->key = key;
+            }
+            pair->value = value;
+        }
+
+        p += len;
+        if (*p)
+            p++;
+    }
+    return 0;
+}
+
+int str_parms_view_init(struct str_parms_view *view, const char *string)
+{
+    return view_parse(view, string, true);
+}
+
+void str_parms_view_release(struct str_parms_view *view)
+{
+    if (view->pairs != view->inline_pairs)
+        free(view->pairs);
+    view->pairs = view->inline_pairs;
+    view->count = 0;
+    view->capacity = STR_PARMS_VIEW_INLINE_PAIRS;
+}
+
+static const struct str_parms_span *view_get(const struct str_parms_view *view,
+                                             const char *key)
+{
+    const struct str_parms_pair *pair = view_find(view, key, strlen(key));
+
+    return pair ? &pair->value : NULL;
+}
+
+int str_parms_view_has_key(const struct str_parms_view *view, const char *key)
+{
+    return view_get(view, key) != NULL;
+}
+
+int str_parms_view_get_str(const struct str_parms_view *view, const char *key,
+                           char *val, int len)
+{
+    const struct str_parms_span *value = view_get(view, key);
+
+    if (!value)
+        return -ENOENT;
+
+    /* strlcpy semantics */
+    if (len > 0) {
+        size_t n = value->len < (size_t)len - 1 ? value->len : (size_t)len - 1;
+        memcpy(val, value->data, n);
+        val[n] = '\0';
+    }
+    return value->len;
+}
+
+/* Numbers are parsed in place: the ';' or NUL that ends a value also stops
+ * strtol/strtof, so a value is valid if they consume all of it. */
+int str_parms_view_get_int(const struct str_parms_view *view, const char *key,
+                           int *val)
+{
+    const struct str_parms_span *value = view_get(view, key);
+    char *end;
+
+    if (!value)
+        return -ENOENT;
+
+    *val = (int)strtol(value->data, &end, 0);
+    if (value->len && end == value->data + value->len)
+        return 0;
+
+    return -EINVAL;
+}
+
+int str_parms_view_get_float(const struct str_parms_view *view, const char *key,
+                             float *val)
+{
+    const struct str_parms_span *value = view_get(view, key);
+    float out;
+    char *end;
+
+    if (!value)
+        return -ENOENT;
+
+    out = strtof(value->data, &end);
+    if (!value->len || end != value->data + value->len)
+        return -EINVAL;
+
+    *val = out;
+    return 0;
+}
+
+/* Appends n bytes at offset *total of buf, always leaving room for the NUL. */
+static void view_append(char *buf, size_t len, size_t *total, const char *data, size_t n)
+{
+    if (*total < len) {
+        size_t room = len - 1 - *total;
+        memcpy(buf + *total, data, n < room ? n : room);
+    }
+    *total += n;
+}
+
+size_t str_parms_view_to_str(const struct str_parms_view *view, char *buf, size_t len)
+{
+    size_t total = 0;
+    size_t i;
+
+    for (i = 0; i < view->count; i++) {
+        const struct str_parms_pair *pair = &view->pairs[i];
+        if (i)
+            view_append(buf, len, &total, ";", 1);
+        view_append(buf, len, &total, pair->key.data, pair->key.len);
+        view_append(buf, len, &total, "=", 1);
+        view_append(buf, len, &total, pair->value.data, pair->value.len);
+    }
+
+    if (len)
+        buf[total < len ? total : len - 1] = '\0';
+    return total;
+}
@@ -19,6 +19,7 @@
 #include <limits.h>
 
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 
@@ -357,4 +358,48 @@ TEST_F(PropertiesTest, GetInt32) {
     }
 }
 
+static void CollectDiff(const char* name, const char* oldValue, const char* newValue,
+                        void* cookie) {
+    auto diff = reinterpret_cast<std::map<std::string, std::string>*>(cookie);
+    (*diff)[name] = std::string(oldValue ? oldValue : "<null>") + " -> " +
+            (newValue ? newValue : "<null>");
+}
+
+TEST_F(PropertiesTest, Snapshot) {
+    ASSERT_OK(property_set(PROPERTY_TEST_KEY, "before"));
+
+    property_snapshot_t* before = property_snapshot_create(NULL);
+    ASSERT_TRUE(before != NULL);
+    EXPECT_STREQ("before", property_snapshot_find(before, PROPERTY_TEST_KEY));
+    EXPECT_EQ(NULL, property_snapshot_find(before, PROPERTY_TEST_KEY ".missing"));
+
+    size_t count;
+    const property_snapshot_entry_t* entries = property_snapshot_entries(before, &count);
+    ASSERT_LT(0U, count);
+    for (size_t i = 1; i < count; ++i) {
+        EXPECT_LT(strcmp(entries[i - 1].name, entries[i].name), 0) << entries[i].name;
+    }
+    for (size_t i = 0; i < count; i += count / 16 + 1) {
+        ResetValue();
+        property_get(entries[i].name, mValue, "");
+        EXPECT_STREQ(mValue, entries[i].value) << entries[i].name;
+    }
+
+    ASSERT_OK(property_set(PROPERTY_TEST_KEY, "after"));
+    EXPECT_EQ(0, property_snapshot_is_current(before));
+
+    property_snapshot_t* after = property_snapshot_create(before);
+    ASSERT_TRUE(after != NULL);
+    EXPECT_STREQ("after", property_snapshot_find(after, PROPERTY_TEST_KEY));
+    // Unchanged by the new snapshot.
+    EXPECT_STREQ("before", property_snapshot_find(before, PROPERTY_TEST_KEY));
+
+    std::map<std::string, std::string> diff;
+    property_snapshot_diff(before, after, CollectDiff, &diff);
+    EXPECT_EQ("before -> after", diff[PROPERTY_TEST_KEY]);
+
+    property_snapshot_free(before);
+    property_snapshot_free(after);
+}
+
 } // namespace android
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/test_utils.h>
+#include <benchmark/benchmark.h>
+#include <private/android_filesystem_config.h>
+
+using android::base::StringPrintf;
+
+// Roughly the shape of a system image: many apps and libraries, fewer binaries.
+static const std::vector<std::string>& SystemImagePaths() {
+    static std::vector<std::string> paths;
+    if (paths.empty()) {
+        for (int i = 0; i < 400; i++) {
+            paths.push_back(StringPrintf("system/app/App%d/App%d.apk", i, i));
+            paths.push_back(StringPrintf("system/app/App%d/oat/arm64/App%d.odex", i, i));
+            paths.push_back(StringPrintf("system/priv-app/Priv%d/Priv%d.apk", i, i));
+            paths.push_back(StringPrintf("system/framework/framework%d.jar", i));
+        }
+        for (int i = 0; i < 1000; i++) {
+            paths.push_back(StringPrintf("system/lib/lib%d.so", i));
+            paths.push_back(StringPrintf("system/lib64/lib%d.so", i));
+            paths.push_back(StringPrintf("vendor/lib/hw/hal%d.so", i));
+            paths.push_back(StringPrintf("system/usr/share/zoneinfo/%d", i));
+        }
+        for (int i = 0; i < 300; i++) {
+            paths.push_back(StringPrintf("system/bin/tool%d", i));
+            paths.push_back(StringPrintf("system/xbin/tool%d", i));
+            paths.push_back(StringPrintf("system/etc/init/service%d.rc", i));
+        }
+        paths.push_back("system/bin/run-as");
+        paths.push_back("system/bin/logd");
+        paths.push_back("system/etc/ppp/ip-up");
+    }
+    return paths;
+}
+
+// Writes |count| generated rules as target_out_path/etc/fs_config_files.
+static void WriteConfig(const char* target_out_path, int count) {
+    std::string content;
+    for (int i = 0; i < count; i++) {
+        std::string prefix = (i % 4) ? StringPrintf("vendor/bin/hw/service%d", i)
+                                     : StringPrintf("vendor/etc/conf%d/*", i);
+        fs_path_config pc = { 00755, AID_ROOT, AID_SHELL, 0, prefix.c_str() };
+        char buffer[512];
+        ssize_t len = fs_config_generate(buffer, sizeof(buffer), &pc);
+        if (len > 0) content.append(buffer, len);
+    }
+    std::string etc = std::string(target_out_path) + "/etc";
+    mkdir(etc.c_str(), 0755);
+    android::base::WriteStringToFile(content, etc + "/fs_config_files");
+}
+
+static void RemoveConfig(const char* target_out_path) {
+    std::string etc = std::string(target_out_path) + "/etc";
+    unlink((etc + "/fs_config_files").c_str());
+    rmdir(etc.c_str());
+}
+
+static void LookupAll(benchmark::State& state, const char* target_out_path) {
+    const std::vector<std::string>& paths = SystemImagePaths();
+    unsigned uid, gid, mode = 0;
+    uint64_t capabilities;
+
+    while (state.KeepRunning()) {
+        for (const auto& path : paths) {
+            fs_config(path.c_str(), 0, target_out_path, &uid, &gid, &mode, &capabilities);
+        }
+    }
+    benchmark::DoNotOptimize(mode);
+    state.SetItemsProcessed(state.iterations() * paths.size());
+}
+
+// Looks up every file in the image against the built-in rules only.
+static void BM_fs_config_builtin(benchmark::State& state) {
+    LookupAll(state, nullptr);
+}
+BENCHMARK(BM_fs_config_builtin);
+
+// Looks up every file in the image with state.range(0) extra rules from a config file.
+static void BM_fs_config_with_file(benchmark::State& state) {
+    TemporaryDir td;
+    WriteConfig(td.path, state.range(0));
+    LookupAll(state, td.path);
+    RemoveConfig(td.path);
+}
+BENCHMARK(BM_fs_config_with_file)->Arg(10)->Arg(100)->Arg(1000);
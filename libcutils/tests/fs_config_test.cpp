@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+#include <private/android_filesystem_config.h>
+
+struct FsConfigResult {
+    unsigned uid;
+    unsigned gid;
+    unsigned mode;
+    uint64_t capabilities;
+};
+
+static FsConfigResult Lookup(const char* path, bool dir, const char* target_out_path) {
+    FsConfigResult result = {};
+    result.mode = dir ? S_IFDIR : S_IFREG;
+    fs_config(path, dir, target_out_path, &result.uid, &result.gid, &result.mode,
+              &result.capabilities);
+    return result;
+}
+
+// Writes |rules| where fs_config() looks for the system config file under target_out_path.
+static void WriteConfig(const std::string& target_out_path, bool dir,
+                        const std::vector<fs_path_config>& rules) {
+    std::string content;
+    for (const auto& rule : rules) {
+        char buffer[512];
+        ssize_t len = fs_config_generate(buffer, sizeof(buffer), &rule);
+        ASSERT_GT(len, 0);
+        content.append(buffer, len);
+    }
+    std::string etc = target_out_path + "/etc";
+    mkdir(etc.c_str(), 0755);
+    // Replace the file rather than rewrite it so that the change is always visible.
+    std::string name = etc + (dir ? "/fs_config_dirs" : "/fs_config_files");
+    std::string tmp = name + ".tmp";
+    ASSERT_TRUE(android::base::WriteStringToFile(content, tmp));
+    ASSERT_EQ(0, rename(tmp.c_str(), name.c_str()));
+}
+
+static void RemoveConfig(const std::string& target_out_path) {
+    std::string etc = target_out_path + "/etc";
+    unlink((etc + "/fs_config_dirs").c_str());
+    unlink((etc + "/fs_config_files").c_str());
+    rmdir(etc.c_str());
+}
+
+// The first rule in |rules| that matches |path|, following the documented rules.
+static const fs_path_config* FirstMatch(const std::vector<fs_path_config>& rules, bool dir,
+                                        const std::string& path) {
+    for (const auto& rule : rules) {
+        std::string prefix(rule.prefix);
+        if (dir) {
+            if (path.compare(0, prefix.size(), prefix) == 0) return &rule;
+        } else if (!prefix.empty() && prefix.back() == '*') {
+            if (path.compare(0, prefix.size() - 1, prefix, 0, prefix.size() - 1) == 0) return &rule;
+        } else if (path == prefix) {
+            return &rule;
+        }
+    }
+    return nullptr;
+}
+
+TEST(fs_config, builtin_rules) {
+    FsConfigResult result = Lookup("/data/app/com.example.apk", false, nullptr);
+    EXPECT_EQ(static_cast<unsigned>(AID_SYSTEM), result.uid);
+    EXPECT_EQ(static_cast<unsigned>(S_IFREG | 00644), result.mode);
+
+    result = Lookup("system/bin/run-as", false, nullptr);
+    EXPECT_NE(0U, result.capabilities);
+
+    result = Lookup("system/bin/sh", false, nullptr);
+    EXPECT_EQ(0U, result.capabilities);
+    EXPECT_EQ(static_cast<unsigned>(AID_SHELL), result.gid);
+
+    result = Lookup("data/app", true, nullptr);
+    EXPECT_EQ(static_cast<unsigned>(AID_SYSTEM), result.uid);
+    EXPECT_EQ(static_cast<unsigned>(S_IFDIR | 00771), result.mode);
+
+    result = Lookup("no/such/dir", true, nullptr);
+    EXPECT_EQ(static_cast<unsigned>(AID_ROOT), result.uid);
+    EXPECT_EQ(static_cast<unsigned>(S_IFDIR | 00755), result.mode);
+}
+
+TEST(fs_config, config_file_matches_first_rule) {
+    TemporaryDir td;
+    const std::vector<fs_path_config> files = {
+        { 00600, 1001, 1001, 0, "system/bin/exact" },
+        { 00640, 1002, 1002, 0, "system/bin/ex*" },
+        { 00700, 1003, 1003, 0, "system/bin/exact" },
+        { 00750, 1004, 1004, 0x10, "system/*" },
+        { 00755, 1005, 1005, 0, "system/bin/*" },
+        { 00444, 1006, 1006, 0, "*" },
+    };
+    const std::vector<fs_path_config> dirs = {
+        { 00700, 1011, 1011, 0, "data/misc/secret" },
+        { 00750, 1012, 1012, 0, "data/misc" },
+        { 00755, 1013, 1013, 0, "data/misc/secret/inner" },
+        { 00711, 1014, 1014, 0, "system" },
+    };
+    WriteConfig(td.path, false, files);
+    WriteConfig(td.path, true, dirs);
+
+    const std::vector<std::string> paths = {
+        "", "system", "system/", "system/bin/exact", "system/bin/exactly", "system/bin/e",
+        "system/bin/sh", "vendor/lib/libfoo.so", "data/misc", "data/misc/secret",
+        "data/misc/secret/inner", "data/misc/secrets", "data/mis", "systemx", "system/bin",
+    };
+    for (bool dir : {false, true}) {
+        const auto& rules = dir ? dirs : files;
+        for (const auto& path : paths) {
+            SCOPED_TRACE(path + (dir ? " (dir)" : " (file)"));
+            FsConfigResult result = Lookup(path.c_str(), dir, td.path);
+            FsConfigResult expected;
+            const fs_path_config* rule = FirstMatch(rules, dir, path);
+            if (rule) {
+                expected.uid = rule->uid;
+                expected.gid = rule->gid;
+                expected.mode = (dir ? S_IFDIR : S_IFREG) | rule->mode;
+                expected.capabilities = rule->capabilities;
+            } else {
+                expected = Lookup(path.c_str(), dir, nullptr);
+            }
+            EXPECT_EQ(expected.uid, result.uid);
+            EXPECT_EQ(expected.gid, result.gid);
+            EXPECT_EQ(expected.mode, result.mode);
+            EXPECT_EQ(expected.capabilities, result.capabilities);
+        }
+    }
+    RemoveConfig(td.path);
+}
+
+TEST(fs_config, config_file_change_is_noticed) {
+    TemporaryDir td;
+    WriteConfig(td.path, false, { { 00600, 1001, 1001, 0, "system/bin/tool" } });
+    EXPECT_EQ(1001U, Lookup("system/bin/tool", false, td.path).uid);
+
+    WriteConfig(td.path, false, { { 00600, 1002, 1002, 0, "system/bin/tool" } });
+    EXPECT_EQ(1002U, Lookup("system/bin/tool", false, td.path).uid);
+
+    // Falls back to the built-in rules once the file is gone.
+    std::string name = std::string(td.path) + "/etc/fs_config_files";
+    ASSERT_EQ(0, unlink(name.c_str()));
+    EXPECT_EQ(Lookup("system/bin/tool", false, nullptr).uid,
+              Lookup("system/bin/tool", false, td.path).uid);
+    RemoveConfig(td.path);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <cutils/hashmap.h>
+
+static const int kKeys = 4096;
+
+static std::vector<int>& Keys() {
+    static std::vector<int> keys;
+    if (keys.empty()) {
+        for (int i = 0; i < kKeys; i++) {
+            keys.push_back(i * 7919);
+        }
+    }
+    return keys;
+}
+
+// Fills an empty map with kKeys entries.
+static void BM_hashmap_put(benchmark::State& state) {
+    std::vector<int>& keys = Keys();
+    while (state.KeepRunning()) {
+        Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+        for (int& key : keys) {
+            hashmapPut(map, &key, &key);
+        }
+        hashmapFree(map);
+    }
+    state.SetItemsProcessed(state.iterations() * kKeys);
+}
+BENCHMARK(BM_hashmap_put);
+
+static Hashmap* gMap;
+
+static void SetUpMap(benchmark::State& state, bool concurrent) {
+    if (state.thread_index == 0) {
+        gMap = concurrent ? hashmapCreateConcurrent(0, hashmapIntHash, hashmapIntEquals)
+                          : hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+        for (int& key : Keys()) {
+            hashmapPut(gMap, &key, &key);
+        }
+    }
+}
+
+static void TearDownMap(benchmark::State& state) {
+    if (state.thread_index == 0) {
+        hashmapFree(gMap);
+    }
+}
+
+// Looks up every key from each thread, taking the lock around each get.
+static void BM_hashmap_get_locked(benchmark::State& state) {
+    SetUpMap(state, false);
+    std::vector<int>& keys = Keys();
+    while (state.KeepRunning()) {
+        for (int& key : keys) {
+            hashmapLock(gMap);
+            benchmark::DoNotOptimize(hashmapGet(gMap, &key));
+            hashmapUnlock(gMap);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kKeys);
+    TearDownMap(state);
+}
+BENCHMARK(BM_hashmap_get_locked)->ThreadRange(1, 8)->UseRealTime();
+
+// Looks up every key from each thread without the lock.
+static void BM_hashmap_get_concurrent(benchmark::State& state) {
+    SetUpMap(state, true);
+    std::vector<int>& keys = Keys();
+    while (state.KeepRunning()) {
+        for (int& key : keys) {
+            benchmark::DoNotOptimize(hashmapGet(gMap, &key));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kKeys);
+    TearDownMap(state);
+}
+BENCHMARK(BM_hashmap_get_concurrent)->ThreadRange(1, 8)->UseRealTime();
+
+// As above, with thread 0 rewriting every value under the lock instead of reading.
+static void BM_hashmap_get_concurrent_with_writer(benchmark::State& state) {
+    SetUpMap(state, true);
+    std::vector<int>& keys = Keys();
+    while (state.KeepRunning()) {
+        if (state.thread_index == 0) {
+            hashmapLock(gMap);
+            for (int& key : keys) {
+                hashmapPut(gMap, &key, &key);
+            }
+            hashmapUnlock(gMap);
+        } else {
+            for (int& key : keys) {
+                benchmark::DoNotOptimize(hashmapGet(gMap, &key));
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kKeys);
+    TearDownMap(state);
+}
+BENCHMARK(BM_hashmap_get_concurrent_with_writer)->ThreadRange(2, 8)->UseRealTime();
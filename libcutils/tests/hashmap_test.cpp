@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <cutils/hashmap.h>
+#include <gtest/gtest.h>
+
+static void* AsValue(intptr_t i) {
+    return reinterpret_cast<void*>(i);
+}
+
+// Hashes everything into the same bucket.
+static int ConstantHash(void*) {
+    return 42;
+}
+
+static bool RemoveEven(void* key, void*, void* context) {
+    Hashmap* map = static_cast<Hashmap*>(context);
+    if (*static_cast<int*>(key) % 2 == 0) {
+        hashmapRemove(map, key);
+    }
+    return true;
+}
+
+static bool CollectKeys(void* key, void*, void* context) {
+    static_cast<std::set<int>*>(context)->insert(*static_cast<int*>(key));
+    return true;
+}
+
+static void* InitialValue(void* key, void* context) {
+    (*static_cast<int*>(context))++;
+    return AsValue(*static_cast<int*>(key) * 10);
+}
+
+TEST(hashmap, put_get_remove) {
+    std::vector<int> keys(1000);
+    Hashmap* map = hashmapCreate(4, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != NULL);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        keys[i] = i;
+        EXPECT_EQ(NULL, hashmapPut(map, &keys[i], AsValue(i + 1)));
+    }
+    EXPECT_EQ(keys.size(), hashmapSize(map));
+    EXPECT_LE(keys.size(), hashmapCurrentCapacity(map));
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        int key = i;
+        EXPECT_EQ(AsValue(i + 1), hashmapGet(map, &key));
+        EXPECT_TRUE(hashmapContainsKey(map, &key));
+    }
+    int missing = -1;
+    EXPECT_EQ(NULL, hashmapGet(map, &missing));
+    EXPECT_FALSE(hashmapContainsKey(map, &missing));
+
+    EXPECT_EQ(AsValue(6), hashmapPut(map, &keys[5], AsValue(600)));
+    EXPECT_EQ(AsValue(600), hashmapGet(map, &keys[5]));
+    EXPECT_EQ(keys.size(), hashmapSize(map));
+
+    for (size_t i = 0; i < keys.size(); i += 3) {
+        void* value = hashmapGet(map, &keys[i]);
+        EXPECT_EQ(value, hashmapRemove(map, &keys[i]));
+    }
+    EXPECT_EQ(NULL, hashmapRemove(map, &keys[0]));
+    for (size_t i = 0; i < keys.size(); i++) {
+        EXPECT_EQ(i % 3 != 0, hashmapContainsKey(map, &keys[i]));
+    }
+
+    hashmapFree(map);
+}
+
+TEST(hashmap, remove_during_for_each) {
+    std::vector<int> keys(100);
+    Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+    for (size_t i = 0; i < keys.size(); i++) {
+        keys[i] = i;
+        hashmapPut(map, &keys[i], AsValue(i));
+    }
+
+    hashmapForEach(map, RemoveEven, map);
+    std::set<int> remaining;
+    hashmapForEach(map, CollectKeys, &remaining);
+
+    EXPECT_EQ(keys.size() / 2, hashmapSize(map));
+    EXPECT_EQ(keys.size() / 2, remaining.size());
+    for (int key : remaining) {
+        EXPECT_EQ(1, key % 2);
+    }
+    hashmapFree(map);
+}
+
+TEST(hashmap, colliding_keys) {
+    std::vector<int> keys(64);
+    Hashmap* map = hashmapCreate(0, ConstantHash, hashmapIntEquals);
+    for (size_t i = 0; i < keys.size(); i++) {
+        keys[i] = i;
+        hashmapPut(map, &keys[i], AsValue(i));
+    }
+    EXPECT_EQ(keys.size() - 1, hashmapCountCollisions(map));
+
+    // Reinserting removed keys reuses their buckets rather than growing without bound.
+    for (int round = 0; round < 100; round++) {
+        for (size_t i = 0; i < keys.size(); i += 2) {
+            hashmapRemove(map, &keys[i]);
+        }
+        for (size_t i = 0; i < keys.size(); i += 2) {
+            hashmapPut(map, &keys[i], AsValue(i));
+        }
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        EXPECT_EQ(AsValue(i), hashmapGet(map, &keys[i]));
+    }
+    EXPECT_GE(4 * keys.size(), hashmapCurrentCapacity(map));
+    hashmapFree(map);
+}
+
+TEST(hashmap, memoize) {
+    int key = 7;
+    int calls = 0;
+    Hashmap* map = hashmapCreate(0, hashmapIntHash, hashmapIntEquals);
+    EXPECT_EQ(AsValue(70), hashmapMemoize(map, &key, InitialValue, &calls));
+    EXPECT_EQ(AsValue(70), hashmapMemoize(map, &key, InitialValue, &calls));
+    EXPECT_EQ(1, calls);
+    EXPECT_EQ(1U, hashmapSize(map));
+    hashmapFree(map);
+}
+
+TEST(hashmap, concurrent_reads) {
+    const int kKeys = 10000;
+    std::vector<int> keys(kKeys);
+    for (int i = 0; i < kKeys; i++) {
+        keys[i] = i;
+    }
+    Hashmap* map = hashmapCreateConcurrent(0, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != NULL);
+
+    // Even keys are present from the start; odd keys come and go while readers run.
+    for (int i = 0; i < kKeys; i += 2) {
+        hashmapPut(map, &keys[i], AsValue(i + 1));
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<int> errors(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&]() {
+            while (!done) {
+                for (int i = 0; i < kKeys; i++) {
+                    int key = i;
+                    void* value = hashmapGet(map, &key);
+                    if ((i % 2 == 0 && value != AsValue(i + 1)) ||
+                        (value != NULL && value != AsValue(i + 1))) {
+                        errors++;
+                    }
+                }
+            }
+        });
+    }
+
+    for (int round = 0; round < 20; round++) {
+        hashmapLock(map);
+        for (int i = 1; i < kKeys; i += 2) {
+            hashmapPut(map, &keys[i], AsValue(i + 1));
+        }
+        hashmapUnlock(map);
+        hashmapLock(map);
+        for (int i = 1; i < kKeys; i += 2) {
+            hashmapRemove(map, &keys[i]);
+        }
+        hashmapUnlock(map);
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    EXPECT_EQ(0, errors.load());
+    EXPECT_EQ(static_cast<size_t>(kKeys / 2), hashmapSize(map));
+    hashmapFree(map);
+}
+
+// Returns the peak resident set size in KiB.
+static long PeakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// Tests that tables replaced by rebuilds are freed even though readers never leave the map.
+TEST(hashmap, churn_under_readers_bounds_memory) {
+    const int kKeys = 1 << 16;
+    std::vector<int> keys(kKeys);
+    for (int i = 0; i < kKeys; i++) {
+        keys[i] = i;
+    }
+    Hashmap* map = hashmapCreateConcurrent(0, hashmapIntHash, hashmapIntEquals);
+    ASSERT_TRUE(map != NULL);
+    for (int i = 0; i < kKeys; i += 2) {
+        hashmapPut(map, &keys[i], AsValue(i + 1));
+    }
+
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&, t]() {
+            for (int i = t; !done; i = (i + 1) % kKeys) {
+                hashmapGet(map, &keys[i]);
+            }
+        });
+    }
+
+    // Each round leaves enough tombstones behind to rebuild the whole table,
+    // whose buckets for 2^16 keys take a few MiB.
+    long before = PeakRssKb();
+    for (int round = 0; round < 50; round++) {
+        hashmapLock(map);
+        for (int i = 1; i < kKeys; i += 2) {
+            hashmapPut(map, &keys[i], AsValue(i + 1));
+        }
+        for (int i = 1; i < kKeys; i += 2) {
+            hashmapRemove(map, &keys[i]);
+        }
+        hashmapUnlock(map);
+    }
+    long growth = PeakRssKb() - before;
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    // Keeping every replaced table would take hundreds of MiB.
+    EXPECT_LT(growth, 32 * 1024) << "peak RSS grew by " << growth << " KiB";
+    EXPECT_EQ(static_cast<size_t>(kKeys / 2), hashmapSize(map));
+    hashmapFree(map);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <benchmark/benchmark.h>
+#include <cutils/str_parms.h>
+
+// A typical set_parameters() call from AudioFlinger.
+static const char kParams[] =
+        "routing=2;input_source=1;sampling_rate=48000;format=1;channels=3;"
+        "frame_count=960;bt_headset_name=Car Kit;screen_state=on;";
+
+// Parses kParams and reads three values through the Hashmap-backed API.
+static void BM_str_parms_parse(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        int routing, rate;
+        char name[32];
+        struct str_parms* parms = str_parms_create_str(kParams);
+        str_parms_get_int(parms, "routing", &routing);
+        str_parms_get_int(parms, "sampling_rate", &rate);
+        str_parms_get_str(parms, "bt_headset_name", name, sizeof(name));
+        str_parms_destroy(parms);
+    }
+}
+BENCHMARK(BM_str_parms_parse);
+
+// Does the same through a str_parms_view.
+static void BM_str_parms_view_parse(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        int routing, rate;
+        char name[32];
+        struct str_parms_view view;
+        str_parms_view_init(&view, kParams);
+        str_parms_view_get_int(&view, "routing", &routing);
+        str_parms_view_get_int(&view, "sampling_rate", &rate);
+        str_parms_view_get_str(&view, "bt_headset_name", name, sizeof(name));
+        str_parms_view_release(&view);
+    }
+}
+BENCHMARK(BM_str_parms_view_parse);
+
+static void BM_str_parms_to_str(benchmark::State& state) {
+    struct str_parms* parms = str_parms_create_str(kParams);
+    while (state.KeepRunning()) {
+        free(str_parms_to_str(parms));
+    }
+    str_parms_destroy(parms);
+}
+BENCHMARK(BM_str_parms_to_str);
+
+static void BM_str_parms_view_to_str(benchmark::State& state) {
+    struct str_parms_view view;
+    char buf[256];
+    str_parms_view_init(&view, kParams);
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(str_parms_view_to_str(&view, buf, sizeof(buf)));
+    }
+    str_parms_view_release(&view);
+}
+BENCHMARK(BM_str_parms_view_to_str);
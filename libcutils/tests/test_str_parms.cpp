@@ -14,6 +14,11 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <string.h>
+
+#include <string>
+
 #include <cutils/str_parms.h>
 #include <gtest/gtest.h>
 
@@ -55,3 +60,112 @@ TEST(str_parms, put_ENOMEM) {
     ASSERT_EQ(ENOMEM, errno);
     test_str_parms_str("foo=bar;baz=", "foo=bar;baz=");
 }
+
+static void test_str_parms_view_str(const char* str, const char* expected) {
+    str_parms_view view;
+    ASSERT_EQ(0, str_parms_view_init(&view, str)) << str;
+    char buf[256];
+    size_t len = str_parms_view_to_str(&view, buf, sizeof(buf));
+    str_parms_view_release(&view);
+    ASSERT_STREQ(expected, buf) << str;
+    ASSERT_EQ(strlen(expected), len) << str;
+}
+
+TEST(str_parms, view_smoke) {
+    test_str_parms_view_str("", "");
+    test_str_parms_view_str(";", "");
+    test_str_parms_view_str("=", "");
+    test_str_parms_view_str("=;", "");
+    test_str_parms_view_str("=bar", "");
+    test_str_parms_view_str("=bar;", "");
+    test_str_parms_view_str("foo=", "foo=");
+    test_str_parms_view_str("foo=;", "foo=");
+    test_str_parms_view_str("foo=bar", "foo=bar");
+    test_str_parms_view_str(";;foo=bar;;", "foo=bar");
+    test_str_parms_view_str("foo=bar;baz", "foo=bar;baz=");
+    test_str_parms_view_str("foo=bar;baz=bat", "foo=bar;baz=bat");
+    test_str_parms_view_str("foo=a=b", "foo=a=b");
+    test_str_parms_view_str("foo=bar1;baz=bat;foo=bar2", "foo=bar2;baz=bat");
+}
+
+TEST(str_parms, view_get) {
+    str_parms_view view;
+    ASSERT_EQ(0, str_parms_view_init(&view, "rate=48000;gain=0.5;name=speaker;bad=12x;empty="));
+
+    int i = 0;
+    float f = 0;
+    char buf[8];
+    EXPECT_TRUE(str_parms_view_has_key(&view, "rate"));
+    EXPECT_FALSE(str_parms_view_has_key(&view, "rat"));
+    EXPECT_EQ(0, str_parms_view_get_int(&view, "rate", &i));
+    EXPECT_EQ(48000, i);
+    EXPECT_EQ(0, str_parms_view_get_float(&view, "gain", &f));
+    EXPECT_FLOAT_EQ(0.5f, f);
+    EXPECT_EQ(-EINVAL, str_parms_view_get_int(&view, "bad", &i));
+    EXPECT_EQ(-EINVAL, str_parms_view_get_int(&view, "empty", &i));
+    EXPECT_EQ(-EINVAL, str_parms_view_get_float(&view, "name", &f));
+    EXPECT_EQ(-ENOENT, str_parms_view_get_int(&view, "missing", &i));
+
+    // Truncates like strlcpy and returns the full length.
+    EXPECT_EQ(7, str_parms_view_get_str(&view, "name", buf, sizeof(buf)));
+    EXPECT_STREQ("speaker", buf);
+    EXPECT_EQ(7, str_parms_view_get_str(&view, "name", buf, 4));
+    EXPECT_STREQ("spe", buf);
+    EXPECT_EQ(0, str_parms_view_get_str(&view, "empty", buf, sizeof(buf)));
+    EXPECT_STREQ("", buf);
+    EXPECT_EQ(-ENOENT, str_parms_view_get_str(&view, "missing", buf, sizeof(buf)));
+
+    str_parms_view_release(&view);
+}
+
+TEST(str_parms, view_many_pairs) {
+    std::string str;
+    for (int i = 0; i < 3 * STR_PARMS_VIEW_INLINE_PAIRS; i++) {
+        str += "key" + std::to_string(i) + "=" + std::to_string(i) + ";";
+    }
+    str_parms_view view;
+    ASSERT_EQ(0, str_parms_view_init(&view, str.c_str()));
+    ASSERT_EQ(3U * STR_PARMS_VIEW_INLINE_PAIRS, view.count);
+    for (int i = 0; i < 3 * STR_PARMS_VIEW_INLINE_PAIRS; i++) {
+        int value = -1;
+        EXPECT_EQ(0, str_parms_view_get_int(&view, ("key" + std::to_string(i)).c_str(), &value));
+        EXPECT_EQ(i, value);
+    }
+
+    // Reports the full length when the buffer is too small.
+    char buf[10];
+    size_t len = str_parms_view_to_str(&view, buf, sizeof(buf));
+    EXPECT_EQ(str.size() - 1, len);
+    EXPECT_STREQ("key0=0;ke", buf);
+    str_parms_view_release(&view);
+}
+
+TEST(str_parms, view_long_numbers) {
+    // Values longer than any fixed-size copy; strtol skips the leading spaces.
+    std::string str = "int=" + std::string(100, ' ') + "42;float=" + std::string(100, '0') + "1.5";
+    str_parms_view view;
+    ASSERT_EQ(0, str_parms_view_init(&view, str.c_str()));
+    int i = 0;
+    EXPECT_EQ(0, str_parms_view_get_int(&view, "int", &i));
+    EXPECT_EQ(42, i);
+    float f = 0;
+    EXPECT_EQ(0, str_parms_view_get_float(&view, "float", &f));
+    EXPECT_EQ(1.5f, f);
+    str_parms_view_release(&view);
+}
+
+TEST(str_parms, create_str_repeated_keys) {
+    // Many pairs, most of them repeats: the last value of each key wins.
+    std::string str;
+    for (int i = 0; i < 10000; i++) {
+        str += "key" + std::to_string(i % 100) + "=" + std::to_string(i) + ";";
+    }
+    str_parms* str_parms = str_parms_create_str(str.c_str());
+    ASSERT_TRUE(str_parms != NULL);
+    for (int i = 0; i < 100; i++) {
+        int value = -1;
+        EXPECT_EQ(0, str_parms_get_int(str_parms, ("key" + std::to_string(i)).c_str(), &value));
+        EXPECT_EQ(9900 + i, value);
+    }
+    str_parms_destroy(str_parms);
+}
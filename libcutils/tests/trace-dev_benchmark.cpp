@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../trace-dev.c"
+
+// Points the marker fd at /dev/null so that only the cost of building and
+// issuing each marker is measured, not ftrace itself.
+class ScopedNullMarker {
+  public:
+    ScopedNullMarker() : saved_fd_(atrace_marker_fd) {
+        atrace_marker_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    }
+    ~ScopedNullMarker() {
+        close(atrace_marker_fd);
+        atrace_marker_fd = saved_fd_;
+    }
+
+  private:
+    int saved_fd_;
+};
+
+static void BM_atrace_begin_end(benchmark::State& state) {
+    ScopedNullMarker marker;
+    while (state.KeepRunning()) {
+        atrace_begin_body("BM_atrace_begin_end");
+        atrace_end_body();
+    }
+}
+BENCHMARK(BM_atrace_begin_end);
+
+static void BM_atrace_async_begin(benchmark::State& state) {
+    ScopedNullMarker marker;
+    int32_t cookie = 0;
+    while (state.KeepRunning()) {
+        atrace_async_begin_body("BM_atrace_async_begin", cookie++);
+    }
+}
+BENCHMARK(BM_atrace_async_begin);
+
+static void BM_atrace_int64(benchmark::State& state) {
+    ScopedNullMarker marker;
+    int64_t value = -17179869183LL;
+    while (state.KeepRunning()) {
+        atrace_int64_body("BM_atrace_int64", value++);
+    }
+}
+BENCHMARK(BM_atrace_int64);
@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <memory>
@@ -293,3 +295,41 @@ TEST_F(TraceDevTest, atrace_int64_body_truncated) {
   expected += android::base::StringPrintf("%.*s|17179869183", expected_len, name.c_str());
   ASSERT_STREQ(expected.c_str(), actual.c_str());
 }
+
+TEST_F(TraceDevTest, atrace_int64_body_extremes) {
+  atrace_int64_body("min", INT64_MIN);
+  atrace_int64_body("zero", 0);
+  atrace_int64_body("max", INT64_MAX);
+
+  ASSERT_EQ(0, lseek(atrace_marker_fd, 0, SEEK_SET));
+
+  std::string actual;
+  ASSERT_TRUE(android::base::ReadFdToString(atrace_marker_fd, &actual));
+  std::string expected = android::base::StringPrintf(
+      "C|%d|min|-9223372036854775808C|%d|zero|0C|%d|max|9223372036854775807",
+      getpid(), getpid(), getpid());
+  ASSERT_STREQ(expected.c_str(), actual.c_str());
+}
+
+TEST_F(TraceDevTest, atrace_begin_body_after_fork) {
+  // Caches the parent's pid.
+  atrace_begin_body("parent");
+
+  pid_t pid = fork();
+  ASSERT_NE(-1, pid);
+  if (pid == 0) {
+    lseek(atrace_marker_fd, 0, SEEK_SET);
+    atrace_begin_body("child");
+    _exit(0);
+  }
+  int status;
+  ASSERT_EQ(pid, waitpid(pid, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+
+  ASSERT_EQ(0, lseek(atrace_marker_fd, 0, SEEK_SET));
+
+  std::string actual;
+  ASSERT_TRUE(android::base::ReadFdToString(atrace_marker_fd, &actual));
+  std::string expected = android::base::StringPrintf("B|%d|child", pid);
+  ASSERT_EQ(expected, actual.substr(0, expected.length()));
+}
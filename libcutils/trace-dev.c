@@ -45,6 +45,8 @@ static bool             atrace_is_debuggable = false;
 static atomic_bool      atrace_is_enabled    = ATOMIC_VAR_INIT(true);
 static pthread_once_t   atrace_once_control  = PTHREAD_ONCE_INIT;
 static pthread_mutex_t  atrace_tags_mutex    = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int       atrace_pid           = ATOMIC_VAR_INIT(0);
+static pthread_once_t   atrace_atfork_control = PTHREAD_ONCE_INIT;
 
 // Set whether this process is debuggable, which determines whether
 // application-level tracing is allowed when the ro.debuggable system property
@@ -178,56 +180,115 @@ void atrace_setup()
     pthread_once(&atrace_once_control, atrace_init_once);
 }
 
-void atrace_begin_body(const char* name)
+static void atrace_forget_pid()
+{
+    atomic_store_explicit(&atrace_pid, 0, memory_order_relaxed);
+}
+
+static void atrace_register_atfork()
+{
+    pthread_atfork(NULL, NULL, atrace_forget_pid);
+}
+
+// Returns this process's pid without a getpid() call on every marker. The
+// cached value is dropped in the child after fork().
+static pid_t atrace_get_pid()
+{
+    pid_t pid = atomic_load_explicit(&atrace_pid, memory_order_relaxed);
+    if (CC_UNLIKELY(pid == 0)) {
+        pthread_once(&atrace_atfork_control, atrace_register_atfork);
+        pid = getpid();
+        atomic_store_explicit(&atrace_pid, pid, memory_order_relaxed);
+    }
+    return pid;
+}
+
+// Writes the decimal form of value to buf, which must have room for 20
+// characters, and returns the number of characters written.
+static size_t atrace_format_int64(char* buf, int64_t value)
+{
+    char digits[20];
+    size_t count = 0;
+    size_t len = 0;
+    uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0) {
+        buf[len++] = '-';
+    }
+    while (count > 0) {
+        buf[len++] = digits[--count];
+    }
+    return len;
+}
+
+// Writes "<type>|<pid>|<name>" and, if has_value is set, "|<value>" as one
+// marker, truncating the name so that the marker fits in
+// ATRACE_MESSAGE_LENGTH - 1 characters. The marker is formatted by hand since
+// snprintf() costs more than the write() itself on this path.
+static void atrace_write_msg(char type, const char* name, bool has_value, int64_t value,
+                             const char* caller)
 {
     char buf[ATRACE_MESSAGE_LENGTH];
+    char suffix[22];
+    size_t suffix_len = 0;
+    size_t len = 0;
+
+    buf[len++] = type;
+    buf[len++] = '|';
+    len += atrace_format_int64(buf + len, atrace_get_pid());
+    buf[len++] = '|';
+
+    if (has_value) {
+        suffix[suffix_len++] = '|';
+        suffix_len += atrace_format_int64(suffix + suffix_len, value);
+    }
 
-    int len = snprintf(buf, sizeof(buf), "B|%d|%s", getpid(), name);
-    if (len >= (int) sizeof(buf)) {
-        ALOGW("Truncated name in %s: %s\n", __FUNCTION__, name);
-        len = sizeof(buf) - 1;
+    size_t room = sizeof(buf) - 1 - len - suffix_len;
+    size_t name_len = strnlen(name, room + 1);
+    if (name_len > room) {
+        ALOGW("Truncated name in %s: %s\n", caller, name);
+        name_len = room;
     }
+    memcpy(buf + len, name, name_len);
+    len += name_len;
+    memcpy(buf + len, suffix, suffix_len);
+    len += suffix_len;
+
     write(atrace_marker_fd, buf, len);
 }
 
+void atrace_begin_body(const char* name)
+{
+    atrace_write_msg('B', name, false, 0, __FUNCTION__);
+}
+
 void atrace_end_body()
 {
     char c = 'E';
     write(atrace_marker_fd, &c, 1);
 }
 
-#define WRITE_MSG(format_begin, format_end, pid, name, value) { \
-    char buf[ATRACE_MESSAGE_LENGTH]; \
-    int len = snprintf(buf, sizeof(buf), format_begin "%s" format_end, pid, \
-        name, value); \
-    if (len >= (int) sizeof(buf)) { \
-        /* Given the sizeof(buf), and all of the current format buffers, \
-         * it is impossible for name_len to be < 0 if len >= sizeof(buf). */ \
-        int name_len = strlen(name) - (len - sizeof(buf)) - 1; \
-        /* Truncate the name to make the message fit. */ \
-        ALOGW("Truncated name in %s: %s\n", __FUNCTION__, name); \
-        len = snprintf(buf, sizeof(buf), format_begin "%.*s" format_end, pid, \
-            name_len, name, value); \
-    } \
-    write(atrace_marker_fd, buf, len); \
-}
-
 void atrace_async_begin_body(const char* name, int32_t cookie)
 {
-    WRITE_MSG("S|%d|", "|%" PRId32, getpid(), name, cookie);
+    atrace_write_msg('S', name, true, cookie, __FUNCTION__);
 }
 
 void atrace_async_end_body(const char* name, int32_t cookie)
 {
-    WRITE_MSG("F|%d|", "|%" PRId32, getpid(), name, cookie);
+    atrace_write_msg('F', name, true, cookie, __FUNCTION__);
 }
 
 void atrace_int_body(const char* name, int32_t value)
 {
-    WRITE_MSG("C|%d|", "|%" PRId32, getpid(), name, value);
+    atrace_write_msg('C', name, true, value, __FUNCTION__);
 }
 
 void atrace_int64_body(const char* name, int64_t value)
 {
-    WRITE_MSG("C|%d|", "|%" PRId64, getpid(), name, value);
+    atrace_write_msg('C', name, true, value, __FUNCTION__);
 }
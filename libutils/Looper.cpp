@@ -16,6 +16,8 @@
 #include <utils/Looper.h>
 #include <sys/eventfd.h>
 
+#include <algorithm>
+
 namespace android {
 
 // --- WeakMessageHandler ---
@@ -54,16 +56,38 @@ int SimpleLooperCallback::handleEvent(int fd, int events, void* data) {
 // Hint for number of file descriptors to be associated with the epoll instance.
 static const int EPOLL_SIZE_HINT = 8;
 
-// Maximum number of file descriptors for which to retrieve poll events each iteration.
+// Initial number of file descriptors for which to retrieve poll events each iteration.
+// The event array grows when a poll fills it and more fds are registered.
 static const int EPOLL_MAX_EVENTS = 16;
 
+// Epoll user data holds the request's fd and sequence number so ready events can be
+// matched to their request with one hash lookup, and events left over from a previous
+// registration of a recycled fd can be recognized.  The wake event fd uses sequence
+// number -1, which is never handed out to requests.
+static const int WAKE_EVENT_SEQ = -1;
+
+static uint64_t makeEpollData(int fd, int seq) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(seq)) << 32) | static_cast<uint32_t>(fd);
+}
+
+static int epollDataFd(uint64_t data) {
+    return static_cast<int>(static_cast<uint32_t>(data));
+}
+
+static int epollDataSeq(uint64_t data) {
+    return static_cast<int>(static_cast<uint32_t>(data >> 32));
+}
+
+const size_t Looper::NO_SLOT;
+
 static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t gTLSKey = 0;
 
 Looper::Looper(bool allowNonCallbacks) :
-        mAllowNonCallbacks(allowNonCallbacks), mSendingMessage(false),
+        mAllowNonCallbacks(allowNonCallbacks), mNextMessageSeq(0), mSendingMessage(false),
         mPolling(false), mEpollFd(-1), mEpollRebuildRequired(false),
-        mNextRequestSeq(0), mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
+        mNextRequestSeq(0), mDispatchingCallbacks(false), mEventItems(EPOLL_MAX_EVENTS),
+        mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
     mWakeEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
     LOG_ALWAYS_FATAL_IF(mWakeEventFd < 0, "Could not make wake event fd: %s",
                         strerror(errno));
@@ -147,13 +171,13 @@ void Looper::rebuildEpollLocked() {
     struct epoll_event eventItem;
     memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
     eventItem.events = EPOLLIN;
-    eventItem.data.fd = mWakeEventFd;
+    eventItem.data.u64 = makeEpollData(mWakeEventFd, WAKE_EVENT_SEQ);
     int result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeEventFd, & eventItem);
     LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake event fd to epoll instance: %s",
                         strerror(errno));
 
-    for (size_t i = 0; i < mRequests.size(); i++) {
-        const Request& request = mRequests.valueAt(i);
+    for (const auto& entry : mRequests) {
+        const Request& request = entry.second;
         struct epoll_event eventItem;
         request.initEventItem(&eventItem);
 
@@ -179,12 +203,12 @@ int Looper::pollOnce(int timeoutMillis, int* outFd, int* outEvents, void** outDa
     int result = 0;
     for (;;) {
         while (mResponseIndex < mResponses.size()) {
-            const Response& response = mResponses.itemAt(mResponseIndex++);
-            int ident = response.request.ident;
+            const Response& response = mResponses[mResponseIndex++];
+            int ident = response.ident;
             if (ident >= 0) {
-                int fd = response.request.fd;
+                int fd = response.fd;
                 int events = response.events;
-                void* data = response.request.data;
+                void* data = response.data;
 #if DEBUG_POLL_AND_WAKE
                 ALOGD("%p ~ pollOnce - returning signalled identifier %d: "
                         "fd=%d, events=0x%x, data=%p",
@@ -238,8 +262,8 @@ int Looper::pollInner(int timeoutMillis) {
     // We are about to idle.
     mPolling = true;
 
-    struct epoll_event eventItems[EPOLL_MAX_EVENTS];
-    int eventCount = epoll_wait(mEpollFd, eventItems, EPOLL_MAX_EVENTS, timeoutMillis);
+    struct epoll_event* eventItems = mEventItems.data();
+    int eventCount = epoll_wait(mEpollFd, eventItems, mEventItems.size(), timeoutMillis);
 
     // No longer idling.
     mPolling = false;
@@ -278,46 +302,56 @@ int Looper::pollInner(int timeoutMillis) {
     ALOGD("%p ~ pollOnce - handling events from %d fds", this, eventCount);
 #endif
 
+    mDispatchingCallbacks = true;
     for (int i = 0; i < eventCount; i++) {
-        int fd = eventItems[i].data.fd;
+        int fd = epollDataFd(eventItems[i].data.u64);
+        int seq = epollDataSeq(eventItems[i].data.u64);
         uint32_t epollEvents = eventItems[i].events;
-        if (fd == mWakeEventFd) {
+        if (seq == WAKE_EVENT_SEQ) {
             if (epollEvents & EPOLLIN) {
                 awoken();
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on wake event fd.", epollEvents);
             }
         } else {
-            ssize_t requestIndex = mRequests.indexOfKey(fd);
-            if (requestIndex >= 0) {
+            auto it = mRequests.find(fd);
+            if (it != mRequests.end() && it->second.seq == seq) {
                 int events = 0;
                 if (epollEvents & EPOLLIN) events |= EVENT_INPUT;
                 if (epollEvents & EPOLLOUT) events |= EVENT_OUTPUT;
                 if (epollEvents & EPOLLERR) events |= EVENT_ERROR;
                 if (epollEvents & EPOLLHUP) events |= EVENT_HANGUP;
-                pushResponse(events, mRequests.valueAt(requestIndex));
+                pushResponse(events, it->second);
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on fd %d that is "
                         "no longer registered.", epollEvents, fd);
             }
         }
     }
+
+    // If the event array was filled, there may have been more ready fds than we could
+    // collect; grow it (up to one slot per registered fd) for the next poll.
+    if (static_cast<size_t>(eventCount) == mEventItems.size()
+            && mEventItems.size() < mRequests.size() + 1) {
+        mEventItems.resize(std::min(mEventItems.size() * 2, mRequests.size() + 1));
+    }
 Done: ;
 
     // Invoke pending message callbacks.
     mNextMessageUptime = LLONG_MAX;
-    while (mMessageEnvelopes.size() != 0) {
+    while (!mMessageHeap.empty()) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-        const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(0);
+        size_t slot = mMessageHeap[0];
+        const MessageEnvelope& messageEnvelope = mMessageSlots[slot];
         if (messageEnvelope.uptime <= now) {
-            // Remove the envelope from the list.
+            // Remove the envelope from the queue.
             // We keep a strong reference to the handler until the call to handleMessage
             // finishes.  Then we drop it so that the handler can be deleted *before*
             // we reacquire our lock.
             { // obtain handler
                 sp<MessageHandler> handler = messageEnvelope.handler;
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                removeMessageLocked(slot);
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -332,7 +366,7 @@ Done: ;
             mSendingMessage = false;
             result = POLL_CALLBACK;
         } else {
-            // The last message left at the head of the queue determines the next wakeup time.
+            // The message left at the head of the queue determines the next wakeup time.
             mNextMessageUptime = messageEnvelope.uptime;
             break;
         }
@@ -343,29 +377,37 @@ Done: ;
 
     // Invoke all response callbacks.
     for (size_t i = 0; i < mResponses.size(); i++) {
-        Response& response = mResponses.editItemAt(i);
-        if (response.request.ident == POLL_CALLBACK) {
-            int fd = response.request.fd;
+        Response& response = mResponses[i];
+        if (response.ident == POLL_CALLBACK) {
+            int fd = response.fd;
             int events = response.events;
-            void* data = response.request.data;
+            void* data = response.data;
 #if DEBUG_POLL_AND_WAKE || DEBUG_CALLBACKS
             ALOGD("%p ~ pollOnce - invoking fd event callback %p: fd=%d, events=0x%x, data=%p",
-                    this, response.request.callback.get(), fd, events, data);
+                    this, response.callback, fd, events, data);
 #endif
             // Invoke the callback.  Note that the file descriptor may be closed by
             // the callback (and potentially even reused) before the function returns so
             // we need to be a little careful when removing the file descriptor afterwards.
-            int callbackResult = response.request.callback->handleEvent(fd, events, data);
+            int callbackResult = response.callback->handleEvent(fd, events, data);
             if (callbackResult == 0) {
-                removeFd(fd, response.request.seq);
+                removeFd(fd, response.seq);
             }
 
-            // Clear the callback reference in the response structure promptly because we
-            // will not clear the response vector itself until the next poll.
-            response.request.callback.clear();
+            // The callback may be released as soon as dispatch ends.
+            response.callback = NULL;
             result = POLL_CALLBACK;
         }
     }
+
+    // Release callbacks that were unregistered while their responses were pending.
+    // They are destroyed outside of the lock.
+    std::vector<sp<LooperCallback> > retiredCallbacks;
+    { // acquire lock
+        AutoMutex _l(mLock);
+        mDispatchingCallbacks = false;
+        retiredCallbacks.swap(mRetiredCallbacks);
+    } // release lock
     return result;
 }
 
@@ -421,9 +463,19 @@ void Looper::awoken() {
 
 void Looper::pushResponse(int events, const Request& request) {
     Response response;
+    response.fd = request.fd;
+    response.ident = request.ident;
     response.events = events;
-    response.request = request;
-    mResponses.push(response);
+    response.seq = request.seq;
+    response.data = request.data;
+    response.callback = request.callback.get();
+    mResponses.push_back(response);
+}
+
+void Looper::retireCallbackLocked(const sp<LooperCallback>& callback) {
+    if (mDispatchingCallbacks && callback != NULL) {
+        mRetiredCallbacks.push_back(callback);
+    }
 }
 
 int Looper::addFd(int fd, int ident, int events, Looper_callbackFunc callback, void* data) {
@@ -465,14 +517,14 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
         struct epoll_event eventItem;
         request.initEventItem(&eventItem);
 
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
+        auto it = mRequests.find(fd);
+        if (it == mRequests.end()) {
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, & eventItem);
             if (epollResult < 0) {
                 ALOGE("Error adding epoll events for fd %d: %s", fd, strerror(errno));
                 return -1;
             }
-            mRequests.add(fd, request);
+            mRequests.insert(std::make_pair(fd, request));
         } else {
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, & eventItem);
             if (epollResult < 0) {
@@ -507,7 +559,8 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
                     return -1;
                 }
             }
-            mRequests.replaceValueAt(requestIndex, request);
+            retireCallbackLocked(it->second.callback);
+            it->second = request;
         }
     } // release lock
     return 1;
@@ -524,23 +577,24 @@ int Looper::removeFd(int fd, int seq) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
+        auto it = mRequests.find(fd);
+        if (it == mRequests.end()) {
             return 0;
         }
 
         // Check the sequence number if one was given.
-        if (seq != -1 && mRequests.valueAt(requestIndex).seq != seq) {
+        if (seq != -1 && it->second.seq != seq) {
 #if DEBUG_CALLBACKS
             ALOGD("%p ~ removeFd - sequence number mismatch, oldSeq=%d",
-                    this, mRequests.valueAt(requestIndex).seq);
+                    this, it->second.seq);
 #endif
             return 0;
         }
 
         // Always remove the FD from the request map even if an error occurs while
         // updating the epoll set so that we avoid accidentally leaking callbacks.
-        mRequests.removeItemsAt(requestIndex);
+        retireCallbackLocked(it->second.callback);
+        mRequests.erase(it);
 
         int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, NULL);
         if (epollResult < 0) {
@@ -593,17 +647,11 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
             this, uptime, handler.get(), message.what);
 #endif
 
-    size_t i = 0;
+    size_t heapIndex;
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        heapIndex = enqueueMessageLocked(uptime, handler, message);
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -615,7 +663,7 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
     } // release lock
 
     // Wake the poll loop only when we enqueue a new message at the head.
-    if (i == 0) {
+    if (heapIndex == 0) {
         wake();
     }
 }
@@ -628,11 +676,10 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
-            }
+        auto it = mMessageHandlerHeads.find(handler.get());
+        while (it != mMessageHandlerHeads.end()) {
+            removeMessageLocked(it->second);
+            it = mMessageHandlerHeads.find(handler.get());
         }
     } // release lock
 }
@@ -645,16 +692,128 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
+        auto it = mMessageHandlerHeads.find(handler.get());
+        size_t slot = it != mMessageHandlerHeads.end() ? it->second : NO_SLOT;
+        while (slot != NO_SLOT) {
+            size_t next = mMessageSlots[slot].nextByHandler;
+            if (mMessageSlots[slot].message.what == what) {
+                removeMessageLocked(slot);
             }
+            slot = next;
         }
     } // release lock
 }
 
+size_t Looper::enqueueMessageLocked(nsecs_t uptime, const sp<MessageHandler>& handler,
+        const Message& message) {
+    size_t slot;
+    if (mFreeMessageSlots.empty()) {
+        slot = mMessageSlots.size();
+        mMessageSlots.push_back(MessageEnvelope(uptime, handler, message));
+    } else {
+        slot = mFreeMessageSlots.back();
+        mFreeMessageSlots.pop_back();
+        mMessageSlots[slot] = MessageEnvelope(uptime, handler, message);
+    }
+
+    MessageEnvelope& messageEnvelope = mMessageSlots[slot];
+    messageEnvelope.seq = mNextMessageSeq++;
+
+    // Link at the head of this handler's list.
+    auto result = mMessageHandlerHeads.insert(std::make_pair(handler.get(), slot));
+    if (!result.second) {
+        size_t oldHead = result.first->second;
+        messageEnvelope.nextByHandler = oldHead;
+        mMessageSlots[oldHead].prevByHandler = slot;
+        result.first->second = slot;
+    }
+
+    messageEnvelope.heapIndex = mMessageHeap.size();
+    mMessageHeap.push_back(slot);
+    siftUpLocked(messageEnvelope.heapIndex);
+    return mMessageSlots[slot].heapIndex;
+}
+
+void Looper::removeMessageLocked(size_t slot) {
+    MessageEnvelope& messageEnvelope = mMessageSlots[slot];
+
+    // Unlink from the handler's list.
+    if (messageEnvelope.prevByHandler != NO_SLOT) {
+        mMessageSlots[messageEnvelope.prevByHandler].nextByHandler =
+                messageEnvelope.nextByHandler;
+    } else if (messageEnvelope.nextByHandler != NO_SLOT) {
+        mMessageHandlerHeads[messageEnvelope.handler.get()] = messageEnvelope.nextByHandler;
+    } else {
+        mMessageHandlerHeads.erase(messageEnvelope.handler.get());
+    }
+    if (messageEnvelope.nextByHandler != NO_SLOT) {
+        mMessageSlots[messageEnvelope.nextByHandler].prevByHandler =
+                messageEnvelope.prevByHandler;
+    }
+
+    // Replace it in the heap with the last entry and restore the heap order.
+    size_t heapIndex = messageEnvelope.heapIndex;
+    size_t last = mMessageHeap.size() - 1;
+    if (heapIndex != last) {
+        swapHeapEntriesLocked(heapIndex, last);
+    }
+    mMessageHeap.pop_back();
+    if (heapIndex != last) {
+        siftUpLocked(heapIndex);
+        siftDownLocked(mMessageSlots[mMessageHeap[heapIndex]].heapIndex);
+    }
+
+    // Drop the handler reference promptly; the slot is reused by a later message.
+    messageEnvelope.handler.clear();
+    messageEnvelope.prevByHandler = NO_SLOT;
+    messageEnvelope.nextByHandler = NO_SLOT;
+    mFreeMessageSlots.push_back(slot);
+}
+
+bool Looper::messageBeforeLocked(size_t a, size_t b) const {
+    const MessageEnvelope& first = mMessageSlots[a];
+    const MessageEnvelope& second = mMessageSlots[b];
+    return first.uptime < second.uptime
+            || (first.uptime == second.uptime && first.seq < second.seq);
+}
+
+void Looper::swapHeapEntriesLocked(size_t i, size_t j) {
+    std::swap(mMessageHeap[i], mMessageHeap[j]);
+    mMessageSlots[mMessageHeap[i]].heapIndex = i;
+    mMessageSlots[mMessageHeap[j]].heapIndex = j;
+}
+
+void Looper::siftUpLocked(size_t heapIndex) {
+    while (heapIndex > 0) {
+        size_t parent = (heapIndex - 1) / 2;
+        if (!messageBeforeLocked(mMessageHeap[heapIndex], mMessageHeap[parent])) {
+            break;
+        }
+        swapHeapEntriesLocked(heapIndex, parent);
+        heapIndex = parent;
+    }
+}
+
+void Looper::siftDownLocked(size_t heapIndex) {
+    size_t size = mMessageHeap.size();
+    for (;;) {
+        size_t smallest = heapIndex;
+        size_t left = heapIndex * 2 + 1;
+        size_t right = left + 1;
+        if (left < size && messageBeforeLocked(mMessageHeap[left], mMessageHeap[smallest])) {
+            smallest = left;
+        }
+        if (right < size && messageBeforeLocked(mMessageHeap[right], mMessageHeap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == heapIndex) {
+            break;
+        }
+        swapHeapEntriesLocked(heapIndex, smallest);
+        heapIndex = smallest;
+    }
+}
+
 bool Looper::isPolling() const {
     return mPolling;
 }
@@ -666,7 +825,7 @@ void Looper::Request::initEventItem(struct epoll_event* eventItem) const {
 
     memset(eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
     eventItem->events = epollEvents;
-    eventItem->data.fd = fd;
+    eventItem->data.u64 = makeEpollData(fd, seq);
 }
 
 MessageHandler::~MessageHandler() { }
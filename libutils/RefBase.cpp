@@ -73,7 +73,17 @@ namespace android {
 // after the RefBase object has been destroyed.
 //
 // A weakref_impl is allocated as the value of mRefs in a RefBase object on
-// construction.
+// construction, unless the object was constructed with LAZY_WEAK_REFS. Such
+// an object keeps its strong count inline in mRefs, tagged with the low bit,
+// and does not allocate its weakref_impl until something needs it: a weak
+// reference, getWeakRefs(), or extendObjectLifetime(). All updates to an
+// inline count are compare-and-swaps on mRefs, so an update that races with
+// the weakref_impl being installed simply retries against the weakref_impl.
+// The weakref_impl starts with the inline strong count, and with a weak count
+// equal to it, since each strong reference would have held a weak one. From
+// then on the object behaves exactly like any other RefBase. While the count
+// is inline there can be no weak references, and the lifetime is always
+// OBJECT_LIFETIME_STRONG, so the last decStrong() simply deletes the object.
 // In the OBJECT_LIFETIME_STRONG case, it is normally deallocated in decWeak,
 // and hence lives as long as the last weak reference. (It can also be
 // deallocated in the RefBase destructor iff the strong reference count was
@@ -130,6 +140,22 @@ namespace android {
 // Same for weak counts.
 #define BAD_WEAK(c) ((c) == 0 || ((c) & (~MAX_COUNT)) != 0)
 
+// Set in mRefs when it holds an inline strong count rather than a
+// weakref_impl pointer, which is always at least 2-byte aligned.
+#define INLINE_COUNT_TAG 1
+
+static inline bool isInlineCount(uintptr_t refs) {
+    return (refs & INLINE_COUNT_TAG) != 0;
+}
+
+static inline int32_t inlineCount(uintptr_t refs) {
+    return static_cast<int32_t>(refs >> 1);
+}
+
+static inline uintptr_t makeInlineCount(int32_t c) {
+    return (static_cast<uintptr_t>(c) << 1) | INLINE_COUNT_TAG;
+}
+
 // ---------------------------------------------------------------------------
 
 class RefBase::weakref_impl : public RefBase::weakref_type
@@ -397,7 +423,25 @@ private:
 
 void RefBase::incStrong(const void* id) const
 {
-    weakref_impl* const refs = mRefs;
+    uintptr_t value = mRefs.load(std::memory_order_acquire);
+    while (isInlineCount(value)) {
+        const int32_t c = inlineCount(value);
+        ALOG_ASSERT(c > 0, "incStrong() called on %p after last strong ref", this);
+        const int32_t next = (c == INITIAL_STRONG_VALUE) ? 1 : c + 1;
+        if (mRefs.compare_exchange_weak(value, makeInlineCount(next),
+                std::memory_order_acquire)) {
+#if PRINT_REFS
+            ALOGD("incStrong of %p from %p: cnt=%d\n", this, id, c);
+#endif
+            if (c == INITIAL_STRONG_VALUE) {
+                const_cast<RefBase*>(this)->onFirstRef();
+            }
+            return;
+        }
+        // value was updated by compare_exchange_weak.
+    }
+
+    weakref_impl* const refs = reinterpret_cast<weakref_impl*>(value);
     refs->incWeak(id);
     
     refs->addStrongRef(id);
@@ -419,7 +463,27 @@ void RefBase::incStrong(const void* id) const
 
 void RefBase::decStrong(const void* id) const
 {
-    weakref_impl* const refs = mRefs;
+    uintptr_t value = mRefs.load(std::memory_order_acquire);
+    while (isInlineCount(value)) {
+        const int32_t c = inlineCount(value);
+        LOG_ALWAYS_FATAL_IF(BAD_STRONG(c), "decStrong() called on %p too many times",
+                this);
+        if (mRefs.compare_exchange_weak(value, makeInlineCount(c - 1),
+                std::memory_order_release, std::memory_order_acquire)) {
+#if PRINT_REFS
+            ALOGD("decStrong of %p from %p: cnt=%d\n", this, id, c);
+#endif
+            if (c == 1) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const_cast<RefBase*>(this)->onLastStrongRef(id);
+                delete this;
+            }
+            return;
+        }
+        // value was updated by compare_exchange_weak.
+    }
+
+    weakref_impl* const refs = reinterpret_cast<weakref_impl*>(value);
     refs->removeStrongRef(id);
     const int32_t c = refs->mStrong.fetch_sub(1, std::memory_order_release);
 #if PRINT_REFS
@@ -449,7 +513,26 @@ void RefBase::forceIncStrong(const void* id) const
 {
     // Allows initial mStrong of 0 in addition to INITIAL_STRONG_VALUE.
     // TODO: Better document assumptions.
-    weakref_impl* const refs = mRefs;
+    uintptr_t value = mRefs.load(std::memory_order_acquire);
+    while (isInlineCount(value)) {
+        const int32_t c = inlineCount(value);
+        ALOG_ASSERT(c >= 0, "forceIncStrong called on %p after ref count underflow",
+                this);
+        const int32_t next = (c == INITIAL_STRONG_VALUE) ? 1 : c + 1;
+        if (mRefs.compare_exchange_weak(value, makeInlineCount(next),
+                std::memory_order_acquire)) {
+#if PRINT_REFS
+            ALOGD("forceIncStrong of %p from %p: cnt=%d\n", this, id, c);
+#endif
+            if (c == INITIAL_STRONG_VALUE || c == 0) {
+                const_cast<RefBase*>(this)->onFirstRef();
+            }
+            return;
+        }
+        // value was updated by compare_exchange_weak.
+    }
+
+    weakref_impl* const refs = reinterpret_cast<weakref_impl*>(value);
     refs->incWeak(id);
     
     refs->addStrongRef(id);
@@ -473,7 +556,11 @@ void RefBase::forceIncStrong(const void* id) const
 int32_t RefBase::getStrongCount() const
 {
     // Debugging only; No memory ordering guarantees.
-    return mRefs->mStrong.load(std::memory_order_relaxed);
+    uintptr_t value = mRefs.load(std::memory_order_acquire);
+    if (isInlineCount(value)) {
+        return inlineCount(value);
+    }
+    return reinterpret_cast<weakref_impl*>(value)->mStrong.load(std::memory_order_relaxed);
 }
 
 RefBase* RefBase::weakref_type::refBase() const
@@ -670,52 +757,94 @@ void RefBase::weakref_type::trackMe(bool enable, bool retain)
 
 RefBase::weakref_type* RefBase::createWeak(const void* id) const
 {
-    mRefs->incWeak(id);
-    return mRefs;
+    weakref_impl* const refs = getRefs();
+    refs->incWeak(id);
+    return refs;
 }
 
 RefBase::weakref_type* RefBase::getWeakRefs() const
 {
-    return mRefs;
+    return getRefs();
+}
+
+RefBase::weakref_impl* RefBase::getRefs() const
+{
+    uintptr_t value = mRefs.load(std::memory_order_acquire);
+    if (!isInlineCount(value)) {
+        return reinterpret_cast<weakref_impl*>(value);
+    }
+
+    weakref_impl* const refs = new weakref_impl(const_cast<RefBase*>(this));
+    do {
+        const int32_t c = inlineCount(value);
+        refs->mStrong.store(c, std::memory_order_relaxed);
+        // Each strong reference holds a weak one.
+        refs->mWeak.store(c == INITIAL_STRONG_VALUE ? 0 : c, std::memory_order_relaxed);
+        if (mRefs.compare_exchange_weak(value, reinterpret_cast<uintptr_t>(refs),
+                std::memory_order_release, std::memory_order_acquire)) {
+            return refs;
+        }
+        // value was updated by compare_exchange_weak.
+    } while (isInlineCount(value));
+
+    // Another thread installed its weakref_impl first.
+    delete refs;
+    return reinterpret_cast<weakref_impl*>(value);
 }
 
 RefBase::RefBase()
-    : mRefs(new weakref_impl(this))
+    : mRefs(reinterpret_cast<uintptr_t>(new weakref_impl(this)))
+{
+}
+
+RefBase::RefBase(uint32_t flags)
+    // Reference tracking needs the weakref_impl from the start.
+    : mRefs(((flags & LAZY_WEAK_REFS) && !DEBUG_REFS)
+            ? makeInlineCount(INITIAL_STRONG_VALUE)
+            : reinterpret_cast<uintptr_t>(new weakref_impl(this)))
 {
 }
 
 RefBase::~RefBase()
 {
-    int32_t flags = mRefs->mFlags.load(std::memory_order_relaxed);
+    uintptr_t value = mRefs.load(std::memory_order_relaxed);
+    if (isInlineCount(value)) {
+        // There were never any weak references, so there is nothing to free.
+        mRefs.store(0, std::memory_order_relaxed);
+        return;
+    }
+
+    weakref_impl* const refs = reinterpret_cast<weakref_impl*>(value);
+    int32_t flags = refs->mFlags.load(std::memory_order_relaxed);
     // Life-time of this object is extended to WEAK, in
     // which case weakref_impl doesn't out-live the object and we
     // can free it now.
     if ((flags & OBJECT_LIFETIME_MASK) == OBJECT_LIFETIME_WEAK) {
         // It's possible that the weak count is not 0 if the object
         // re-acquired a weak reference in its destructor
-        if (mRefs->mWeak.load(std::memory_order_relaxed) == 0) {
-            delete mRefs;
+        if (refs->mWeak.load(std::memory_order_relaxed) == 0) {
+            delete refs;
         }
-    } else if (mRefs->mStrong.load(std::memory_order_relaxed)
+    } else if (refs->mStrong.load(std::memory_order_relaxed)
             == INITIAL_STRONG_VALUE) {
         // We never acquired a strong reference on this object.
-        LOG_ALWAYS_FATAL_IF(mRefs->mWeak.load() != 0,
+        LOG_ALWAYS_FATAL_IF(refs->mWeak.load() != 0,
                 "RefBase: Explicit destruction with non-zero weak "
                 "reference count");
         // TODO: Always report if we get here. Currently MediaMetadataRetriever
         // C++ objects are inconsistently managed and sometimes get here.
         // There may be other cases, but we believe they should all be fixed.
-        delete mRefs;
+        delete refs;
     }
     // For debugging purposes, clear mRefs.  Ineffective against outstanding wp's.
-    const_cast<weakref_impl*&>(mRefs) = NULL;
+    mRefs.store(0, std::memory_order_relaxed);
 }
 
 void RefBase::extendObjectLifetime(int32_t mode)
 {
     // Must be happens-before ordered with respect to construction or any
     // operation that could destroy the object.
-    mRefs->mFlags.fetch_or(mode, std::memory_order_relaxed);
+    getRefs()->mFlags.fetch_or(mode, std::memory_order_relaxed);
 }
 
 void RefBase::onFirstRef()
@@ -756,8 +885,14 @@ void RefBase::renameRefId(weakref_type* ref,
 
 void RefBase::renameRefId(RefBase* ref,
         const void* old_id, const void* new_id) {
-    ref->mRefs->renameStrongRefId(old_id, new_id);
-    ref->mRefs->renameWeakRefId(old_id, new_id);
+    uintptr_t value = ref->mRefs.load(std::memory_order_acquire);
+    if (isInlineCount(value)) {
+        // Not tracked: DEBUG_REFS never leaves the count inline.
+        return;
+    }
+    weakref_impl* const impl = reinterpret_cast<weakref_impl*>(value);
+    impl->renameStrongRefId(old_id, new_id);
+    impl->renameWeakRefId(old_id, new_id);
 }
 
 VirtualLightRefBase::~VirtualLightRefBase() {}
@@ -19,6 +19,7 @@
 #include <utils/Log.h>
 
 #include <ctype.h>
+#include <limits.h>
 
 #include "SharedBuffer.h"
 
@@ -54,29 +55,31 @@ void terminate_string16()
 static char16_t* allocFromUTF8(const char* u8str, size_t u8len)
 {
     if (u8len == 0) return getEmptyString();
+    if (u8len >= SSIZE_MAX / sizeof(char16_t)) return getEmptyString();
 
-    const uint8_t* u8cur = (const uint8_t*) u8str;
+    // The UTF-16 is never longer than the UTF-8, and is exactly as long for
+    // ASCII, so convert straight into a buffer of that size rather than
+    // measuring first, and shrink it afterwards if need be.
+    SharedBuffer* buf = SharedBuffer::alloc(sizeof(char16_t)*(u8len+1));
+    if (!buf) {
+        return getEmptyString();
+    }
 
-    const ssize_t u16len = utf8_to_utf16_length(u8cur, u8len);
+    char16_t* u16str = (char16_t*)buf->data();
+    const ssize_t u16len = utf8_to_utf16_single_pass((const uint8_t*) u8str, u8len, u16str);
     if (u16len < 0) {
+        buf->release();
         return getEmptyString();
     }
-
-    SharedBuffer* buf = SharedBuffer::alloc(sizeof(char16_t)*(u16len+1));
-    if (buf) {
-        u8cur = (const uint8_t*) u8str;
-        char16_t* u16str = (char16_t*)buf->data();
-
-        utf8_to_utf16(u8cur, u8len, u16str, ((size_t) u16len) + 1);
-
-        //printf("Created UTF-16 string from UTF-8 \"%s\":", in);
-        //printHexData(1, str, buf->size(), 16, 1);
-        //printf("\n");
-
-        return u16str;
+    if ((size_t) u16len < u8len) {
+        buf = buf->editResize(sizeof(char16_t)*(u16len+1));
+        if (!buf) {
+            return getEmptyString();
+        }
+        u16str = (char16_t*)buf->data();
     }
-
-    return getEmptyString();
+    u16str[u16len] = 0;
+    return u16str;
 }
 
 // ---------------------------------------------------------------------------
@@ -105,6 +108,24 @@ String16::String16(const String16& o)
     SharedBuffer::bufferFromData(mString)->acquire();
 }
 
+// Moving hands the SharedBuffer over, so string() of the result is the same
+// pointer the source had. The source is left empty.
+String16::String16(String16&& o) noexcept
+    : mString(o.mString)
+{
+    o.mString = getEmptyString();
+}
+
+String16& String16::operator=(String16&& other) noexcept
+{
+    if (this != &other) {
+        SharedBuffer::bufferFromData(mString)->release();
+        mString = other.mString;
+        other.mString = getEmptyString();
+    }
+    return *this;
+}
+
 String16::String16(const String16& o, size_t len, size_t begin)
     : mString(getEmptyString())
 {
@@ -201,16 +222,26 @@ status_t String16::setTo(const char16_t* other)
 
 status_t String16::setTo(const char16_t* other, size_t len)
 {
+    // other may point into this string, whose buffer editResize() can move
+    // or shrink; keep that buffer alive until other has been copied.
+    const SharedBuffer* aliased = NULL;
+    if (other >= mString && other <= mString + size()) {
+        aliased = SharedBuffer::bufferFromData(mString);
+        aliased->acquire();
+    }
+
     SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
         ->editResize((len+1)*sizeof(char16_t));
+    status_t result = NO_MEMORY;
     if (buf) {
         char16_t* str = (char16_t*)buf->data();
         memmove(str, other, len*sizeof(char16_t));
         str[len] = 0;
         mString = str;
-        return NO_ERROR;
+        result = NO_ERROR;
     }
-    return NO_MEMORY;
+    if (aliased) aliased->release();
+    return result;
 }
 
 status_t String16::append(const String16& other)
@@ -224,15 +255,7 @@ status_t String16::append(const String16& other)
         return NO_ERROR;
     }
 
-    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize((myLen+otherLen+1)*sizeof(char16_t));
-    if (buf) {
-        char16_t* str = (char16_t*)buf->data();
-        memcpy(str+myLen, other, (otherLen+1)*sizeof(char16_t));
-        mString = str;
-        return NO_ERROR;
-    }
-    return NO_MEMORY;
+    return append(other.string(), otherLen);
 }
 
 status_t String16::append(const char16_t* chrs, size_t otherLen)
@@ -245,10 +268,16 @@ status_t String16::append(const char16_t* chrs, size_t otherLen)
         return NO_ERROR;
     }
 
+    // chrs may point into this string, e.g. s.append(s), and editResize()
+    // can move a buffer that isn't shared.
+    const bool aliased = chrs >= mString && chrs <= mString + myLen;
+    const size_t offset = aliased ? chrs - mString : 0;
+
     SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
         ->editResize((myLen+otherLen+1)*sizeof(char16_t));
     if (buf) {
         char16_t* str = (char16_t*)buf->data();
+        if (aliased) chrs = str + offset;
         memcpy(str+myLen, chrs, otherLen*sizeof(char16_t));
         str[myLen+otherLen] = 0;
         mString = str;
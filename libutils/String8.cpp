@@ -100,22 +100,33 @@ static char* allocFromUTF8(const char* in, size_t len)
 
 static char* allocFromUTF16(const char16_t* in, size_t len)
 {
-    if (len == 0) return getEmptyString();
+    if (len == 0 || in == NULL) return getEmptyString();
 
-     // Allow for closing '\0'
-    const ssize_t resultStrLen = utf16_to_utf8_length(in, len) + 1;
-    if (resultStrLen < 1) {
+    // Allow for closing '\0'. This is exactly enough for an ASCII string,
+    // which then only takes one pass; otherwise only what follows the ASCII
+    // prefix has to be measured.
+    SharedBuffer* buf = SharedBuffer::alloc(len + 1);
+    ALOG_ASSERT(buf, "Unable to allocate shared buffer");
+    if (!buf) {
         return getEmptyString();
     }
 
-    SharedBuffer* buf = SharedBuffer::alloc(resultStrLen);
+    char* resultStr = (char*)buf->data();
+    const size_t asciiLen = utf16_to_utf8_ascii_prefix(in, len, resultStr);
+    if (asciiLen == len) {
+        resultStr[len] = '\0';
+        return resultStr;
+    }
+
+    const size_t tailLen = utf16_to_utf8_length(in + asciiLen, len - asciiLen) + 1;
+    buf = buf->editResize(asciiLen + tailLen);
     ALOG_ASSERT(buf, "Unable to allocate shared buffer");
     if (!buf) {
         return getEmptyString();
     }
 
-    char* resultStr = (char*)buf->data();
-    utf16_to_utf8(in, len, resultStr, resultStrLen);
+    resultStr = (char*)buf->data();
+    utf16_to_utf8(in + asciiLen, len - asciiLen, resultStr + asciiLen, tailLen);
     return resultStr;
 }
 
@@ -168,6 +179,14 @@ String8::String8(const String8& o)
     SharedBuffer::bufferFromData(mString)->acquire();
 }
 
+// Moving hands the SharedBuffer over, so string() of the result is the same
+// pointer the source had. The source is left empty.
+String8::String8(String8&& o) noexcept
+    : mString(o.mString)
+{
+    o.mString = getEmptyString();
+}
+
 String8::String8(const char* o)
     : mString(allocFromUTF8(o, strlen(o)))
 {
@@ -242,6 +261,16 @@ void String8::clear() {
     mString = getEmptyString();
 }
 
+String8& String8::operator=(String8&& other) noexcept
+{
+    if (this != &other) {
+        SharedBuffer::bufferFromData(mString)->release();
+        mString = other.mString;
+        other.mString = getEmptyString();
+    }
+    return *this;
+}
+
 void String8::setTo(const String8& other)
 {
     SharedBuffer::bufferFromData(other.mString)->acquire();
@@ -361,12 +390,17 @@ status_t String8::appendFormatV(const char* fmt, va_list args)
 status_t String8::real_append(const char* other, size_t otherLen)
 {
     const size_t myLen = bytes();
+    // other may point into this string, e.g. s.append(s), and editResize()
+    // can move a buffer that isn't shared.
+    const bool aliased = other >= mString && other <= mString + myLen;
+    const size_t offset = aliased ? other - mString : 0;
 
     SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
         ->editResize(myLen+otherLen+1);
     if (buf) {
         char* str = (char*)buf->data();
         mString = str;
+        if (aliased) other = str + offset;
         str += myLen;
         memcpy(str, other, otherLen);
         str[otherLen] = '\0';
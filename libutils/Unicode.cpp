@@ -18,9 +18,18 @@
 
 #include <utils/Unicode.h>
 #include <limits.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include <log/log.h>
 
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON)
+# include <arm_neon.h>
+#endif
+
 #if defined(_WIN32)
 # undef  nhtol
 # undef  htonl
@@ -65,6 +74,197 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// --------------------------------------------------------------------------
+// Runs of ASCII
+// --------------------------------------------------------------------------
+
+// Most strings that go through here are mostly or entirely ASCII, which the
+// helpers below handle a vector at a time. Each one looks at no more than
+// "len" elements, only ever in whole blocks, and stops at the first block
+// that isn't entirely ASCII, returning how many elements it handled. The
+// callers then deal with the remainder one character at a time.
+
+/**
+ * Returns the length of the run of ASCII bytes at the start of "src".
+ */
+static inline size_t utf8_ascii_run_length(const uint8_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(v) != 0) break;
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= len; i += 16) {
+        const uint64x2_t high = vreinterpretq_u64_u8(vandq_u8(vld1q_u8(src + i), vdupq_n_u8(0x80)));
+        if ((vgetq_lane_u64(high, 0) | vgetq_lane_u64(high, 1)) != 0) break;
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, src + i, sizeof(v));
+        if ((v & 0x8080808080808080ULL) != 0) break;
+    }
+#endif
+    return i;
+}
+
+/**
+ * Widens the run of ASCII bytes at the start of "src" into "dst".
+ */
+static inline size_t utf8_ascii_run_to_utf16(const uint8_t* src, size_t len, char16_t* dst)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(v) != 0) break;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= len; i += 16) {
+        const uint8x16_t v = vld1q_u8(src + i);
+        const uint64x2_t high = vreinterpretq_u64_u8(vandq_u8(v, vdupq_n_u8(0x80)));
+        if ((vgetq_lane_u64(high, 0) | vgetq_lane_u64(high, 1)) != 0) break;
+        vst1q_u16(reinterpret_cast<uint16_t*>(dst + i), vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(reinterpret_cast<uint16_t*>(dst + i + 8), vmovl_u8(vget_high_u8(v)));
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, src + i, sizeof(v));
+        if ((v & 0x8080808080808080ULL) != 0) break;
+        for (size_t j = 0; j < 8; j++) {
+            dst[i + j] = src[i + j];
+        }
+    }
+#endif
+    return i;
+}
+
+/**
+ * Returns the length of the run of ASCII characters at the start of "src".
+ */
+static inline size_t utf16_ascii_run_length(const char16_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    for (; i + 8 <= len; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(v, nonAscii), _mm_setzero_si128());
+        if (_mm_movemask_epi8(ascii) != 0xFFFF) break;
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= len; i += 8) {
+        const uint16x8_t v = vld1q_u16(reinterpret_cast<const uint16_t*>(src + i));
+        const uint64x2_t high = vreinterpretq_u64_u16(vandq_u16(v, vdupq_n_u16(0xFF80)));
+        if ((vgetq_lane_u64(high, 0) | vgetq_lane_u64(high, 1)) != 0) break;
+    }
+#else
+    for (; i + 4 <= len; i += 4) {
+        uint64_t v;
+        memcpy(&v, src + i, sizeof(v));
+        if ((v & 0xFF80FF80FF80FF80ULL) != 0) break;
+    }
+#endif
+    return i;
+}
+
+/**
+ * Narrows the run of ASCII characters at the start of "src" into "dst".
+ */
+static inline size_t utf16_ascii_run_to_utf8(const char16_t* src, size_t len, char* dst)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    for (; i + 16 <= len; i += 16) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+        const __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(lo, hi), nonAscii),
+                _mm_setzero_si128());
+        if (_mm_movemask_epi8(ascii) != 0xFFFF) break;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= len; i += 16) {
+        const uint16x8_t lo = vld1q_u16(reinterpret_cast<const uint16_t*>(src + i));
+        const uint16x8_t hi = vld1q_u16(reinterpret_cast<const uint16_t*>(src + i + 8));
+        const uint64x2_t high =
+                vreinterpretq_u64_u16(vandq_u16(vorrq_u16(lo, hi), vdupq_n_u16(0xFF80)));
+        if ((vgetq_lane_u64(high, 0) | vgetq_lane_u64(high, 1)) != 0) break;
+        vst1q_u8(reinterpret_cast<uint8_t*>(dst + i), vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+    }
+#else
+    for (; i + 4 <= len; i += 4) {
+        uint64_t v;
+        memcpy(&v, src + i, sizeof(v));
+        if ((v & 0xFF80FF80FF80FF80ULL) != 0) break;
+        for (size_t j = 0; j < 4; j++) {
+            dst[i + j] = static_cast<char>(src[i + j]);
+        }
+    }
+#endif
+    return i;
+}
+
+/**
+ * Returns how many UTF-8 bytes the run of characters at the start of "src"
+ * takes, as long as that run contains no surrogates, and stores its length in
+ * "*run_len". This keeps text in scripts other than Latin, which is mostly
+ * outside ASCII but inside the BMP, off the one character at a time path.
+ */
+static inline size_t utf16_bmp_run_utf8_length(const char16_t* src, size_t len, size_t* run_len)
+{
+    size_t i = 0;
+    size_t ret = 0;
+#if defined(__SSE2__)
+    const __m128i mask80 = _mm_set1_epi16(static_cast<short>(0xFF80));
+    const __m128i mask800 = _mm_set1_epi16(static_cast<short>(0xF800));
+    const __m128i surrogate = _mm_set1_epi16(static_cast<short>(0xD800));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    for (; i + 8 <= len; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i top = _mm_and_si128(v, mask800);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(top, surrogate)) != 0) break;
+        // Each character takes 3 bytes, less one for each of these that is
+        // set: < 0x800 and < 0x80. The lanes are -1 when set.
+        const __m128i below800 = _mm_cmpeq_epi16(top, zero);
+        const __m128i below80 = _mm_cmpeq_epi16(_mm_and_si128(v, mask80), zero);
+        const __m128i sums = _mm_madd_epi16(_mm_add_epi16(below800, below80), one);
+        int32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sums);
+        ret += 24 + (lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= len; i += 8) {
+        const uint16x8_t v = vld1q_u16(reinterpret_cast<const uint16_t*>(src + i));
+        const uint16x8_t top = vandq_u16(v, vdupq_n_u16(0xF800));
+        const uint64x2_t isSurrogate =
+                vreinterpretq_u64_u16(vceqq_u16(top, vdupq_n_u16(0xD800)));
+        if ((vgetq_lane_u64(isSurrogate, 0) | vgetq_lane_u64(isSurrogate, 1)) != 0) break;
+        // One byte, plus one for each of these that is set: >= 0x80 and
+        // >= 0x800.
+        const uint16x8_t bytes = vaddq_u16(vdupq_n_u16(1),
+                vaddq_u16(vshrq_n_u16(vcgeq_u16(v, vdupq_n_u16(0x80)), 15),
+                          vshrq_n_u16(vcgeq_u16(v, vdupq_n_u16(0x800)), 15)));
+        const uint64x2_t sums = vpaddlq_u32(vpaddlq_u16(bytes));
+        ret += vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+    }
+#else
+    // Not worth it without vectors; the caller goes one character at a time.
+    (void) src;
+    (void) len;
+#endif
+    *run_len = i;
+    return ret;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -364,6 +564,16 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst, size_t dst_le
     const char16_t* const end_utf16 = src + src_len;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80) {
+            // Running out of room is left to the one character at a time
+            // path, which reports it.
+            const size_t run = utf16_ascii_run_to_utf8(cur_utf16,
+                    std::min(static_cast<size_t>(end_utf16 - cur_utf16), dst_len), cur);
+            cur_utf16 += run;
+            cur += run;
+            dst_len -= run;
+            if (run != 0) continue;
+        }
         char32_t utf32;
         // surrogate pairs
         if((*cur_utf16 & 0xFC00) == 0xD800 && (cur_utf16 + 1) < end_utf16
@@ -384,6 +594,15 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst, size_t dst_le
     *cur = '\0';
 }
 
+size_t utf16_to_utf8_ascii_prefix(const char16_t* src, size_t src_len, char* dst)
+{
+    size_t i = utf16_ascii_run_to_utf8(src, src_len, dst);
+    for (; i < src_len && src[i] < 0x80; i++) {
+        dst[i] = static_cast<char>(src[i]);
+    }
+    return i;
+}
+
 // --------------------------------------------------------------------------
 // UTF-8
 // --------------------------------------------------------------------------
@@ -440,6 +659,17 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     size_t ret = 0;
     const char16_t* const end = src + src_len;
     while (src < end) {
+        if (*src < 0x80) {
+            const size_t run = utf16_ascii_run_length(src, end - src);
+            ret += run;
+            src += run;
+            if (run != 0) continue;
+        } else if ((*src & 0xF800) != 0xD800) {
+            size_t run;
+            ret += utf16_bmp_run_utf8_length(src, end - src, &run);
+            src += run;
+            if (run != 0) continue;
+        }
         if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*(src + 1) & 0xFC00) == 0xDC00) {
             // surrogate pairs are always 4 bytes.
@@ -552,6 +782,12 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len, bool overreadIs
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t run = utf8_ascii_run_length(u8cur, u8end - u8cur);
+            u16measuredLen += run;
+            u8cur += run;
+            if (run != 0) continue;
+        }
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
         // Malformed utf8, some characters are beyond the end.
@@ -584,6 +820,41 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len, bool overreadIs
     return u16measuredLen;
 }
 
+ssize_t utf8_to_utf16_single_pass(const uint8_t* src, size_t srcLen, char16_t* dst)
+{
+    // A value > SSIZE_MAX is probably a negative value returned as an error and casted.
+    LOG_ALWAYS_FATAL_IF(srcLen > SSIZE_MAX, "srcLen is %zu", srcLen);
+    const uint8_t* const u8end = src + srcLen;
+    const uint8_t* u8cur = src;
+    char16_t* u16cur = dst;
+
+    // No character takes more UTF-16 units than UTF-8 bytes, so there is
+    // always room in dst.
+    while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t run = utf8_ascii_run_to_utf16(u8cur, u8end - u8cur, u16cur);
+            u8cur += run;
+            u16cur += run;
+            if (run != 0) continue;
+        }
+        const size_t u8len = utf8_codepoint_len(*u8cur);
+        // The same check as utf8_to_utf16_length().
+        if (u8cur + u8len - 1 >= u8end) {
+            return -1;
+        }
+        uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
+        if (codepoint <= 0xFFFF) {
+            *u16cur++ = (char16_t) codepoint;
+        } else {
+            codepoint = codepoint - 0x10000;
+            *u16cur++ = (char16_t) ((codepoint >> 10) + 0xD800);
+            *u16cur++ = (char16_t) ((codepoint & 0x3FF) + 0xDC00);
+        }
+        u8cur += u8len;
+    }
+    return u16cur - dst;
+}
+
 char16_t* utf8_to_utf16(const uint8_t* u8str, size_t u8len, char16_t* u16str, size_t u16len) {
     // A value > SSIZE_MAX is probably a negative value returned as an error and casted.
     LOG_ALWAYS_FATAL_IF(u16len == 0 || u16len > SSIZE_MAX, "u16len is %zu", u16len);
@@ -605,6 +876,14 @@ char16_t* utf8_to_utf16_no_null_terminator(
     char16_t* u16cur = dst;
 
     while (u8cur < u8end && u16cur < u16end) {
+        if (*u8cur < 0x80) {
+            const size_t run = utf8_ascii_run_to_utf16(u8cur,
+                    std::min(static_cast<size_t>(u8end - u8cur), static_cast<size_t>(u16end - u16cur)),
+                    u16cur);
+            u8cur += run;
+            u16cur += run;
+            if (run != 0) continue;
+        }
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
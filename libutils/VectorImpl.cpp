@@ -41,6 +41,19 @@ static inline size_t max(size_t a, size_t b) {
     return a>b ? a : b;
 }
 
+// Whether no other vector shares this storage, so its items may be moved
+// rather than copied.
+static inline bool storage_is_unique(const void* storage) {
+    return storage && SharedBuffer::bufferFromData(storage)->onlyOwner();
+}
+
+// Frees storage whose items have all been moved out or destroyed.
+static inline void free_relocated_storage(void* storage) {
+    const SharedBuffer* sb = SharedBuffer::bufferFromData(storage);
+    sb->release(SharedBuffer::eKeepStorage);
+    SharedBuffer::dealloc(sb);
+}
+
 // ----------------------------------------------------------------------------
 
 VectorImpl::VectorImpl(size_t itemSize, uint32_t flags)
@@ -346,8 +359,13 @@ ssize_t VectorImpl::setCapacity(size_t new_capacity)
     SharedBuffer* sb = SharedBuffer::alloc(new_allocation_size);
     if (sb) {
         void* array = sb->data();
-        _do_copy(array, mStorage, size());
-        release_storage();
+        if (storage_is_unique(mStorage)) {
+            _do_relocate(array, mStorage, size());
+            free_relocated_storage(mStorage);
+        } else {
+            _do_copy(array, mStorage, size());
+            release_storage();
+        }
         mStorage = const_cast<void*>(array);
     } else {
         return NO_MEMORY;
@@ -408,10 +426,14 @@ void* VectorImpl::_grow(size_t where, size_t amount)
                             "new_alloc_size overflow");
 
 //        ALOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
+        // editResize() copies the bytes of a shared buffer, which is only
+        // right for items that can be copied with memcpy(); items that can
+        // merely be moved that way need the buffer to be ours alone.
+        const bool unique = storage_is_unique(mStorage);
         if ((mStorage) &&
             (mCount==where) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
+            (((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR)) ||
+             ((mFlags & HAS_TRIVIAL_MOVE) && unique)))
         {
             const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_alloc_size);
@@ -424,15 +446,21 @@ void* VectorImpl::_grow(size_t where, size_t amount)
             SharedBuffer* sb = SharedBuffer::alloc(new_alloc_size);
             if (sb) {
                 void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != mCount) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
-                    _do_copy(dest, from, mCount-where);
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
+                if (unique) {
+                    _do_relocate(array, mStorage, where);
+                    _do_relocate(dest, from, mCount-where);
+                    free_relocated_storage(mStorage);
+                } else {
+                    if (where != 0) {
+                        _do_copy(array, mStorage, where);
+                    }
+                    if (where != mCount) {
+                        _do_copy(dest, from, mCount-where);
+                    }
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
             } else {
                 return NULL;
@@ -476,30 +504,41 @@ void VectorImpl::_shrink(size_t where, size_t amount)
         // we are always reducing the capacity of the underlying SharedBuffer.
         // In other words, (old_capacity * mItemSize) did not overflow, and
         // where < (where + amount) < new_capacity < old_capacity.
+        const bool unique = storage_is_unique(mStorage);
         if ((where == new_size) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
+            (((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR)) ||
+             ((mFlags & HAS_TRIVIAL_MOVE) && unique)))
         {
+            // The removed items are at the end, so the buffer can simply be
+            // cut short once they are gone. If it is shared, they are
+            // trivially destructible and destroying them is a no-op.
+            _do_destroy(reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize, amount);
             const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
             if (sb) {
                 mStorage = sb->data();
-            } else {
-                return;
             }
+            // Otherwise the old, larger buffer is as good.
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
                 void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != new_size) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
-                    _do_copy(dest, from, new_size - where);
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
+                if (unique) {
+                    _do_destroy(reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize, amount);
+                    _do_relocate(array, mStorage, where);
+                    _do_relocate(dest, from, new_size - where);
+                    free_relocated_storage(mStorage);
+                } else {
+                    if (where != 0) {
+                        _do_copy(array, mStorage, where);
+                    }
+                    if (where != new_size) {
+                        _do_copy(dest, from, new_size - where);
+                    }
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
             } else{
                 return;
@@ -556,6 +595,16 @@ void VectorImpl::_do_move_backward(void* dest, const void* from, size_t num) con
     do_move_backward(dest, from, num);
 }
 
+// Moves items into uninitialized storage that does not overlap them.
+void VectorImpl::_do_relocate(void* dest, const void* from, size_t num) const {
+    if ((mFlags & HAS_TRIVIAL_MOVE) ||
+        ((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR))) {
+        memcpy(dest, from, num*itemSize());
+    } else {
+        do_move_backward(dest, from, num);
+    }
+}
+
 /*****************************************************************************/
 
 SortedVectorImpl::SortedVectorImpl(size_t itemSize, uint32_t flags)
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
+#define ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
+
+#include <stdint.h>
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utils/Mutex.h"
+#include "utils/TypeHelpers.h"  // hash_t
+
+namespace android {
+
+/**
+ * A thread-safe LRU cache whose capacity is a number of bytes rather than a
+ * number of entries.
+ *
+ * Where LruCache needs a single lock around it, this splits the entries into
+ * shards by key hash, each with its own lock, its own LRU order and an equal
+ * share of the capacity. Threads working on different keys then rarely contend,
+ * at the cost of eviction being least-recently-used within a shard rather than
+ * across the whole cache.
+ *
+ * Keys need operator== and hash_type(), as for LruCache. The size of an entry
+ * is given by the sizeOf function passed to the constructor, which must return
+ * the same value every time it is called for the same entry; by default each
+ * entry costs sizeof(TKey) + sizeof(TValue).
+ *
+ * Values are returned by copy, since another thread may evict an entry as soon
+ * as its shard lock is released. Use a small or reference-counted TValue
+ * (sp<>, std::shared_ptr<>) for anything expensive to copy.
+ */
+template <typename TKey, typename TValue>
+class ConcurrentLruCache {
+public:
+    typedef size_t (*SizeOf)(const TKey& key, const TValue& value);
+
+    enum {
+        kDefaultShardCount = 16,
+    };
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+
+    // shardCount is rounded up to a power of two.
+    explicit ConcurrentLruCache(size_t maxBytes, size_t shardCount = kDefaultShardCount,
+            SizeOf sizeOf = NULL);
+
+    // Returns true and copies the value into *outValue if key is present,
+    // making it the most recently used entry of its shard.
+    bool get(const TKey& key, TValue* outValue);
+
+    // Adds an entry, evicting the least recently used entries of its shard to
+    // make room. Returns false, leaving the cache unchanged, if key is already
+    // present or the entry is larger than a shard.
+    bool put(const TKey& key, const TValue& value);
+
+    bool remove(const TKey& key);
+    void clear();
+
+    size_t size() const;
+    size_t sizeInBytes() const;
+    size_t maxBytes() const { return mShardBytes * mShards.size(); }
+
+    Stats getStats() const;
+    void resetStats();
+
+private:
+    ConcurrentLruCache(const ConcurrentLruCache&) = delete;
+    ConcurrentLruCache& operator=(const ConcurrentLruCache&) = delete;
+
+    struct Entry {
+        TKey key;
+        TValue value;
+        size_t bytes;
+
+        Entry(const TKey& _key, const TValue& _value, size_t _bytes)
+            : key(_key), value(_value), bytes(_bytes) {
+        }
+    };
+
+    // Most recently used first.
+    typedef std::list<Entry> EntryList;
+
+    struct HashForKey {
+        size_t operator()(const TKey& key) const {
+            return hash_type(key);
+        }
+    };
+
+    struct Shard {
+        mutable Mutex lock;
+        EntryList entries;
+        std::unordered_map<TKey, typename EntryList::iterator, HashForKey> index;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    static size_t defaultSizeOf(const TKey&, const TValue&) {
+        return sizeof(TKey) + sizeof(TValue);
+    }
+
+    Shard& shardFor(const TKey& key) const {
+        // hash_type() of an integer is the integer itself, so mix before
+        // taking the top bits or sequential keys would all land together.
+        uint32_t hash = static_cast<uint32_t>(hash_type(key)) * 0x9e3779b1u;
+        return *mShards[(hash >> 16) & (mShards.size() - 1)];
+    }
+
+    // Each shard is allocated separately so that their locks do not share a
+    // cache line.
+    std::vector<std::unique_ptr<Shard>> mShards;
+    size_t mShardBytes;
+    SizeOf mSizeOf;
+};
+
+// Implementation is here, because it's fully templated
+template <typename TKey, typename TValue>
+ConcurrentLruCache<TKey, TValue>::ConcurrentLruCache(size_t maxBytes, size_t shardCount,
+        SizeOf sizeOf)
+    : mSizeOf(sizeOf != NULL ? sizeOf : &defaultSizeOf) {
+    size_t shards = 1;
+    while (shards < shardCount && shards < 65536) {
+        shards *= 2;
+    }
+    mShards.reserve(shards);
+    for (size_t i = 0; i < shards; i++) {
+        mShards.emplace_back(new Shard());
+    }
+    mShardBytes = maxBytes / shards;
+}
+
+template <typename TKey, typename TValue>
+bool ConcurrentLruCache<TKey, TValue>::get(const TKey& key, TValue* outValue) {
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+        shard.misses++;
+        return false;
+    }
+    shard.hits++;
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    *outValue = found->second->value;
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ConcurrentLruCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
+    size_t bytes = mSizeOf(key, value);
+    if (bytes > mShardBytes) {
+        return false;
+    }
+
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    auto inserted = shard.index.emplace(key, shard.entries.end());
+    if (!inserted.second) {
+        return false;
+    }
+    // Evicting other keys leaves inserted.first valid.
+    while (shard.bytes + bytes > mShardBytes) {
+        Entry& oldest = shard.entries.back();
+        shard.bytes -= oldest.bytes;
+        shard.index.erase(oldest.key);
+        shard.entries.pop_back();
+        shard.evictions++;
+    }
+    shard.entries.emplace_front(key, value, bytes);
+    inserted.first->second = shard.entries.begin();
+    shard.bytes += bytes;
+    return true;
+}
+
+template <typename TKey, typename TValue>
+bool ConcurrentLruCache<TKey, TValue>::remove(const TKey& key) {
+    Shard& shard = shardFor(key);
+    Mutex::Autolock _l(shard.lock);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+        return false;
+    }
+    typename EntryList::iterator entry = found->second;
+    shard.bytes -= entry->bytes;
+    shard.index.erase(found);
+    shard.entries.erase(entry);
+    return true;
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::clear() {
+    for (auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        shard->index.clear();
+        shard->entries.clear();
+        shard->bytes = 0;
+    }
+}
+
+template <typename TKey, typename TValue>
+size_t ConcurrentLruCache<TKey, TValue>::size() const {
+    size_t size = 0;
+    for (const auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        size += shard->index.size();
+    }
+    return size;
+}
+
+template <typename TKey, typename TValue>
+size_t ConcurrentLruCache<TKey, TValue>::sizeInBytes() const {
+    size_t bytes = 0;
+    for (const auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        bytes += shard->bytes;
+    }
+    return bytes;
+}
+
+template <typename TKey, typename TValue>
+typename ConcurrentLruCache<TKey, TValue>::Stats
+ConcurrentLruCache<TKey, TValue>::getStats() const {
+    Stats stats = {};
+    for (const auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.evictions += shard->evictions;
+    }
+    return stats;
+}
+
+template <typename TKey, typename TValue>
+void ConcurrentLruCache<TKey, TValue>::resetStats() {
+    for (auto& shard : mShards) {
+        Mutex::Autolock _l(shard->lock);
+        shard->hits = 0;
+        shard->misses = 0;
+        shard->evictions = 0;
+    }
+}
+
+}  // namespace android
+
+#endif // ANDROID_UTILS_CONCURRENT_LRU_CACHE_H
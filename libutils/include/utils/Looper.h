@@ -24,6 +24,9 @@
 
 #include <sys/epoll.h>
 
+#include <unordered_map>
+#include <vector>
+
 namespace android {
 
 /*
@@ -428,29 +431,55 @@ private:
         void initEventItem(struct epoll_event* eventItem) const;
     };
 
+    // A ready fd waiting to be returned by pollOnce() or dispatched to its callback.
+    // The callback is not reference counted here; instead, callbacks removed while
+    // responses are pending are kept alive in mRetiredCallbacks until dispatch ends.
     struct Response {
+        int fd;
+        int ident;
         int events;
-        Request request;
+        int seq;
+        void* data;
+        LooperCallback* callback;
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
+        MessageEnvelope() : uptime(0), seq(0), heapIndex(0),
+                prevByHandler(NO_SLOT), nextByHandler(NO_SLOT) { }
 
         MessageEnvelope(nsecs_t u, const sp<MessageHandler> h,
-                const Message& m) : uptime(u), handler(h), message(m) {
+                const Message& m) : uptime(u), handler(h), message(m), seq(0), heapIndex(0),
+                prevByHandler(NO_SLOT), nextByHandler(NO_SLOT) {
         }
 
         nsecs_t uptime;
         sp<MessageHandler> handler;
         Message message;
+
+        // Messages with the same uptime are delivered in the order they were sent.
+        uint64_t seq;
+        // Position of this envelope in mMessageHeap.
+        size_t heapIndex;
+        // Neighbours in the list of slots holding messages for the same handler.
+        size_t prevByHandler;
+        size_t nextByHandler;
     };
 
+    static const size_t NO_SLOT = SIZE_MAX;
+
     const bool mAllowNonCallbacks; // immutable
 
     int mWakeEventFd;  // immutable
     Mutex mLock;
 
-    Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    // Pending messages live in mMessageSlots; mMessageHeap is a binary min-heap of slot
+    // indices ordered by (uptime, seq), and mMessageHandlerHeads links together the slots
+    // of each handler so that removeMessages() only visits that handler's messages.
+    std::vector<MessageEnvelope> mMessageSlots; // guarded by mLock
+    std::vector<size_t> mFreeMessageSlots; // guarded by mLock
+    std::vector<size_t> mMessageHeap; // guarded by mLock
+    std::unordered_map<MessageHandler*, size_t> mMessageHandlerHeads; // guarded by mLock
+    uint64_t mNextMessageSeq; // guarded by mLock
     bool mSendingMessage; // guarded by mLock
 
     // Whether we are currently waiting for work.  Not protected by a lock,
@@ -461,12 +490,19 @@ private:
     bool mEpollRebuildRequired; // guarded by mLock
 
     // Locked list of file descriptor monitoring requests.
-    KeyedVector<int, Request> mRequests;  // guarded by mLock
+    std::unordered_map<int, Request> mRequests;  // guarded by mLock
     int mNextRequestSeq;
 
+    // True from the moment responses are collected until their callbacks have all been
+    // invoked; callbacks dropped by addFd()/removeFd() in that window go to
+    // mRetiredCallbacks and are released once dispatch finishes.
+    bool mDispatchingCallbacks; // guarded by mLock
+    std::vector<sp<LooperCallback> > mRetiredCallbacks; // guarded by mLock
+
     // This state is only used privately by pollOnce and does not require a lock since
     // it runs on a single thread.
-    Vector<Response> mResponses;
+    std::vector<struct epoll_event> mEventItems;
+    std::vector<Response> mResponses;
     size_t mResponseIndex;
     nsecs_t mNextMessageUptime; // set to LLONG_MAX when none
 
@@ -474,6 +510,14 @@ private:
     int removeFd(int fd, int seq);
     void awoken();
     void pushResponse(int events, const Request& request);
+    void retireCallbackLocked(const sp<LooperCallback>& callback);
+    size_t enqueueMessageLocked(nsecs_t uptime, const sp<MessageHandler>& handler,
+            const Message& message);
+    void removeMessageLocked(size_t slot);
+    bool messageBeforeLocked(size_t a, size_t b) const;
+    void swapHeapEntriesLocked(size_t i, size_t j);
+    void siftUpLocked(size_t heapIndex);
+    void siftDownLocked(size_t heapIndex);
     void rebuildEpollLocked();
     void scheduleEpollRebuildLocked();
 
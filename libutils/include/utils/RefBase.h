@@ -148,6 +148,14 @@
 // object while there are still weak references. This is really special purpose
 // functionality to support Binder.
 
+// Objects that are rarely or never the target of a wp<> can pass
+// LAZY_WEAK_REFS to the RefBase constructor. The strong count is then kept in
+// the object itself, and the separately allocated weak reference bookkeeping
+// is only created by the first createWeak(), getWeakRefs() or
+// extendObjectLifetime() call. Until then, sp<> operations avoid both that
+// allocation and the pointer chase to it. sp<> and wp<> behave exactly as
+// they do for other RefBase objects.
+
 // Wp::promote(), implemented via the attemptIncStrong() member function, is
 // used to try to convert a weak pointer back to a strong pointer.  It's the
 // normal way to try to access the fields of an object referenced only through
@@ -290,7 +298,14 @@ public:
     typedef RefBase basetype;
 
 protected:
+    //! Flags for the RefBase(uint32_t) constructor
+    enum {
+        // Defer allocating the weak reference bookkeeping until it is needed.
+        LAZY_WEAK_REFS = 0x0001
+    };
+
                             RefBase();
+    explicit                RefBase(uint32_t flags);
     virtual                 ~RefBase();
     
     //! Flags for extendObjectLifetime()
@@ -340,7 +355,12 @@ private:
     static void renameRefId(RefBase* ref,
             const void* old_id, const void* new_id);
 
-        weakref_impl* const mRefs;
+    // Returns the weakref_impl, creating it first for LAZY_WEAK_REFS objects.
+            weakref_impl*   getRefs() const;
+
+    // A weakref_impl*, or, for a LAZY_WEAK_REFS object that doesn't have one
+    // yet, the strong count shifted left by one with the low bit set.
+    mutable std::atomic<uintptr_t> mRefs;
 };
 
 // ---------------------------------------------------------------------------
@@ -19,6 +19,7 @@
 
 #include <new>
 #include <type_traits>
+#include <utility>
 
 #include <stdint.h>
 #include <string.h>
@@ -185,6 +186,11 @@ void splat_type(TYPE* where, const TYPE* what, size_t n) {
     }
 }
 
+/*
+ * Moving an item that can't simply be memmove()d move-constructs it at its
+ * new location, then destroys the moved-from original.
+ */
+
 template<typename TYPE>
 struct use_trivial_move : public std::integral_constant<bool,
     (traits<TYPE>::has_trivial_dtor && traits<TYPE>::has_trivial_copy)
@@ -208,7 +214,7 @@ move_forward_type(TYPE* d, const TYPE* s, size_t n = 1) {
         n--;
         --d, --s;
         if (!traits<TYPE>::has_trivial_copy) {
-            new(d) TYPE(*s);
+            new(d) TYPE(std::move(*const_cast<TYPE*>(s)));
         } else {
             *d = *s;
         }
@@ -232,7 +238,7 @@ move_backward_type(TYPE* d, const TYPE* s, size_t n = 1) {
     while (n > 0) {
         n--;
         if (!traits<TYPE>::has_trivial_copy) {
-            new(d) TYPE(*s);
+            new(d) TYPE(std::move(*const_cast<TYPE*>(s)));
         } else {
             *d = *s;
         }
@@ -258,11 +264,17 @@ struct key_value_pair_t {
     VALUE   value;
     key_value_pair_t() { }
     key_value_pair_t(const key_value_pair_t& o) : key(o.key), value(o.value) { }
+    key_value_pair_t(key_value_pair_t&& o) : key(std::move(o.key)), value(std::move(o.value)) { }
     key_value_pair_t& operator=(const key_value_pair_t& o) {
         key = o.key;
         value = o.value;
         return *this;
     }
+    key_value_pair_t& operator=(key_value_pair_t&& o) {
+        key = std::move(o.key);
+        value = std::move(o.value);
+        return *this;
+    }
     key_value_pair_t(const KEY& k, const VALUE& v) : key(k), value(v)  { }
     explicit key_value_pair_t(const KEY& k) : key(k) { }
     inline bool operator < (const key_value_pair_t& o) const {
@@ -114,6 +114,14 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len);
  */
 void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst, size_t dst_len);
 
+/**
+ * Copies the ASCII characters at the start of UTF-16 string "src" to "dst",
+ * which must have room for "src_len" bytes, and returns how many it copied.
+ * Stops at the first character that is not ASCII. No NUL terminator is
+ * written.
+ */
+size_t utf16_to_utf8_ascii_prefix(const char16_t* src, size_t src_len, char* dst);
+
 /**
  * Returns the length of "src" when "src" is valid UTF-8 string.
  * Returns 0 if src is NULL or 0-length string. Returns -1 when the source
@@ -173,6 +181,15 @@ char16_t* utf8_to_utf16_no_null_terminator(
 char16_t *utf8_to_utf16(
         const uint8_t* src, size_t srcLen, char16_t* dst, size_t dstLen);
 
+/**
+ * Convert UTF-8 to UTF-16 including surrogate pairs without measuring it first. "dst" must have
+ * room for "srcLen" characters, which is always enough. Returns the number of characters written,
+ * which is what utf8_to_utf16_length would have returned, or -1 if utf8_to_utf16_length would
+ * have returned -1, in which case the contents of "dst" are unspecified. No NUL terminator is
+ * written. Aborts if srcLen > SSIZE_MAX.
+ */
+ssize_t utf8_to_utf16_single_pass(const uint8_t* src, size_t srcLen, char16_t* dst);
+
 }
 
 #endif
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/ConcurrentLruCache.h>
+
+namespace android {
+
+typedef ConcurrentLruCache<int, std::string> StringCache;
+
+static size_t stringSizeOf(const int&, const std::string& value) {
+    return value.size();
+}
+
+TEST(ConcurrentLruCacheTest, Empty) {
+    StringCache cache(100);
+    std::string value;
+
+    EXPECT_FALSE(cache.get(0, &value));
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_EQ(0u, cache.sizeInBytes());
+}
+
+TEST(ConcurrentLruCacheTest, Simple) {
+    StringCache cache(1024);
+    std::string value;
+
+    EXPECT_TRUE(cache.put(1, "one"));
+    EXPECT_TRUE(cache.put(2, "two"));
+    EXPECT_FALSE(cache.put(2, "deux"));
+    ASSERT_TRUE(cache.get(1, &value));
+    EXPECT_EQ("one", value);
+    ASSERT_TRUE(cache.get(2, &value));
+    EXPECT_EQ("two", value);
+    EXPECT_EQ(2u, cache.size());
+
+    EXPECT_TRUE(cache.remove(1));
+    EXPECT_FALSE(cache.remove(1));
+    EXPECT_FALSE(cache.get(1, &value));
+    EXPECT_EQ(1u, cache.size());
+}
+
+TEST(ConcurrentLruCacheTest, EvictsLeastRecentlyUsedBytes) {
+    // A single shard, so the LRU order is global.
+    StringCache cache(10, 1, stringSizeOf);
+    std::string value;
+
+    EXPECT_TRUE(cache.put(1, "aaaa"));
+    EXPECT_TRUE(cache.put(2, "bbbb"));
+    EXPECT_EQ(8u, cache.sizeInBytes());
+    EXPECT_TRUE(cache.get(1, &value));
+
+    // Needs 3 more bytes than are free: 2 is the least recently used.
+    EXPECT_TRUE(cache.put(3, "ccccc"));
+    EXPECT_TRUE(cache.get(1, &value));
+    EXPECT_FALSE(cache.get(2, &value));
+    EXPECT_TRUE(cache.get(3, &value));
+    EXPECT_EQ(9u, cache.sizeInBytes());
+
+    // Too big to ever fit.
+    EXPECT_FALSE(cache.put(4, "ddddddddddd"));
+    EXPECT_EQ(2u, cache.size());
+
+    StringCache::Stats stats = cache.getStats();
+    EXPECT_EQ(3u, stats.hits);
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(1u, stats.evictions);
+
+    cache.resetStats();
+    stats = cache.getStats();
+    EXPECT_EQ(0u, stats.hits + stats.misses + stats.evictions);
+}
+
+TEST(ConcurrentLruCacheTest, ShardsShareCapacity) {
+    // 6 shards round up to 8, of 125 bytes each.
+    StringCache cache(1000, 6, stringSizeOf);
+    EXPECT_EQ(1000u, cache.maxBytes());
+
+    for (int i = 0; i < 1000; i++) {
+        cache.put(i, "0123456789");
+    }
+    EXPECT_LE(cache.sizeInBytes(), cache.maxBytes());
+    EXPECT_GT(cache.sizeInBytes(), cache.maxBytes() - 8 * 10);
+    EXPECT_EQ(cache.sizeInBytes(), cache.size() * 10);
+
+    cache.clear();
+    EXPECT_EQ(0u, cache.size());
+    EXPECT_EQ(0u, cache.sizeInBytes());
+}
+
+TEST(ConcurrentLruCacheTest, ConcurrentAccess) {
+    const int kThreads = 4;
+    const int kKeys = 1024;
+    const int kIters = 20000;
+    ConcurrentLruCache<int, int> cache(kKeys / 2 * (sizeof(int) + sizeof(int)));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&cache, t] {
+            uint32_t seed = t;
+            for (int i = 0; i < kIters; i++) {
+                seed = seed * 1103515245 + 12345;
+                int key = (seed >> 8) % kKeys;
+                int value;
+                if (cache.get(key, &value)) {
+                    EXPECT_EQ(key * 3, value);
+                } else {
+                    cache.put(key, key * 3);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ConcurrentLruCache<int, int>::Stats stats = cache.getStats();
+    EXPECT_EQ(uint64_t(kThreads * kIters), stats.hits + stats.misses);
+    EXPECT_GT(stats.hits, 0u);
+    EXPECT_LE(cache.sizeInBytes(), cache.maxBytes());
+}
+
+}  // namespace android
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <utils/Looper.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class NopMessageHandler : public MessageHandler {
+public:
+    virtual void handleMessage(const Message&) {}
+};
+
+// Delays spread pseudo-randomly over one hour so that inserts land all over the queue.
+static nsecs_t delayFor(int i) {
+    return seconds_to_nanoseconds(3600) + ms2ns((i * 7919) % 3600000);
+}
+
+// Enqueues state.range(0) delayed messages behind the same number of already-queued ones.
+static void BM_Looper_sendMessageDelayed(benchmark::State& state) {
+    sp<Looper> looper = new Looper(false);
+    sp<MessageHandler> handler = new NopMessageHandler();
+    int count = state.range(0);
+    for (int i = 0; i < count; i++) {
+        looper->sendMessageDelayed(delayFor(i), handler, Message(i));
+    }
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        sp<MessageHandler> batch = new NopMessageHandler();
+        state.ResumeTiming();
+
+        for (int i = 0; i < count; i++) {
+            looper->sendMessageDelayed(delayFor(i + count), batch, Message(i));
+        }
+
+        state.PauseTiming();
+        looper->removeMessages(batch);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_Looper_sendMessageDelayed)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Delivers state.range(0) due messages through pollOnce().
+static void BM_Looper_dispatchMessages(benchmark::State& state) {
+    sp<Looper> looper = new Looper(false);
+    sp<MessageHandler> handler = new NopMessageHandler();
+    int count = state.range(0);
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < count; i++) {
+            looper->sendMessageAtTime(now - delayFor(i), handler, Message(i));
+        }
+        state.ResumeTiming();
+
+        looper->pollOnce(0);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_Looper_dispatchMessages)->Arg(100)->Arg(1000)->Arg(10000);
+
+// Removes one message type for one of 100 handlers sharing a queue of state.range(0) messages.
+static void BM_Looper_removeMessages(benchmark::State& state) {
+    sp<Looper> looper = new Looper(false);
+    const int kHandlers = 100;
+    sp<MessageHandler> handlers[kHandlers];
+    for (int i = 0; i < kHandlers; i++) {
+        handlers[i] = new NopMessageHandler();
+    }
+    int count = state.range(0);
+    for (int i = 0; i < count; i++) {
+        looper->sendMessageDelayed(delayFor(i), handlers[i % kHandlers], Message(i % 4));
+    }
+
+    int i = 0;
+    while (state.KeepRunning()) {
+        const sp<MessageHandler>& handler = handlers[i++ % kHandlers];
+        looper->removeMessages(handler, 1);
+
+        state.PauseTiming();
+        for (int j = 0; j < count / kHandlers / 4; j++) {
+            looper->sendMessageDelayed(delayFor(j), handler, Message(1));
+        }
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_Looper_removeMessages)->Arg(1000)->Arg(10000)->Arg(100000);
+
+class NopLooperCallback : public LooperCallback {
+public:
+    virtual int handleEvent(int fd, int, void*) {
+        char buf[16];
+        read(fd, buf, sizeof(buf));
+        return 1;
+    }
+};
+
+// Dispatches one callback for each of state.range(0) pipes that are all readable at once.
+static void BM_Looper_dispatchCallbacks(benchmark::State& state) {
+    sp<Looper> looper = new Looper(false);
+    sp<LooperCallback> callback = new NopLooperCallback();
+    int count = state.range(0);
+    std::vector<int> readFds;
+    std::vector<int> writeFds;
+    for (int i = 0; i < count; i++) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            state.SkipWithError("pipe failed");
+            return;
+        }
+        looper->addFd(fds[0], 0, Looper::EVENT_INPUT, callback, NULL);
+        readFds.push_back(fds[0]);
+        writeFds.push_back(fds[1]);
+    }
+
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        for (int fd : writeFds) {
+            write(fd, "x", 1);
+        }
+        state.ResumeTiming();
+
+        looper->pollOnce(0);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+
+    for (int i = 0; i < count; i++) {
+        looper->removeFd(readFds[i]);
+        close(readFds[i]);
+        close(writeFds[i]);
+    }
+}
+BENCHMARK(BM_Looper_dispatchCallbacks)->Arg(1)->Arg(16)->Arg(64)->Arg(256);
+
+}  // namespace android
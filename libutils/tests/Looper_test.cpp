@@ -8,6 +8,8 @@
 #include <gtest/gtest.h>
 #include <unistd.h>
 #include <time.h>
+#include <memory>
+#include <vector>
 
 #include "TestHelpers.h"
 
@@ -690,4 +692,144 @@ TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesForHandler_ShouldRemove
             << "no more messages to handle";
 }
 
+TEST_F(LooperTest, SendMessageAtTime_WhenSentOutOfOrder_ShouldInvokeHandlerInTimeOrder) {
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    // Send in a scrambled time order with pairs of messages sharing an uptime; those must
+    // keep their send order.
+    const int kCount = 1000;
+    for (int i = 0; i < kCount; i++) {
+        int group = (i * 7919) % kCount / 2;
+        mLooper->sendMessageAtTime(now - ms2ns(kCount - group), handler, Message(i));
+    }
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(kCount), handler->messages.size())
+            << "all messages should be handled";
+    for (int i = 1; i < kCount; i++) {
+        int previous = handler->messages[i - 1].what;
+        int current = handler->messages[i].what;
+        int previousGroup = (previous * 7919) % kCount / 2;
+        int currentGroup = (current * 7919) % kCount / 2;
+        EXPECT_LE(previousGroup, currentGroup)
+                << "messages should be handled in uptime order";
+        if (previousGroup == currentGroup) {
+            EXPECT_LT(previous, current)
+                    << "messages with the same uptime should be handled in send order";
+        }
+    }
+}
+
+TEST_F(LooperTest, RemoveMessage_WhenHandlersAreInterleaved_ShouldOnlyRemoveThoseMessages) {
+    sp<StubMessageHandler> handler1 = new StubMessageHandler();
+    sp<StubMessageHandler> handler2 = new StubMessageHandler();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < 100; i++) {
+        mLooper->sendMessageAtTime(now - ms2ns(100 - i), (i % 2) ? handler1 : handler2,
+                Message(i % 4));
+    }
+    mLooper->removeMessages(handler1, MSG_TEST1);
+    mLooper->removeMessages(handler2);
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    EXPECT_EQ(size_t(0), handler2->messages.size())
+            << "all messages for handler2 were removed";
+    ASSERT_EQ(size_t(25), handler1->messages.size())
+            << "only MSG_TEST3 messages for handler1 should remain";
+    for (size_t i = 0; i < handler1->messages.size(); i++) {
+        EXPECT_EQ(MSG_TEST3, handler1->messages[i].what)
+                << "handled message";
+    }
+}
+
+TEST_F(LooperTest, PollOnce_WhenManyFdsAreSignalled_ShouldInvokeAllCallbacks) {
+    // More fds than fit in the initial epoll event array.
+    const size_t kCount = 100;
+    Pipe pipes[kCount];
+    std::vector<std::unique_ptr<StubCallbackHandler> > handlers;
+    for (size_t i = 0; i < kCount; i++) {
+        handlers.emplace_back(new StubCallbackHandler(true));
+    }
+    for (size_t i = 0; i < kCount; i++) {
+        handlers[i]->setCallback(mLooper, pipes[i].receiveFd, Looper::EVENT_INPUT);
+        pipes[i].writeSignal();
+    }
+
+    for (int i = 0; i < 10; i++) {
+        mLooper->pollOnce(0);
+    }
+
+    for (size_t i = 0; i < kCount; i++) {
+        EXPECT_LE(1, handlers[i]->callbackCount)
+                << "callback should have been invoked for every signalled fd";
+        EXPECT_EQ(pipes[i].receiveFd, handlers[i]->fd)
+                << "callback should have received the registered fd";
+    }
+}
+
+class RemovingLooperCallback : public LooperCallback {
+public:
+    RemovingLooperCallback(const sp<Looper>& looper, int* invocations, bool* destroyed) :
+            mLooper(looper), mInvocations(invocations), mDestroyed(destroyed), mRemoveFd(-1) {
+    }
+
+    virtual ~RemovingLooperCallback() {
+        *mDestroyed = true;
+    }
+
+    void setFdToRemove(int fd) {
+        mRemoveFd = fd;
+    }
+
+    virtual int handleEvent(int, int, void*) {
+        (*mInvocations)++;
+        if (mRemoveFd != -1) {
+            mLooper->removeFd(mRemoveFd);
+        }
+        return 1;
+    }
+
+private:
+    sp<Looper> mLooper;
+    int* mInvocations;
+    bool* mDestroyed;
+    int mRemoveFd;
+};
+
+TEST_F(LooperTest, PollOnce_WhenCallbackRemovesAnotherPendingFd_ShouldKeepItAliveUntilDispatchEnds) {
+    Pipe pipe1, pipe2;
+    int invocations = 0;
+    bool destroyed1 = false, destroyed2 = false;
+    sp<RemovingLooperCallback> callback1 =
+            new RemovingLooperCallback(mLooper, &invocations, &destroyed1);
+    {
+        sp<RemovingLooperCallback> callback2 =
+                new RemovingLooperCallback(mLooper, &invocations, &destroyed2);
+        callback1->setFdToRemove(pipe2.receiveFd);
+        callback2->setFdToRemove(pipe1.receiveFd);
+        mLooper->addFd(pipe1.receiveFd, 0, Looper::EVENT_INPUT, callback1, NULL);
+        mLooper->addFd(pipe2.receiveFd, 0, Looper::EVENT_INPUT, callback2, NULL);
+    }
+    pipe1.writeSignal();
+    pipe2.writeSignal();
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because fds were signalled";
+    EXPECT_EQ(2, invocations)
+            << "both callbacks collected by the poll should have been invoked";
+    EXPECT_FALSE(destroyed1)
+            << "callback1 is still referenced by the test";
+    EXPECT_TRUE(destroyed2)
+            << "callback2 should be released once dispatch has finished";
+}
+
 } // namespace android
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <utils/ConcurrentLruCache.h>
+#include <utils/LruCache.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+// Every thread looks up random keys out of kKeys, inserting the ones that
+// miss, in a cache with room for a quarter of them.
+
+static const int kKeys = 4096;
+static const int kCapacity = kKeys / 4;
+
+static int NextKey(uint32_t* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 8) % kKeys;
+}
+
+// What callers do with LruCache today: one lock around the whole cache.
+static void BM_LruCache_locked(benchmark::State& state) {
+    static Mutex lock;
+    static LruCache<int, intptr_t> cache(kCapacity);
+    uint32_t seed = state.thread_index + 1;
+    while (state.KeepRunning()) {
+        int key = NextKey(&seed);
+        Mutex::Autolock _l(lock);
+        if (cache.get(key) == 0) {
+            cache.put(key, key + 1);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LruCache_locked)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_ConcurrentLruCache(benchmark::State& state) {
+    static ConcurrentLruCache<int, intptr_t> cache(kCapacity * (sizeof(int) + sizeof(intptr_t)));
+    uint32_t seed = state.thread_index + 1;
+    while (state.KeepRunning()) {
+        int key = NextKey(&seed);
+        intptr_t value;
+        if (!cache.get(key, &value)) {
+            cache.put(key, key + 1);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConcurrentLruCache)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace android
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <utils/RefBase.h>
+#include <utils/StrongPointer.h>
+
+namespace android {
+
+class EagerObject : public RefBase {
+};
+
+class LazyObject : public RefBase {
+public:
+    LazyObject() : RefBase(LAZY_WEAK_REFS) {}
+};
+
+// Creates and destroys state.range(0) objects held only through sp<>.
+template <typename T>
+static void BM_RefBase_createDestroy(benchmark::State& state) {
+    std::vector<sp<T>> objects(state.range(0));
+    while (state.KeepRunning()) {
+        for (auto& object : objects) {
+            object = new T();
+        }
+        for (auto& object : objects) {
+            object.clear();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_RefBase_createDestroy, EagerObject)->Arg(1)->Arg(1 << 10)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_RefBase_createDestroy, LazyObject)->Arg(1)->Arg(1 << 10)->Arg(1 << 20);
+
+// Copies and drops an sp<> to an object that already has a strong reference.
+template <typename T>
+static void BM_RefBase_copy(benchmark::State& state) {
+    sp<T> object = new T();
+    while (state.KeepRunning()) {
+        sp<T> copy(object);
+        benchmark::DoNotOptimize(copy.get());
+    }
+}
+BENCHMARK_TEMPLATE(BM_RefBase_copy, EagerObject);
+BENCHMARK_TEMPLATE(BM_RefBase_copy, LazyObject);
+
+// Creates an object, takes the first weak reference to it, and destroys it.
+template <typename T>
+static void BM_RefBase_createWeak(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        sp<T> object = new T();
+        wp<T> weak(object);
+        benchmark::DoNotOptimize(weak.unsafe_get());
+    }
+}
+BENCHMARK_TEMPLATE(BM_RefBase_createWeak, EagerObject);
+BENCHMARK_TEMPLATE(BM_RefBase_createWeak, LazyObject);
+
+}  // namespace android
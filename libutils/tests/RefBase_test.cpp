@@ -256,3 +256,126 @@ TEST(RefBase, RacingPromotions) {
         ASSERT_EQ(NITERS, deleteCount) << "Deletions missed!";
     }  // Otherwise this is slow and probably pointless on a uniprocessor.
 }
+
+class LazyFoo : public RefBase {
+public:
+    LazyFoo(bool* deleted_check) : RefBase(LAZY_WEAK_REFS), mDeleted(deleted_check) {
+        *mDeleted = false;
+    }
+
+    ~LazyFoo() {
+        *mDeleted = true;
+    }
+private:
+    bool* mDeleted;
+};
+
+TEST(RefBase, LazyStrongOnly) {
+    bool isDeleted;
+    LazyFoo* foo = new LazyFoo(&isDeleted);
+    ASSERT_EQ(INITIAL_STRONG_VALUE, foo->getStrongCount());
+    sp<LazyFoo> sp1(foo);
+    ASSERT_EQ(1, foo->getStrongCount());
+    {
+        sp<LazyFoo> sp2 = sp1;
+        ASSERT_EQ(2, foo->getStrongCount());
+    }
+    ASSERT_EQ(1, foo->getStrongCount());
+    ASSERT_FALSE(isDeleted) << "deleted too early! still has a reference!";
+    sp1 = nullptr;
+    ASSERT_TRUE(isDeleted) << "foo was leaked!";
+}
+
+TEST(RefBase, LazyWeakAfterStrong) {
+    bool isDeleted;
+    LazyFoo* foo = new LazyFoo(&isDeleted);
+    sp<LazyFoo> sp1(foo);
+    sp<LazyFoo> sp2(foo);
+    wp<LazyFoo> wp1(sp1);
+    ASSERT_EQ(2, foo->getStrongCount());
+    // Weak count includes both strong and weak references.
+    ASSERT_EQ(3, foo->getWeakRefs()->getWeakCount());
+    {
+        sp<LazyFoo> sp3 = wp1.promote();
+        ASSERT_EQ(foo, sp3.get());
+        ASSERT_EQ(3, foo->getStrongCount());
+    }
+    sp1 = nullptr;
+    sp2 = nullptr;
+    ASSERT_TRUE(isDeleted) << "foo was leaked!";
+    ASSERT_TRUE(wp1.promote().get() == nullptr);
+}
+
+TEST(RefBase, LazyWeakBeforeStrong) {
+    bool isDeleted;
+    LazyFoo* foo = new LazyFoo(&isDeleted);
+    wp<LazyFoo> wp1(foo);
+    EXPECT_EQ(1, foo->getWeakRefs()->getWeakCount());
+    ASSERT_EQ(INITIAL_STRONG_VALUE, foo->getStrongCount());
+    {
+        sp<LazyFoo> sp1 = wp1.promote();
+        ASSERT_EQ(foo, sp1.get());
+        ASSERT_EQ(1, foo->getStrongCount());
+    }
+    ASSERT_TRUE(isDeleted) << "foo was leaked!";
+    ASSERT_TRUE(wp1.promote().get() == nullptr);
+}
+
+class LazyBar : public RefBase {
+public:
+    LazyBar(std::atomic<int>* delete_count) : RefBase(LAZY_WEAK_REFS),
+            mDeleteCount(delete_count) {
+    }
+
+    ~LazyBar() {
+        (*mDeleteCount)++;
+    }
+private:
+    std::atomic<int>* mDeleteCount;
+};
+
+static sp<LazyBar> lazyBuffer;
+static std::atomic<bool> lazyBufferFull(false);
+
+// Takes and drops strong references while the other thread creates the first weak one.
+static void copyAndRemove() {
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &otherCpus) != 0) {
+        FAIL() << "setaffinity returned:" << errno;
+    }
+    for (int i = 0; i < NITERS; ++i) {
+        while (!lazyBufferFull) {}
+        for (int j = 0; j < 10; ++j) {
+            sp<LazyBar> copy = lazyBuffer;
+        }
+        lazyBuffer = nullptr;
+        lazyBufferFull = false;
+    }
+}
+
+TEST(RefBase, LazyRacingWeakCreation) {
+    cpu_set_t origCpus;
+    cpu_set_t myCpus;
+    if (setExclusiveCpus(&origCpus, &myCpus, &otherCpus)) {
+        std::thread t(copyAndRemove);
+        std::atomic<int> deleteCount(0);
+        if (sched_setaffinity(0, sizeof(cpu_set_t), &myCpus) != 0) {
+            FAIL() << "setaffinity returned:" << errno;
+        }
+        for (int i = 0; i < NITERS; ++i) {
+            sp<LazyBar> sp1 = new LazyBar(&deleteCount);
+            lazyBuffer = sp1;
+            lazyBufferFull = true;
+            // Creating the first weak reference races with the strong
+            // reference updates in copyAndRemove.
+            wp<LazyBar> wp1(sp1);
+            sp1 = nullptr;
+            while (lazyBufferFull) {}
+            ASSERT_EQ(nullptr, wp1.promote().get()) << "Dead wp promotion succeeded!";
+            ASSERT_EQ(i + 1, deleteCount) << "Deletions missed!";
+        }
+        t.join();
+        if (sched_setaffinity(0, sizeof(cpu_set_t), &origCpus) != 0) {
+            FAIL();
+        }
+    }  // Otherwise this is slow and probably pointless on a uniprocessor.
+}
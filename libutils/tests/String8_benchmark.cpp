@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utility>
+
+#include <benchmark/benchmark.h>
+
+#include <utils/String8.h>
+#include <utils/String16.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// The operations exercised by String8_test, on a short and a long string.
+
+static const char* const kShort = "Hello, ";
+static const char* const kLong = "/system/framework/arm64/boot-framework.oat";
+
+static void BM_String8_construct(benchmark::State& state) {
+    const char* text = state.range(0) ? kLong : kShort;
+    while (state.KeepRunning()) {
+        String8 string(text);
+        benchmark::DoNotOptimize(string.string());
+    }
+}
+BENCHMARK(BM_String8_construct)->Arg(0)->Arg(1);
+
+static void BM_String8_copy(benchmark::State& state) {
+    const String8 text(state.range(0) ? kLong : kShort);
+    while (state.KeepRunning()) {
+        String8 copy(text);
+        benchmark::DoNotOptimize(copy.string());
+    }
+}
+BENCHMARK(BM_String8_copy)->Arg(0)->Arg(1);
+
+static void BM_String8_operatorPlus(benchmark::State& state) {
+    const String8 src(state.range(0) ? kLong : kShort);
+    while (state.KeepRunning()) {
+        String8 result = src + "world!";
+        benchmark::DoNotOptimize(result.string());
+    }
+}
+BENCHMARK(BM_String8_operatorPlus)->Arg(0)->Arg(1);
+
+static void BM_String8_format(benchmark::State& state) {
+    int i = 0;
+    while (state.KeepRunning()) {
+        String8 result = String8::format("uid=%d", i++);
+        benchmark::DoNotOptimize(result.string());
+    }
+}
+BENCHMARK(BM_String8_format);
+
+// Builds "0,1,2,..." of state.range(0) numbers with appendFormat().
+static void BM_String8_appendFormat(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        String8 result;
+        for (int i = 0; i < state.range(0); i++) {
+            result.appendFormat("%d,", i);
+        }
+        benchmark::DoNotOptimize(result.string());
+    }
+}
+BENCHMARK(BM_String8_appendFormat)->Arg(4)->Arg(64);
+
+// Splits a path into its components and collects them, as path-handling
+// callers of walkPath() do.
+static void BM_String8_walkPath(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        Vector<String8> components;
+        String8 remains(kLong);
+        while (!remains.isEmpty()) {
+            components.add(remains.walkPath(&remains));
+        }
+        benchmark::DoNotOptimize(components.array());
+    }
+}
+BENCHMARK(BM_String8_walkPath);
+
+static void BM_String16_fromString8(benchmark::State& state) {
+    const String8 text(state.range(0) ? kLong : "uid");
+    while (state.KeepRunning()) {
+        String16 string(text);
+        benchmark::DoNotOptimize(string.string());
+    }
+}
+BENCHMARK(BM_String16_fromString8)->Arg(0)->Arg(1);
+
+}  // namespace android
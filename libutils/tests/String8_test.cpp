@@ -18,6 +18,7 @@
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
+#include <utils/Vector.h>
 
 #include <gtest/gtest.h>
 
@@ -88,6 +89,133 @@ TEST_F(String8Test, CorrectInvalidSurrogate) {
     EXPECT_EQ(4U, string8.length());
 }
 
+TEST_F(String8Test, Utf16RoundTrip) {
+    // All ASCII, which converts without measuring, then the same with
+    // characters that make the UTF-8 longer and the UTF-16 shorter.
+    const char* ascii = "The quick brown fox jumps over the lazy dog";
+    String16 ascii16(ascii);
+    EXPECT_EQ(strlen(ascii), ascii16.size());
+    EXPECT_STREQ(ascii, String8(ascii16).string());
+
+    const char* mixed = "The quick brown \xe7\x8b\x90 jumps over the \xf0\x9f\x90\xb6";
+    String16 mixed16(mixed);
+    EXPECT_EQ(strlen("The quick brown ") + 1 + strlen(" jumps over the ") + 2, mixed16.size());
+    EXPECT_STREQ(mixed, String8(mixed16).string());
+}
+
+// Copies and moves of strings of many lengths, for both classes.
+TEST_F(String8Test, LengthsCopiesAndMoves) {
+    const char* text = "0123456789abcdefghijklmnopqrstuvwxyz";
+    for (size_t len = 0; len <= strlen(text); len++) {
+        SCOPED_TRACE(len);
+        String8 s(text, len);
+        EXPECT_EQ(len, s.length());
+        EXPECT_EQ(0, strncmp(text, s.string(), len));
+        EXPECT_EQ('\0', s.string()[len]);
+
+        String8 copy(s);
+        String8 moved(std::move(copy));
+        EXPECT_EQ(s, moved);
+        EXPECT_EQ(0U, copy.length());
+        EXPECT_STREQ("", copy.string());
+
+        String16 s16(s);
+        EXPECT_EQ(len, s16.size());
+        EXPECT_EQ(s, String8(s16));
+        String16 moved16(std::move(s16));
+        EXPECT_EQ(0U, s16.size());
+        EXPECT_EQ(len, moved16.size());
+    }
+}
+
+TEST_F(String8Test, GrowAndShrinkInPlace) {
+    String8 s;
+    for (int i = 0; i < 10; i++) {
+        s.appendFormat("%d,", i);
+    }
+    EXPECT_STREQ("0,1,2,3,4,5,6,7,8,9,", s.string());
+
+    String8 copy(s);
+    EXPECT_TRUE(s.removeAll(","));
+    EXPECT_STREQ("0123456789", s.string());
+    EXPECT_STREQ("0,1,2,3,4,5,6,7,8,9,", copy.string());
+
+    s.append(s);
+    EXPECT_STREQ("01234567890123456789", s.string());
+    s.append(s.string() + 15, 3);
+    EXPECT_STREQ("01234567890123456789567", s.string());
+
+    String8 path("a/b");
+    path.appendPath("c");
+    EXPECT_STREQ("a/b/c", path.string());
+    path.appendPath("a_much_longer_leaf_name");
+    EXPECT_STREQ("a/b/c/a_much_longer_leaf_name", path.string());
+    EXPECT_STREQ("a/b/c", path.getPathDir().string());
+    path.setPathName("x/");
+    EXPECT_STREQ("x", path.string());
+}
+
+TEST_F(String8Test, String16Edits) {
+    String16 s("Abc");
+    String16 copy(s);
+    s.append(s);
+    EXPECT_EQ(String16("AbcAbc"), s);
+    s.append(s);
+    EXPECT_EQ(String16("AbcAbcAbcAbc"), s);
+    s.insert(3, u"--");
+    EXPECT_EQ(String16("Abc--AbcAbcAbc"), s);
+
+    String16 shared(s);
+    s.makeLower();
+    s.replaceAll('-', '+');
+    EXPECT_EQ(String16("abc++abcabcabc"), s);
+    EXPECT_EQ(String16("Abc--AbcAbcAbc"), shared);
+    EXPECT_EQ(String16("Abc"), copy);
+
+    s.remove(4, 5);
+    EXPECT_EQ(String16("abca"), s);
+    s.setTo(s.string() + 1, 2);
+    EXPECT_EQ(String16("bc"), s);
+    s.setTo(shared, 8, 3);
+    EXPECT_EQ(String16("--AbcAbc"), s);
+
+    // Shrinking onto a tail of itself, with the buffer unique and shared.
+    String16 tail("0123456789abcdef");
+    tail.setTo(tail.string() + 10, 6);
+    EXPECT_EQ(String16("abcdef"), tail);
+    tail.setTo(u"0123456789abcdef");
+    String16 kept(tail);
+    tail.setTo(tail.string() + 10, 6);
+    EXPECT_EQ(String16("abcdef"), tail);
+    EXPECT_EQ(String16("0123456789abcdef"), kept);
+}
+
+// Both classes are a single pointer to their characters, which stay put when the
+// object is moved or relocated by a Vector.
+TEST_F(String8Test, StorageIsStableAcrossMoves) {
+    static_assert(sizeof(String8) == sizeof(void*), "String8 must stay one pointer");
+    static_assert(sizeof(String16) == sizeof(void*), "String16 must stay one pointer");
+
+    String8 s("abc");
+    const char* chars = s.string();
+    String8 moved(std::move(s));
+    EXPECT_EQ(chars, moved.string());
+    s = std::move(moved);
+    EXPECT_EQ(chars, s.string());
+
+    String16 s16("abc");
+    const char16_t* chars16 = s16.string();
+    String16 moved16(std::move(s16));
+    EXPECT_EQ(chars16, moved16.string());
+
+    Vector<String8> v;
+    v.add(s);
+    for (int i = 0; i < 100; i++) {
+        v.add(String8::format("%d", i));
+    }
+    EXPECT_EQ(chars, v[0].string());
+}
+
 TEST_F(String8Test, CheckUtf32Conversion) {
     // Since bound checks were added, check the conversion can be done without fatal errors.
     // The utf8 lengths of these are chars are 1 + 2 + 3 + 4 = 10.
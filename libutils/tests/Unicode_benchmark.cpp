@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <utils/String8.h>
+#include <utils/String16.h>
+#include <utils/Unicode.h>
+
+namespace android {
+
+enum Text {
+    // Identifiers, paths and the like, with the odd accented letter.
+    MOSTLY_ASCII,
+    // Chinese prose with some ASCII punctuation and digits.
+    CJK,
+};
+
+// Returns state.range(0) characters of the text selected by state.range(1), as UTF-8.
+static std::string MakeText(benchmark::State& state) {
+    const char* const pieces[] = {
+        "com.android.settings/.SubSettings", "\xc3\xa9", "/system/framework/",
+        "\xe4\xb8\xad\xe6\x96\x87", "\xe6\xb5\x8b\xe8\xaf\x95", "12", "\xe3\x80\x82",
+    };
+    std::string text;
+    for (int i = 0; utf8_to_utf16_length(reinterpret_cast<const uint8_t*>(text.data()),
+                                         text.size()) < state.range(0); i++) {
+        if (state.range(1) == MOSTLY_ASCII) {
+            text += pieces[i % 3];
+        } else {
+            text += pieces[3 + i % 4];
+        }
+    }
+    // Trim to a whole number of characters.
+    while (utf8_to_utf16_length(reinterpret_cast<const uint8_t*>(text.data()), text.size()) !=
+           state.range(0)) {
+        text.pop_back();
+    }
+    return text;
+}
+
+static void TextArgs(benchmark::internal::Benchmark* b) {
+    for (int text : {MOSTLY_ASCII, CJK}) {
+        for (int len : {16, 256, 4096}) {
+            b->Args({len, text});
+        }
+    }
+}
+
+static void BM_Unicode_utf8_to_utf16(benchmark::State& state) {
+    const std::string text = MakeText(state);
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(text.data());
+    std::vector<char16_t> dst(state.range(0) + 1);
+    while (state.KeepRunning()) {
+        ssize_t len = utf8_to_utf16_length(src, text.size());
+        utf8_to_utf16(src, text.size(), dst.data(), len + 1);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_Unicode_utf8_to_utf16)->Apply(TextArgs);
+
+static void BM_Unicode_utf16_to_utf8(benchmark::State& state) {
+    const String16 text(MakeText(state).c_str());
+    std::vector<char> dst(3 * text.size() + 1);
+    while (state.KeepRunning()) {
+        ssize_t len = utf16_to_utf8_length(text.string(), text.size());
+        utf16_to_utf8(text.string(), text.size(), dst.data(), len + 1);
+    }
+    state.SetBytesProcessed(state.iterations() * text.size() * sizeof(char16_t));
+}
+BENCHMARK(BM_Unicode_utf16_to_utf8)->Apply(TextArgs);
+
+static void BM_String16_fromUtf8(benchmark::State& state) {
+    const std::string text = MakeText(state);
+    while (state.KeepRunning()) {
+        String16 string(text.data(), text.size());
+        benchmark::DoNotOptimize(string.string());
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_String16_fromUtf8)->Apply(TextArgs);
+
+static void BM_String8_fromUtf16(benchmark::State& state) {
+    const String16 text(MakeText(state).c_str());
+    while (state.KeepRunning()) {
+        String8 string(text);
+        benchmark::DoNotOptimize(string.string());
+    }
+    state.SetBytesProcessed(state.iterations() * text.size() * sizeof(char16_t));
+}
+BENCHMARK(BM_String8_fromUtf16)->Apply(TextArgs);
+
+}  // namespace android
@@ -18,8 +18,13 @@
 #include <utils/Log.h>
 #include <utils/Unicode.h>
 
+#include <string.h>
+
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace android {
 
 class UnicodeTest : public testing::Test {
@@ -114,6 +119,78 @@ TEST_F(UnicodeTest, UTF8toUTF16Normal) {
             << "should be NULL terminated";
 }
 
+TEST_F(UnicodeTest, UTF8toUTF16SinglePass) {
+    const uint8_t str[] = {
+        0x30, // U+0030, 1 UTF-16 character
+        0xC4, 0x80, // U+0100, 1 UTF-16 character
+        0xE2, 0x8C, 0xA3, // U+2323, 1 UTF-16 character
+        0xF0, 0x90, 0x80, 0x80, // U+10000, 2 UTF-16 character
+    };
+    char16_t output[sizeof(str)];
+
+    EXPECT_EQ(5, utf8_to_utf16_single_pass(str, sizeof(str), output));
+    EXPECT_EQ(0x0030, output[0]);
+    EXPECT_EQ(0x0100, output[1]);
+    EXPECT_EQ(0x2323, output[2]);
+    EXPECT_EQ(0xD800, output[3]);
+    EXPECT_EQ(0xDC00, output[4]);
+
+    // Truncated U+2323 SMILE
+    EXPECT_EQ(-1, utf8_to_utf16_single_pass(str, 5, output))
+            << "Truncated UTF-8 should return -1 to indicate invalid";
+}
+
+// The ASCII fast paths work on blocks of characters, so put one non-ASCII
+// character at every position in and around the first few blocks.
+TEST_F(UnicodeTest, NonASCIIAtEveryOffset) {
+    for (size_t len = 1; len < 70; len++) {
+        for (size_t pos = 0; pos < len; pos++) {
+            SCOPED_TRACE(testing::Message() << "len=" << len << " pos=" << pos);
+
+            // U+00E9 in the middle of ASCII, as UTF-8 and as UTF-16.
+            std::vector<uint8_t> u8;
+            std::vector<char16_t> u16;
+            for (size_t i = 0; i < len; i++) {
+                if (i == pos) {
+                    u8.push_back(0xC3);
+                    u8.push_back(0xA9);
+                    u16.push_back(0x00E9);
+                } else {
+                    u8.push_back('a' + i % 26);
+                    u16.push_back('a' + i % 26);
+                }
+            }
+
+            EXPECT_EQ(static_cast<ssize_t>(len), utf8_to_utf16_length(u8.data(), u8.size()));
+            std::vector<char16_t> out16(len + 1);
+            utf8_to_utf16(u8.data(), u8.size(), out16.data(), out16.size());
+            EXPECT_TRUE(std::equal(u16.begin(), u16.end(), out16.begin()));
+            EXPECT_EQ(0, out16[len]);
+            std::vector<char16_t> single(u8.size());
+            EXPECT_EQ(static_cast<ssize_t>(len),
+                      utf8_to_utf16_single_pass(u8.data(), u8.size(), single.data()));
+            EXPECT_TRUE(std::equal(u16.begin(), u16.end(), single.begin()));
+
+            EXPECT_EQ(static_cast<ssize_t>(u8.size()), utf16_to_utf8_length(u16.data(), len));
+            std::vector<char> out8(u8.size() + 1);
+            utf16_to_utf8(u16.data(), len, out8.data(), out8.size());
+            EXPECT_EQ(0, memcmp(u8.data(), out8.data(), u8.size()));
+            EXPECT_EQ(0, out8[u8.size()]);
+            EXPECT_EQ(pos, utf16_to_utf8_ascii_prefix(u16.data(), len, out8.data()));
+        }
+    }
+}
+
+TEST_F(UnicodeTest, UTF16toUTF8LengthMixedScripts) {
+    // 1 + 2 + 3 byte characters, a surrogate pair and a lone surrogate, which
+    // is dropped, repeated so that they fill several blocks.
+    std::vector<char16_t> u16;
+    for (int i = 0; i < 20; i++) {
+        u16.insert(u16.end(), { u'a', 0x00E9, 0x4E2D, 0x6587, 0xD83D, 0xDE00, 0xDC00 });
+    }
+    EXPECT_EQ(20 * (1 + 2 + 3 + 3 + 4), utf16_to_utf8_length(u16.data(), u16.size()));
+}
+
 TEST_F(UnicodeTest, strstr16EmptyTarget) {
     EXPECT_EQ(strstr16(kSearchString, u""), kSearchString)
             << "should return the original pointer";
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <utils/RefBase.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class Item : public RefBase {
+public:
+    explicit Item(int key) : mKey(key) { }
+    int key() const { return mKey; }
+
+private:
+    const int mKey;
+};
+
+// Not trivially movable, so Vector has to move it item by item.
+struct Named {
+    std::string name;
+    sp<Item> item;
+};
+
+// A fixed pseudo-random order of state.range(0) keys.
+static std::vector<int> Keys(benchmark::State& state) {
+    std::vector<int> keys(state.range(0));
+    uint32_t seed = 1;
+    for (auto& key : keys) {
+        seed = seed * 1103515245 + 12345;
+        key = seed >> 8;
+    }
+    return keys;
+}
+
+static void BM_Vector_sp_append(benchmark::State& state) {
+    const std::vector<int> keys = Keys(state);
+    std::vector<sp<Item>> items;
+    for (int key : keys) items.push_back(new Item(key));
+    while (state.KeepRunning()) {
+        Vector<sp<Item>> vector;
+        for (const auto& item : items) {
+            vector.add(item);
+        }
+        benchmark::DoNotOptimize(vector.array());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_Vector_sp_append)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_Vector_sp_insertMiddle(benchmark::State& state) {
+    const std::vector<int> keys = Keys(state);
+    std::vector<sp<Item>> items;
+    for (int key : keys) items.push_back(new Item(key));
+    while (state.KeepRunning()) {
+        Vector<sp<Item>> vector;
+        for (const auto& item : items) {
+            vector.insertAt(item, vector.size() / 2);
+        }
+        benchmark::DoNotOptimize(vector.array());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_Vector_sp_insertMiddle)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_Vector_String8_append(benchmark::State& state) {
+    const std::vector<int> keys = Keys(state);
+    while (state.KeepRunning()) {
+        Vector<String8> vector;
+        for (int key : keys) {
+            vector.add(String8::format("/data/app/com.example.%d", key));
+        }
+        benchmark::DoNotOptimize(vector.array());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_Vector_String8_append)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_Vector_struct_append(benchmark::State& state) {
+    const std::vector<int> keys = Keys(state);
+    std::vector<Named> items;
+    for (int key : keys) items.push_back({ std::to_string(key), new Item(key) });
+    while (state.KeepRunning()) {
+        Vector<Named> vector;
+        for (const auto& item : items) {
+            vector.add(item);
+        }
+        benchmark::DoNotOptimize(vector.array());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_Vector_struct_append)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_SortedVector_sp_add(benchmark::State& state) {
+    const std::vector<int> keys = Keys(state);
+    std::vector<sp<Item>> items;
+    for (int key : keys) items.push_back(new Item(key));
+    while (state.KeepRunning()) {
+        SortedVector<sp<Item>> sorted;
+        for (const auto& item : items) {
+            sorted.add(item);
+        }
+        benchmark::DoNotOptimize(sorted.array());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_SortedVector_sp_add)->Arg(16)->Arg(256)->Arg(4096);
+
+static void BM_SortedVector_int_addRemove(benchmark::State& state) {
+    const std::vector<int> keys = Keys(state);
+    while (state.KeepRunning()) {
+        SortedVector<int> sorted;
+        for (int key : keys) {
+            sorted.add(key);
+        }
+        for (int key : keys) {
+            sorted.remove(key);
+        }
+        benchmark::DoNotOptimize(sorted.array());
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_SortedVector_int_addRemove)->Arg(16)->Arg(256)->Arg(4096);
+
+}  // namespace android
@@ -22,6 +22,9 @@
 
 #include <android/log.h>
 #include <gtest/gtest.h>
+#include <utils/RefBase.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 
 namespace android {
@@ -37,6 +40,28 @@ protected:
 public:
 };
 
+// Counts how often it is copied, and how many are alive.
+struct Counted {
+    static int sCopies;
+    static int sAlive;
+
+    int value;
+
+    Counted() : value(0) { sAlive++; }
+    explicit Counted(int v) : value(v) { sAlive++; }
+    Counted(const Counted& o) : value(o.value) { sCopies++; sAlive++; }
+    Counted(Counted&& o) : value(o.value) { o.value = -1; sAlive++; }
+    ~Counted() { sAlive--; }
+    Counted& operator=(const Counted& o) { value = o.value; sCopies++; return *this; }
+    bool operator<(const Counted& o) const { return value < o.value; }
+};
+
+int Counted::sCopies;
+int Counted::sAlive;
+
+class Tracked : public RefBase {
+};
+
 
 TEST_F(VectorTest, CopyOnWrite_CopyAndAddElements) {
 
@@ -136,4 +161,84 @@ TEST_F(VectorTest, editArray_Shared) {
   }
 }
 
+TEST_F(VectorTest, Relocate_MovesUniqueItems) {
+  Counted::sCopies = 0;
+  Counted::sAlive = 0;
+  {
+    Vector<Counted> vector;
+    for (int i = 0; i < 100; i++) {
+      vector.insertAt(Counted(i), i / 2);
+    }
+    // One copy per insertion into the vector, none to make room.
+    EXPECT_EQ(100, Counted::sCopies);
+    EXPECT_EQ(100, Counted::sAlive);
+
+    vector.removeItemsAt(10, 80);
+    EXPECT_EQ(20U, vector.size());
+    EXPECT_EQ(20, Counted::sAlive);
+    EXPECT_EQ(100, Counted::sCopies);
+
+    // Once shared, making room has to copy.
+    Vector<Counted> other(vector);
+    vector.add(Counted(100));
+    EXPECT_EQ(100 + 20 + 1, Counted::sCopies);
+    EXPECT_EQ(20U, other.size());
+    for (size_t i = 0; i < other.size(); i++) {
+      EXPECT_EQ(other[i].value, vector[i].value);
+    }
+  }
+  EXPECT_EQ(0, Counted::sAlive);
+}
+
+TEST_F(VectorTest, Relocate_StrongPointersKeepTheirCount) {
+  Vector<sp<Tracked>> vector;
+  SortedVector<sp<Tracked>> sorted;
+  for (int i = 0; i < 50; i++) {
+    sp<Tracked> item = new Tracked();
+    vector.insertAt(item, 0);
+    sorted.add(item);
+  }
+  for (size_t i = 0; i < vector.size(); i++) {
+    EXPECT_EQ(2, vector[i]->getStrongCount());
+  }
+
+  // The copy shares the storage, so removing from the vector copies the
+  // items it keeps.
+  Vector<sp<Tracked>> copy(vector);
+  vector.removeItemsAt(0, 40);
+  vector.add(new Tracked());
+  EXPECT_EQ(50U, copy.size());
+  EXPECT_EQ(11U, vector.size());
+  for (size_t i = 0; i < 10; i++) {
+    EXPECT_EQ(copy[40 + i], vector[i]);
+    EXPECT_EQ(3, vector[i]->getStrongCount());
+  }
+  EXPECT_EQ(1, vector[10]->getStrongCount());
+
+  sorted.clear();
+  copy.clear();
+  for (size_t i = 0; i < 10; i++) {
+    EXPECT_EQ(1, vector[i]->getStrongCount());
+  }
+}
+
+TEST_F(VectorTest, Relocate_TriviallyMovableItems) {
+  Vector<String8> vector;
+  for (int i = 0; i < 100; i++) {
+    vector.add(String8::format("a string that is not stored inline #%d", i));
+  }
+  Vector<String8> copy(vector);
+  for (int i = 0; i < 100; i++) {
+    vector.insertAt(String8::format("#%d", i), 0);
+  }
+  vector.removeItemsAt(50, 150);
+  EXPECT_EQ(50U, vector.size());
+  EXPECT_EQ(100U, copy.size());
+  EXPECT_STREQ("#99", vector[0].string());
+  EXPECT_STREQ("#50", vector[49].string());
+  EXPECT_STREQ("a string that is not stored inline #99", copy[99].string());
+  copy.removeItemsAt(1, 99);
+  EXPECT_STREQ("a string that is not stored inline #0", copy[0].string());
+}
+
 } // namespace android